@@ -0,0 +1,175 @@
+/// whenever_tray
+///
+/// Replay of a trace recorded by the tray (see `trace_file`) through the
+/// processing of the scheduler output: the chunks read from the scheduler
+/// are split in lines and each line goes through the same work done by the
+/// tray when a line arrives (post-mortem buffer, acknowledgement of the
+/// pending command, parsing, counters by level, last task started), and
+/// optionally through the task statistics. The trace is replayed as fast as
+/// possible, unless its original timing is requested, as in
+///
+///     wt_replay [-r] [-s] [-n repeat] trace
+///
+/// where `-r` keeps the original timing and `-s` adds the task statistics.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "../wt_output.h"
+#include "../wt_postmortem.h"
+#include "../wt_taskstats.h"
+#include "../wt_trace.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+// commands and fragments of their acknowledgements, as in whenever_tray.cpp
+static const char* REPLAY_COMMANDS[][2] = {
+    { "pause\n", "paus" },
+    { "resume\n", "resum" },
+    { "reset_conditions\n", "reset" },
+    { NULL, NULL },
+};
+
+// The work done by the tray for each line of output
+class ReplaySink : public WTLineSink {
+public:
+    ReplaySink(bool stats) : lines(0), bytes(0), acks(0), tasks(0), pending(NULL) {
+        memset(levels, 0, sizeof(levels));
+        m_stats = stats;
+        m_lastTask[0] = 0;
+    }
+
+    virtual void OnLine(WTOutputStream stream, const char* line, size_t len) {
+        m_postMortem.AddLine(stream, line, len);
+        lines++;
+        bytes += len + 1;
+        if (pending && WTLineContains(line, len, pending)) {
+            pending = NULL;
+            acks++;
+        }
+        WTLogRecord rec;
+        bool parsed = WTParseLogLine(line, len, rec);
+        levels[rec.level]++;
+        if (parsed && rec.context.Is("TASK") && rec.when.Is("START")) {
+            size_t n = rec.name.len < sizeof(m_lastTask) - 1 ? rec.name.len : sizeof(m_lastTask) - 1;
+            memcpy(m_lastTask, rec.name.ptr, n);
+            m_lastTask[n] = 0;
+            tasks++;
+        }
+        if (m_stats) {
+            m_taskStats.Feed(line, len);
+        }
+    }
+
+    // a command has been sent to the scheduler
+    void Command(const char* data, size_t len) {
+        for (int i = 0; REPLAY_COMMANDS[i][0]; i++) {
+            if (strlen(REPLAY_COMMANDS[i][0]) == len
+                && memcmp(REPLAY_COMMANDS[i][0], data, len) == 0) {
+                pending = REPLAY_COMMANDS[i][1];
+            }
+        }
+    }
+
+    unsigned long long lines;
+    unsigned long long bytes;
+    unsigned long long acks;
+    unsigned long long tasks;
+    unsigned long long levels[WT_LEVEL_COUNT];
+    const char* pending;
+
+private:
+    bool m_stats;
+    char m_lastTask[64];
+    WTPostMortem m_postMortem;
+    WTTaskStats m_taskStats;
+};
+
+int main(int argc, char** argv) {
+    bool realtime = false, stats = false;
+    int repeat = 1;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            realtime = true;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            stats = true;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path || repeat <= 0) {
+        fprintf(stderr, "usage: %s [-r] [-s] [-n repeat] trace\n", argv[0]);
+        return 2;
+    }
+
+    ReplaySink sink(stats);
+    unsigned long long records = 0, chunks = 0, traced_ns = 0;
+    double busy = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (int round = 0; round < repeat; round++) {
+        WTTraceReader reader;
+        if (!reader.Open(path)) {
+            fprintf(stderr, "%s: not a trace\n", path);
+            return 1;
+        }
+        WTLineSplitter out(WT_STREAM_STDOUT, &sink), err(WT_STREAM_STDERR, &sink);
+        bench_clock::time_point round_start = bench_clock::now();
+        WTTraceRecord rec;
+        while (reader.Next(rec)) {
+            records++;
+            if (realtime) {
+                std::this_thread::sleep_until(round_start + std::chrono::nanoseconds(rec.time_ns));
+            }
+            bench_clock::time_point t = bench_clock::now();
+            switch (rec.kind) {
+            case WT_TRACE_STDIN:
+                sink.Command(rec.data, rec.len);
+                break;
+            case WT_TRACE_STDOUT:
+                out.Feed(rec.data, rec.len);
+                chunks++;
+                break;
+            case WT_TRACE_STDERR:
+                err.Feed(rec.data, rec.len);
+                chunks++;
+                break;
+            case WT_TRACE_EXIT:
+                out.Flush();
+                err.Flush();
+                break;
+            default:
+                break;
+            }
+            busy += std::chrono::duration<double>(bench_clock::now() - t).count();
+            traced_ns = rec.time_ns;
+        }
+        out.Flush();
+        err.Flush();
+    }
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    printf("records        %llu (%llu output chunks)\n", records, chunks);
+    printf("lines          %llu (%.1f MB)\n", sink.lines, sink.bytes / (1024.0 * 1024.0));
+    printf("tasks started  %llu, commands acknowledged %llu\n", sink.tasks, sink.acks);
+    for (int i = 0; i < WT_LEVEL_COUNT; i++) {
+        if (sink.levels[i]) {
+            printf("  %-12s %llu\n", WTLogLevelName((WTLogLevel)i), sink.levels[i]);
+        }
+    }
+    printf("traced time    %.3f s per round\n", traced_ns / 1e9);
+    printf("elapsed        %.3f s, processing %.3f s\n", elapsed, busy);
+    if (busy > 0) {
+        printf("throughput     %.0f lines/s, %.1f MB/s\n",
+               sink.lines / busy, sink.bytes / (1024.0 * 1024.0) / busy);
+    }
+    return 0;
+}
+
+// end.
@@ -0,0 +1,89 @@
+/// whenever_tray
+///
+/// Benchmark of the time needed to spawn a process with redirected streams
+/// and wait for it to exit, using the native spawning of the tray and using
+/// wxExecute as the tray did before: the spawned program is `true`, unless
+/// another one is given on the command line, as in
+///
+///     wt_spawn_bench [iterations [program [args...]]]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "wx/wx.h"
+#include "wx/init.h"
+#include "wx/process.h"
+
+#include "../wt_process.h"
+
+#define BENCH_DEFAULT_ITERATIONS 500
+
+typedef std::chrono::steady_clock bench_clock;
+
+// average time in microseconds between two instants over n iterations
+static double average_us(bench_clock::time_point start, bench_clock::time_point end, int n) {
+    return std::chrono::duration<double, std::micro>(end - start).count() / n;
+}
+
+int main(int argc, char** argv) {
+    wxInitializer initializer;
+    if (!initializer.IsOk()) {
+        fprintf(stderr, "could not initialize wxWidgets\n");
+        return 1;
+    }
+
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+    if (iterations <= 0) {
+        iterations = BENCH_DEFAULT_ITERATIONS;
+    }
+    WTSpawnOptions options;
+    if (argc > 2) {
+        for (int i = 2; i < argc; i++) {
+            options.argv.push_back(argv[i]);
+        }
+    } else {
+        options.argv.push_back("true");
+    }
+    options.env = WTCurrentEnvironment();
+
+    // native spawning
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        WTChildProcess child;
+        int status;
+        if (!child.Spawn(options) || !child.Reap(status, true)) {
+            perror("spawn");
+            return 1;
+        }
+    }
+    double native_us = average_us(start, bench_clock::now(), iterations);
+
+    // wxExecute, with the same redirection
+    std::vector<const char*> args;
+    for (size_t i = 0; i < options.argv.size(); i++) {
+        args.push_back(options.argv[i].c_str());
+    }
+    args.push_back(NULL);
+    start = bench_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        wxProcess* process = new wxProcess();
+        process->Redirect();
+        if (wxExecute(&args[0], wxEXEC_SYNC | wxEXEC_NOEVENTS | wxEXEC_MAKE_GROUP_LEADER,
+                      process) < 0) {
+            fprintf(stderr, "wxExecute failed\n");
+            return 1;
+        }
+        delete process;
+    }
+    double wx_us = average_us(start, bench_clock::now(), iterations);
+
+    printf("%-12s %10s\n", "method", "us/spawn");
+    printf("%-12s %10.1f\n", "native", native_us);
+    printf("%-12s %10.1f\n", "wxExecute", wx_us);
+    return 0;
+}
+
+// end.
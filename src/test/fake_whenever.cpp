@@ -0,0 +1,237 @@
+/// whenever_tray
+///
+/// Stand-in for the *whenever* scheduler, used by the tests: it accepts the
+/// command line the tray passes to the scheduler, prints lines in the
+/// *whenever* log format, and acknowledges the commands it reads from its
+/// standard input as the real scheduler does. Its behavior is scripted with
+/// environment variables, so that it can also be run by the tray itself by
+/// setting `whenever_command` and `whenever_environment`:
+///
+///     FAKE_WHENEVER_READY_DELAY   milliseconds before the first line is
+///                                 printed and commands are read
+///     FAKE_WHENEVER_RATE          task records per second, -1 for as many
+///                                 as possible (default 0)
+///     FAKE_WHENEVER_LINE_SIZE     length of the task records (default 80)
+///     FAKE_WHENEVER_ACK_DELAY     milliseconds before acknowledging a
+///                                 command
+///     FAKE_WHENEVER_IGNORE_EXIT   1 to acknowledge `exit` without leaving
+///     FAKE_WHENEVER_HANG_AFTER    milliseconds after which the scheduler
+///                                 stops reading and writing for good
+///     FAKE_WHENEVER_CRASH_AFTER   milliseconds after which it aborts
+///     FAKE_WHENEVER_LEAVE_CHILD   milliseconds a child lives on after the
+///                                 scheduler has exited, keeping its output
+///                                 open, as a task still running would do
+///
+/// Lines are also appended to the log given with `-l`, if any. Only POSIX
+/// systems are supported.
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define FAKE_DEFAULT_LINE_SIZE 80
+#define FAKE_MAX_LINE_SIZE 65536
+
+// the whole behavior, as read from the environment
+struct FakeScript {
+    long ready_delay;
+    long rate;
+    long line_size;
+    long ack_delay;
+    bool ignore_exit;
+    long hang_after;
+    long crash_after;
+    long leave_child;
+};
+
+static long env_long(const char* name, long value) {
+    const char* s = getenv(name);
+    return s && *s ? atol(s) : value;
+}
+
+static long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int log_fd = -1;
+
+// write a whole buffer to a descriptor, blocking as a real program would
+static void write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// print a line in the log format, padded with dots to the given length
+static void emit(const char* level, const char* body, long pad_to = 0) {
+    static char line[FAKE_MAX_LINE_SIZE + 2];
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct tm t;
+    localtime_r(&tv.tv_sec, &t);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &t);
+    int n = snprintf(line, FAKE_MAX_LINE_SIZE, "[%s.%03d] (whenever) %-5s %s",
+                     stamp, (int)(tv.tv_usec / 1000), level, body);
+    if (n < 0) {
+        return;
+    }
+    if (n > FAKE_MAX_LINE_SIZE - 1) {
+        n = FAKE_MAX_LINE_SIZE - 1;
+    }
+    while (n < pad_to && n < FAKE_MAX_LINE_SIZE - 1) {
+        line[n++] = '.';
+    }
+    line[n++] = '\n';
+    write_all(1, line, n);
+    if (log_fd >= 0) {
+        write_all(log_fd, line, n);
+    }
+}
+
+// stop for good: the process stays alive, but does nothing
+static void hang() {
+    for (;;) {
+        pause();
+    }
+}
+
+int main(int argc, char** argv) {
+    FakeScript script;
+    script.ready_delay = env_long("FAKE_WHENEVER_READY_DELAY", 0);
+    script.rate = env_long("FAKE_WHENEVER_RATE", 0);
+    script.line_size = env_long("FAKE_WHENEVER_LINE_SIZE", FAKE_DEFAULT_LINE_SIZE);
+    script.ack_delay = env_long("FAKE_WHENEVER_ACK_DELAY", 0);
+    script.ignore_exit = env_long("FAKE_WHENEVER_IGNORE_EXIT", 0) != 0;
+    script.hang_after = env_long("FAKE_WHENEVER_HANG_AFTER", -1);
+    script.crash_after = env_long("FAKE_WHENEVER_CRASH_AFTER", -1);
+    script.leave_child = env_long("FAKE_WHENEVER_LEAVE_CHILD", 0);
+
+    // the command line of the scheduler: options, then the configuration
+    bool paused = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            log_fd = open(argv[++i], O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        } else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+            i++;
+        } else if (strcmp(argv[i], "--pause") == 0) {
+            paused = true;
+        }
+    }
+
+    long long started = now_ms();
+    if (script.ready_delay > 0) {
+        usleep(script.ready_delay * 1000);
+    }
+    emit("INFO", "MAIN whenever/[START/OK] scheduler started");
+    if (paused) {
+        emit("INFO", "MAIN whenever/[PAUSE/OK] scheduler paused");
+    }
+
+    // records are printed at the scripted rate, in pairs of start and end
+    // of a fake task, while commands are read between them
+    long long rate_start = now_ms();
+    long long rate_count = 0;
+    unsigned long long records = 0;
+    std::string input;
+    for (;;) {
+        long long now = now_ms();
+        if (script.crash_after >= 0 && now - started >= script.crash_after) {
+            abort();
+        }
+        if (script.hang_after >= 0 && now - started >= script.hang_after) {
+            hang();
+        }
+
+        int timeout = 100;
+        if (script.rate < 0) {
+            timeout = 0;
+        } else if (script.rate > 0 && !paused) {
+            long long next_record = rate_start + (rate_count + 1) * 1000 / script.rate;
+            timeout = next_record > now ? (int)(next_record - now) : 0;
+            if (timeout > 100) {
+                timeout = 100;
+            }
+        }
+        struct pollfd pfd;
+        pfd.fd = 0;
+        pfd.events = POLLIN;
+        int ready = poll(&pfd, 1, timeout);
+        if (ready > 0) {
+            char buf[4096];
+            ssize_t n = read(0, buf, sizeof(buf));
+            if (n <= 0) {
+                // the tray has gone: the real scheduler leaves as well
+                emit("WARN", "MAIN whenever/[END/FAIL] input closed, exiting");
+                return 0;
+            }
+            input.append(buf, n);
+            size_t nl;
+            while ((nl = input.find('\n')) != std::string::npos) {
+                std::string cmd = input.substr(0, nl);
+                input.erase(0, nl + 1);
+                if (script.ack_delay > 0) {
+                    usleep(script.ack_delay * 1000);
+                }
+                if (cmd == "pause") {
+                    paused = true;
+                    emit("INFO", "MAIN whenever/[PAUSE/OK] scheduler paused");
+                } else if (cmd == "resume") {
+                    paused = false;
+                    rate_start = now_ms();
+                    rate_count = 0;
+                    emit("INFO", "MAIN whenever/[RESUME/OK] scheduler resumed");
+                } else if (cmd == "reset_conditions") {
+                    emit("INFO", "MAIN whenever/[RESET/OK] conditions reset");
+                } else if (cmd == "exit") {
+                    emit("INFO", "MAIN whenever/[END/OK] scheduler exiting");
+                    if (!script.ignore_exit) {
+                        if (script.leave_child > 0 && fork() == 0) {
+                            usleep(script.leave_child * 1000);
+                            _exit(0);
+                        }
+                        return 0;
+                    }
+                } else {
+                    emit("WARN", ("MAIN whenever/[INPUT/ERR] unknown command " + cmd).c_str());
+                }
+            }
+        }
+
+        if (script.rate != 0 && !paused) {
+            now = now_ms();
+            while (script.rate < 0 || rate_count < script.rate * (now - rate_start) / 1000) {
+                char body[64];
+                snprintf(body, sizeof(body), "TASK FakeTask/[%s/OK] record %llu ",
+                         records % 2 ? "END" : "START", records);
+                emit("INFO", body, script.line_size);
+                records++;
+                rate_count++;
+                if (script.rate < 0) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// end.
@@ -0,0 +1,357 @@
+/// whenever_tray
+///
+/// Tests of the controller thread against the fake scheduler: each test
+/// drives the fake only through the requests and events of the controller,
+/// as the tray does, and checks the time taken by the lifecycle and the
+/// commands against fixed budgets. The test to run is named on the command
+/// line:
+///
+///     wt_controller_test path/to/fake_whenever test
+///
+/// and the exit status is 0 if it passes. No display is needed.
+
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "../wt_controller.h"
+#include "../wt_timing.h"
+#include "wt_test.h"
+
+// budgets, generous enough for loaded build machines
+#define BUDGET_SETTLE 150       // milliseconds, besides the settle time
+#define BUDGET_EXIT 500         // milliseconds
+#define BUDGET_KILL 500         // milliseconds
+#define BUDGET_ACK 250          // milliseconds
+#define BUDGET_ACK_FLOOD 1000   // milliseconds
+#define BUDGET_REQUEST 20       // milliseconds
+
+// exit with the output still open: where the exit is watched through a
+// pidfd the budget is below the reap interval, so that the periodic
+// reaping of the children alone cannot meet it
+#if defined(__linux__) && defined(SYS_pidfd_open)
+#define BUDGET_NOTICE 30        // milliseconds
+static_assert(BUDGET_NOTICE < WT_CONTROL_REAP_INTERVAL,
+              "the exit must be noticed before the children are reaped");
+#else
+#define BUDGET_NOTICE (WT_CONTROL_REAP_INTERVAL + 50)
+#endif
+
+static const char* fake_path = NULL;
+
+
+// ----------------------------------------------------------------------------
+// the controller, seen from the tray
+// ----------------------------------------------------------------------------
+
+// A controller with a single fake scheduler, whose events are taken as in
+// the tray: the notification only wakes up the thread that takes them
+class FakeSession : public WTControlListener, public WTLineSink {
+public:
+    FakeSession()
+        : spawned_at(0), pid(0), spawn_status(0), exited_at(0), exit_status(0),
+          lines(0), bytes(0), most_taken(0), waiting(NULL), sent_at(0), acked_at(0),
+          m_notified(false), m_out(WT_STREAM_STDOUT, this), m_err(WT_STREAM_STDERR, this) {
+        controller.Start(this);
+    }
+    ~FakeSession() {
+        controller.Stop();
+    }
+
+    virtual void OnControlEvents() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_notified = true;
+        m_cond.notify_one();
+    }
+
+    // spawn the fake with the scripted environment
+    void Spawn(const std::vector<std::string>& script, long settle_ms,
+               const char* path = NULL) {
+        WTSpawnOptions options;
+        options.argv.push_back(path ? path : fake_path);
+        options.argv.push_back("-L");
+        options.argv.push_back("info");
+        options.argv.push_back("whenever.toml");
+        options.env = WTCurrentEnvironment();
+        for (size_t i = 0; i < script.size(); i++) {
+            WTSetEnvironment(options.env, script[i]);
+        }
+        started_at = now_ms();
+        controller.Spawn(1, options, settle_ms);
+    }
+
+    void Send(const char* command, const char* ack) {
+        waiting = ack;
+        acked_at = 0;
+        sent_at = now_ms();
+        controller.Write(1, command);
+    }
+
+    // take the events for at most ms milliseconds, or until done is true
+    bool Pump(long ms, std::function<bool()> done) {
+        long long until = now_ms() + ms;
+        std::vector<WTControlEvent> events;
+        for (;;) {
+            if (done()) {
+                return true;
+            }
+            long long now = now_ms();
+            if (now >= until) {
+                return false;
+            }
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (!m_notified) {
+                    m_cond.wait_for(lock, std::chrono::milliseconds(until - now));
+                }
+                m_notified = false;
+            }
+            controller.TakeEvents(events);
+            size_t taken = 0;
+            for (size_t i = 0; i < events.size(); i++) {
+                Handle(events[i]);
+                taken += events[i].data.size();
+            }
+            most_taken = taken > most_taken ? taken : most_taken;
+        }
+    }
+
+    void Drain(long ms) {
+        Pump(ms, []() { return false; });
+    }
+
+    virtual void OnLine(WTOutputStream, const char* line, size_t len) {
+        lines++;
+        if (waiting && WTLineContains(line, len, waiting)) {
+            waiting = NULL;
+            acked_at = now_ms();
+        }
+    }
+
+    bool Acked() const {
+        return acked_at != 0;
+    }
+
+    WTProcessController controller;
+    long long started_at;
+    long long spawned_at;
+    long pid;
+    int spawn_status;
+    long long exited_at;
+    int exit_status;
+    unsigned long long lines;
+    unsigned long long bytes;
+    size_t most_taken;
+    const char* waiting;
+    long long sent_at;
+    long long acked_at;
+
+private:
+    void Handle(WTControlEvent& event) {
+        switch (event.kind) {
+        case WT_CONTROL_SPAWNED:
+            spawned_at = now_ms();
+            pid = event.pid;
+            spawn_status = event.status;
+            break;
+        case WT_CONTROL_OUTPUT:
+            bytes += event.data.size();
+            (event.stream == WT_STREAM_STDERR ? m_err : m_out).Feed(
+                event.data.data(), event.data.size());
+            break;
+        case WT_CONTROL_EXITED:
+            m_out.Flush();
+            m_err.Flush();
+            exited_at = now_ms();
+            exit_status = event.status;
+            break;
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_notified;
+    WTLineSplitter m_out;
+    WTLineSplitter m_err;
+};
+
+// send a command and wait for its acknowledgement, checking the latency
+static bool command(FakeSession& fake, const char* cmd, const char* ack, long budget) {
+    long long before = now_ms();
+    fake.Send(cmd, ack);
+    long long took = now_ms() - before;
+    check(took <= BUDGET_REQUEST, "request queued at once", took);
+    fake.Pump(APP_ACK_TIMEOUT, [&]() { return fake.Acked(); });
+    long long latency = fake.Acked() ? fake.acked_at - fake.sent_at : APP_ACK_TIMEOUT;
+    return check(fake.Acked() && latency <= budget, "command acknowledged in time", latency);
+}
+
+
+// ----------------------------------------------------------------------------
+// tests
+// ----------------------------------------------------------------------------
+
+// the spawned event follows the settle time, and the first lines arrive
+static void test_settle() {
+    FakeSession fake;
+    fake.Spawn({ "FAKE_WHENEVER_RATE=50" }, APP_START_SLEEP);
+    fake.Pump(APP_START_SLEEP + BUDGET_SETTLE + 1000, [&]() { return fake.spawned_at != 0; });
+    long long settle = fake.spawned_at - fake.started_at;
+    check(fake.spawned_at && fake.pid > 0, "spawned");
+    check(settle >= APP_START_SLEEP && settle <= APP_START_SLEEP + BUDGET_SETTLE,
+          "settled in time", fake.spawned_at ? settle : -1);
+    fake.Drain(200);
+    check(fake.lines > 0, "output received", (long long)fake.lines);
+}
+
+// a program that cannot be spawned, or that leaves before settling, is
+// reported as not running
+static void test_failure() {
+    FakeSession missing;
+    missing.Spawn({}, APP_START_SLEEP, "/nonexistent/whenever");
+    missing.Pump(BUDGET_SETTLE, [&]() { return missing.spawned_at != 0; });
+    check(missing.spawned_at && missing.pid == 0 && missing.spawn_status != 0,
+          "spawn failure reported", missing.spawn_status);
+
+    FakeSession crash;
+    crash.Spawn({ "FAKE_WHENEVER_CRASH_AFTER=50" }, APP_START_SLEEP);
+    crash.Pump(APP_START_SLEEP, [&]() { return crash.exited_at != 0; });
+    long long left = crash.exited_at - crash.started_at;
+    check(crash.spawned_at && crash.pid == 0, "early exit reported as not running");
+    check(crash.exited_at && left <= 50 + BUDGET_EXIT, "exit reported in time",
+          crash.exited_at ? left : -1);
+    check(crash.exit_status == -SIGABRT, "killed by SIGABRT");
+}
+
+// commands are acknowledged within the budget, and the exit is seen
+static void test_commands() {
+    FakeSession fake;
+    fake.Spawn({ "FAKE_WHENEVER_RATE=50" }, 0);
+    fake.Drain(200);
+    command(fake, "pause\n", "paus", BUDGET_ACK);
+    command(fake, "resume\n", "resum", BUDGET_ACK);
+    command(fake, "reset_conditions\n", "reset", BUDGET_ACK);
+    long long before = now_ms();
+    fake.controller.Write(1, "exit\n");
+    fake.controller.Kill(1, APP_KILL_SLEEP);
+    fake.Pump(APP_KILL_SLEEP + BUDGET_KILL, [&]() { return fake.exited_at != 0; });
+    long long left = fake.exited_at - before;
+    check(fake.exited_at && left <= BUDGET_EXIT, "left after exit", fake.exited_at ? left : -1);
+    check(fake.exit_status == 0, "exit status 0");
+}
+
+// a scheduler ignoring the exit command is killed after the grace period
+static void test_kill() {
+    FakeSession fake;
+    fake.Spawn({ "FAKE_WHENEVER_IGNORE_EXIT=1" }, 0);
+    fake.Drain(100);
+    long long before = now_ms();
+    fake.controller.Write(1, "exit\n");
+    fake.controller.Kill(1, APP_KILL_SLEEP);
+    fake.Pump(APP_KILL_SLEEP + BUDGET_KILL, [&]() { return fake.exited_at != 0; });
+    long long left = fake.exited_at - before;
+    check(fake.exited_at && left >= APP_KILL_SLEEP && left <= APP_KILL_SLEEP + BUDGET_KILL,
+          "killed in time", fake.exited_at ? left : -1);
+    check(fake.exit_status == -SIGKILL, "killed by SIGKILL");
+}
+
+// under a flood the output waiting to be taken is bounded, and commands
+// are still acknowledged in time
+static void test_flood() {
+    FakeSession fake;
+    fake.Spawn({ "FAKE_WHENEVER_RATE=-1", "FAKE_WHENEVER_LINE_SIZE=1024" }, 0);
+    usleep(500 * 1000);
+    fake.Drain(500);
+    check(fake.bytes >= 1024 * 1024, "output read", (long long)fake.bytes);
+    check(fake.most_taken <= WT_CONTROL_OUTPUT_MAX + 2 * WT_CONTROL_READ_CHUNK,
+          "waiting output bounded", (long long)fake.most_taken);
+    command(fake, "pause\n", "paus", BUDGET_ACK_FLOOD);
+    command(fake, "resume\n", "resum", BUDGET_ACK_FLOOD);
+    fake.controller.Write(1, "exit\n");
+    fake.controller.Kill(1, APP_KILL_SLEEP);
+    fake.Pump(APP_KILL_SLEEP + BUDGET_KILL, [&]() { return fake.exited_at != 0; });
+    check(fake.exited_at && fake.exit_status == 0, "left after exit");
+}
+
+// the exit is seen at once also when a process left behind keeps the
+// output open, and the output that follows is not waited for
+static void test_linger() {
+    FakeSession fake;
+    fake.Spawn({ "FAKE_WHENEVER_LEAVE_CHILD=3000" }, 0);
+    fake.Pump(1000, [&]() { return fake.spawned_at != 0; });
+    long long before = now_ms();
+    fake.controller.Write(1, "exit\n");
+    fake.Pump(BUDGET_EXIT, [&]() { return fake.exited_at != 0; });
+    long long left = fake.exited_at - before;
+    check(fake.exited_at && left <= BUDGET_NOTICE, "exit noticed in time",
+          fake.exited_at ? left : -1);
+    check(fake.exit_status == 0, "exit status 0");
+    if (fake.pid > 0) {
+        kill(-(pid_t)fake.pid, SIGKILL);
+    }
+}
+
+// a released child is killed and reaped, and no more events arrive
+static void test_release() {
+    FakeSession fake;
+    fake.Spawn({ "FAKE_WHENEVER_RATE=50" }, 0);
+    fake.Pump(1000, [&]() { return fake.spawned_at != 0; });
+    long pid = fake.pid;
+    fake.controller.Release(1);
+    fake.Drain(100);
+    std::vector<WTControlEvent> events;
+    fake.controller.TakeEvents(events);
+    usleep(200 * 1000);
+    fake.controller.TakeEvents(events);
+    check(events.empty(), "no events after release", (long long)events.size());
+    check(pid > 0 && kill((pid_t)pid, 0) != 0, "killed and reaped");
+}
+
+// stopping the controller waits for the scheduler to leave by itself
+static void test_stop() {
+    FakeSession fake;
+    fake.Spawn({ "FAKE_WHENEVER_RATE=50" }, 0);
+    fake.Pump(1000, [&]() { return fake.spawned_at != 0; });
+    long pid = fake.pid;
+    fake.controller.Write(1, "exit\n");
+    long long before = now_ms();
+    fake.controller.Stop(APP_KILL_SLEEP);
+    long long took = now_ms() - before;
+    check(took <= BUDGET_EXIT, "stopped in time", took);
+    check(pid > 0 && kill((pid_t)pid, 0) != 0, "scheduler gone");
+}
+
+static const TestCase TESTS[] = {
+    { "settle", test_settle },
+    { "failure", test_failure },
+    { "commands", test_commands },
+    { "kill", test_kill },
+    { "flood", test_flood },
+    { "linger", test_linger },
+    { "release", test_release },
+    { "stop", test_stop },
+    { NULL, NULL },
+};
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s fake_whenever test\n", argv[0]);
+        return 2;
+    }
+    fake_path = argv[1];
+    return run_test(TESTS, argv[2]);
+}
+
+// end.
@@ -0,0 +1,230 @@
+/// whenever_tray
+///
+/// Tests of the excerpts and of the log reader across rotations: each test
+/// writes a log in a temporary directory with a rotated segment of several
+/// blocks, compressed as the tray does, and extracts or reads a time range
+/// that spans the compressed segment and the live log, checking the result
+/// against the lines expected. The test to run is named on the command line:
+///
+///     wt_excerpt_test test
+///
+/// and the exit status is 0 if it passes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../wt_excerpt.h"
+#include "../wt_logreader.h"
+#include "../wt_logrotate.h"
+#include "wt_test.h"
+
+// lines of the rotated segment, enough for a few blocks, and of the live
+// log; the lines are 100 ms apart
+#define TEST_SEGMENT_LINES 40000
+#define TEST_LIVE_LINES 1000
+#define TEST_SEGMENT_NAME "whenever.log.20240101-000000"
+
+// first and last line of the range, which spans whole blocks of the
+// segment and the beginning of the live log
+#define TEST_FROM_LINE 5000
+#define TEST_TO_LINE (TEST_SEGMENT_LINES + TEST_LIVE_LINES / 2)
+
+
+// ----------------------------------------------------------------------------
+// the log, with a compressed segment
+// ----------------------------------------------------------------------------
+
+// the timestamp of a line, as written and as parsed
+static std::string line_stamp(int n) {
+    char stamp[32];
+    long ms = n * 100L;
+    snprintf(stamp, sizeof(stamp), "2024-01-01 %02ld:%02ld:%02ld.%03ld",
+             ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+    return stamp;
+}
+
+static long long line_time(int n) {
+    std::string stamp = line_stamp(n);
+    long long ts = 0;
+    WTParseTimestamp(stamp.c_str(), stamp.size(), ts);
+    return ts;
+}
+
+static std::string line_text(int n) {
+    char line[160];
+    snprintf(line, sizeof(line), "[%s] (whenever) INFO  test line %06d "
+             "with some padding to make the segment span several blocks",
+             line_stamp(n).c_str(), n);
+    return line;
+}
+
+// A log in a temporary directory: a compressed segment followed by the
+// live log, and the lines expected within the test range
+class TestLog {
+public:
+    TestLog() {
+        char dir[] = "/tmp/wt_excerpt_XXXXXX";
+        if (mkdtemp(dir)) {
+            m_dir = dir;
+        }
+        path = m_dir + "/whenever.log";
+        segment = m_dir + "/" TEST_SEGMENT_NAME;
+    }
+    ~TestLog() {
+        if (!m_dir.empty()) {
+            std::string cmd = "rm -rf '" + m_dir + "'";
+            if (system(cmd.c_str()) != 0) {
+                fprintf(stderr, "cannot remove %s\n", m_dir.c_str());
+            }
+        }
+    }
+
+    bool Create() {
+        if (m_dir.empty() || !Write(segment, 0, TEST_SEGMENT_LINES)
+            || !Write(path, TEST_SEGMENT_LINES, TEST_SEGMENT_LINES + TEST_LIVE_LINES)) {
+            return false;
+        }
+        WTCompressStats stats;
+        return WTCompressLogSegment(segment, 6, stats);
+    }
+
+    std::string Expected() const {
+        std::string text;
+        for (int n = TEST_FROM_LINE; n <= TEST_TO_LINE; n++) {
+            text += line_text(n) + "\n";
+        }
+        return text;
+    }
+
+    std::string Path(const char* name) const {
+        return m_dir + "/" + name;
+    }
+
+    std::string path;
+    std::string segment;
+
+private:
+    bool Write(const std::string& file, int first, int end) {
+        FILE* f = fopen(file.c_str(), "w");
+        if (!f) {
+            return false;
+        }
+        for (int n = first; n < end; n++) {
+            fprintf(f, "%s\n", line_text(n).c_str());
+        }
+        return fclose(f) == 0;
+    }
+
+    std::string m_dir;
+};
+
+// read a file, decompressing it if it is a gzip file
+static std::string read_file(const std::string& path) {
+    std::string text;
+    gzFile f = gzopen(path.c_str(), "rb");
+    if (!f) {
+        return text;
+    }
+    char buf[65536];
+    int n;
+    while ((n = gzread(f, buf, sizeof(buf))) > 0) {
+        text.append(buf, n);
+    }
+    gzclose(f);
+    return text;
+}
+
+// collects the lines delivered by the reader
+class TextSink : public WTLineSink {
+public:
+    virtual void OnLine(WTOutputStream /* stream */, const char* line, size_t len) {
+        text.append(line, len);
+        text += "\n";
+    }
+    std::string text;
+};
+
+
+// ----------------------------------------------------------------------------
+// tests
+// ----------------------------------------------------------------------------
+
+// a plain excerpt: the blocks of the compressed segment are decompressed,
+// so that the excerpt is made of lines only
+static void test_plain() {
+    TestLog log;
+    check(log.Create(), "log created");
+    std::vector<WTLogBlock> blocks;
+    WTReadLogIndex(WTLogIndexPath(log.segment + WT_LOG_GZ_SUFFIX), blocks);
+    check(blocks.size() >= 3, "segment in several blocks", (long long)blocks.size());
+    std::string out = log.Path("excerpt.log");
+    WTExcerptStats stats;
+    check(WTExtractLog(log.path, line_time(TEST_FROM_LINE), line_time(TEST_TO_LINE),
+                       out, false, stats), "extracted");
+    FILE* f = fopen(out.c_str(), "rb");
+    int magic = f ? fgetc(f) : EOF;
+    if (f) {
+        fclose(f);
+    }
+    check(magic == '[', "starts with a line");
+    std::string text = read_file(out);
+    check(text == log.Expected(), "expected lines", (long long)text.size());
+    check(stats.segments == 2, "segment and live log", stats.segments);
+}
+
+// a compressed excerpt: the blocks within the range are copied, and the
+// result is a valid gzip file with the expected lines
+static void test_compressed() {
+    TestLog log;
+    check(log.Create(), "log created");
+    std::string out = log.Path("excerpt.log.gz");
+    WTExcerptStats stats;
+    check(WTExtractLog(log.path, line_time(TEST_FROM_LINE), line_time(TEST_TO_LINE),
+                       out, true, stats), "extracted");
+    check(stats.bytes_copied > 0, "blocks copied", (long long)stats.bytes_copied);
+    std::string text = read_file(out);
+    check(text == log.Expected(), "expected lines", (long long)text.size());
+}
+
+// the reader returns the same lines, and fails on a damaged compressed
+// segment instead of silently leaving its lines out
+static void test_reader() {
+    TestLog log;
+    check(log.Create(), "log created");
+    WTLogReader reader;
+    reader.SetPath(log.path);
+    TextSink sink;
+    check(reader.Read(line_time(TEST_FROM_LINE), line_time(TEST_TO_LINE), &sink), "read");
+    check(sink.text == log.Expected(), "expected lines", (long long)sink.text.size());
+
+    std::string gz = log.segment + WT_LOG_GZ_SUFFIX;
+    check(truncate(gz.c_str(), 1024) == 0, "segment damaged");
+    WTLogReader damaged;
+    damaged.SetPath(log.path);
+    TextSink lost;
+    check(!damaged.Read(line_time(TEST_FROM_LINE), line_time(TEST_TO_LINE), &lost),
+          "damaged segment reported");
+}
+
+static const TestCase TESTS[] = {
+    { "plain", test_plain },
+    { "compressed", test_compressed },
+    { "reader", test_reader },
+    { NULL, NULL },
+};
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s test\n", argv[0]);
+        return 2;
+    }
+    return run_test(TESTS, argv[1]);
+}
+
+// end.
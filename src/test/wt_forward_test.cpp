@@ -0,0 +1,221 @@
+/// whenever_tray
+///
+/// Tests of the forwarder against a local receiver: each test binds an
+/// AF_UNIX datagram socket in a temporary directory, forwards lines to it
+/// as the tray does, and checks the records received and the counters of
+/// sent, dropped and failed records. The test to run is named on the
+/// command line:
+///
+///     wt_forward_test test
+///
+/// and the exit status is 0 if it passes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../wt_forward.h"
+#include "wt_test.h"
+
+// lines forwarded at once to fill the ring, and time given to the
+// forwarder thread to settle
+#define TEST_FLOOD_LINES 5000
+#define TEST_SETTLE 2000        // milliseconds
+
+
+// ----------------------------------------------------------------------------
+// the receiver, standing for the syslog daemon or the journal
+// ----------------------------------------------------------------------------
+
+// A datagram socket bound in a temporary directory: without Bind the path
+// is left free, so that the forwarder finds no receiver
+class Receiver {
+public:
+    Receiver() : m_fd(-1) {
+        char dir[] = "/tmp/wt_forward_XXXXXX";
+        if (mkdtemp(dir)) {
+            m_dir = dir;
+            path = m_dir + "/socket";
+        }
+    }
+    ~Receiver() {
+        if (m_fd >= 0) {
+            close(m_fd);
+            unlink(path.c_str());
+        }
+        if (!m_dir.empty()) {
+            rmdir(m_dir.c_str());
+        }
+    }
+
+    bool Bind() {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        m_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+        return m_fd >= 0 && bind(m_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+
+    // receive a record, waiting at most the given time
+    bool Receive(std::string& record, int timeout) {
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout) <= 0) {
+            return false;
+        }
+        char buf[WT_FORWARD_RECORD];
+        ssize_t n = recv(m_fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            return false;
+        }
+        record.assign(buf, n);
+        return true;
+    }
+
+    std::string path;
+
+private:
+    std::string m_dir;
+    int m_fd;
+};
+
+// wait until the forwarder is done with the given number of records
+static WTForwardStats settle(const WTLogForwarder& forwarder, unsigned long long total) {
+    long long deadline = now_ms() + TEST_SETTLE;
+    WTForwardStats stats = forwarder.Stats();
+    while (stats.sent + stats.dropped + stats.failed < total && now_ms() < deadline) {
+        usleep(10 * 1000);
+        stats = forwarder.Stats();
+    }
+    return stats;
+}
+
+
+// ----------------------------------------------------------------------------
+// tests
+// ----------------------------------------------------------------------------
+
+// traditional syslog lines: priority from the level, identifier and PID
+static void test_syslog() {
+    Receiver receiver;
+    check(receiver.Bind(), "receiver bound");
+    WTLogForwarder forwarder;
+    forwarder.SetSocket(receiver.path, WT_FORWARD_SYSLOG);
+    forwarder.SetIdentifier("whenever");
+    check(forwarder.Start(), "started");
+    forwarder.Forward("task started", 12, WT_LEVEL_WARN, 1234);
+    forwarder.Forward("task failed", 11, WT_LEVEL_ERROR, 1234);
+
+    std::string record;
+    const char* suffix = " whenever[1234]: task started";
+    check(receiver.Receive(record, TEST_SETTLE), "first record received");
+    check(record.compare(0, 4, "<12>") == 0, "warning priority");
+    check(record.size() > strlen(suffix)
+          && record.compare(record.size() - strlen(suffix), std::string::npos, suffix) == 0,
+          "identifier, PID and message");
+    check(receiver.Receive(record, TEST_SETTLE), "second record received");
+    check(record.compare(0, 4, "<11>") == 0, "error priority");
+    WTForwardStats stats = settle(forwarder, 2);
+    check(stats.sent == 2 && stats.dropped == 0 && stats.failed == 0, "counted as sent");
+}
+
+// native journal records: one field per line, ending with a newline
+static void test_journal() {
+    Receiver receiver;
+    check(receiver.Bind(), "receiver bound");
+    WTLogForwarder forwarder;
+    forwarder.SetSocket(receiver.path, WT_FORWARD_JOURNAL);
+    forwarder.SetIdentifier("whenever");
+    check(forwarder.Start(), "started");
+    forwarder.Forward("task started", 12, WT_LEVEL_INFO, 1234);
+
+    std::string record;
+    check(receiver.Receive(record, TEST_SETTLE), "record received");
+    check(record == "PRIORITY=6\nSYSLOG_FACILITY=1\nSYSLOG_IDENTIFIER=whenever\n"
+                    "SYSLOG_PID=1234\nMESSAGE=task started\n", "fields");
+
+    // a line that does not fit is truncated, and the record still ends
+    // with a newline
+    std::string line(WT_FORWARD_RECORD, 'x');
+    forwarder.Forward(line.c_str(), line.size(), WT_LEVEL_INFO, 1234);
+    check(receiver.Receive(record, TEST_SETTLE), "long record received");
+    check(record.size() < WT_FORWARD_RECORD && record[record.size() - 1] == '\n',
+          "truncated with a newline", (long long)record.size());
+    WTForwardStats stats = settle(forwarder, 2);
+    check(stats.sent == 2 && stats.dropped == 0 && stats.failed == 0, "counted as sent");
+}
+
+// a receiver that does not read: the lines that do not fit in the ring
+// are dropped, and every line is either delivered or counted as dropped
+static void test_drop() {
+    Receiver receiver;
+    check(receiver.Bind(), "receiver bound");
+    WTLogForwarder forwarder;
+    forwarder.SetSocket(receiver.path, WT_FORWARD_SYSLOG);
+    check(forwarder.Start(), "started");
+    long long started = now_ms();
+    for (int i = 0; i < TEST_FLOOD_LINES; i++) {
+        forwarder.Forward("flood", 5, WT_LEVEL_INFO, 1234);
+    }
+    check(now_ms() - started < TEST_SETTLE, "never blocked", now_ms() - started);
+
+    unsigned long long received = 0;
+    std::string record;
+    WTForwardStats stats = forwarder.Stats();
+    long long deadline = now_ms() + TEST_SETTLE;
+    while (stats.sent + stats.dropped < TEST_FLOOD_LINES && now_ms() < deadline) {
+        if (receiver.Receive(record, 10)) {
+            received++;
+        }
+        stats = forwarder.Stats();
+    }
+    while (receiver.Receive(record, 100)) {
+        received++;
+    }
+    stats = forwarder.Stats();
+    check(stats.dropped > 0, "dropped", (long long)stats.dropped);
+    check(stats.sent + stats.dropped == TEST_FLOOD_LINES, "all accounted for",
+          (long long)(stats.sent + stats.dropped));
+    check(received == stats.sent, "sent received", (long long)received);
+    check(stats.failed == 0, "none failed");
+}
+
+// no receiver: the records are counted as failed, and nothing is sent
+static void test_failed() {
+    Receiver receiver;
+    WTLogForwarder forwarder;
+    forwarder.SetSocket(receiver.path, WT_FORWARD_SYSLOG);
+    check(forwarder.Start(), "started");
+    for (int i = 0; i < 10; i++) {
+        forwarder.Forward("lost", 4, WT_LEVEL_INFO, 1234);
+    }
+    WTForwardStats stats = settle(forwarder, 10);
+    check(stats.failed == 10, "failed", (long long)stats.failed);
+    check(stats.sent == 0 && stats.dropped == 0, "neither sent nor dropped");
+}
+
+static const TestCase TESTS[] = {
+    { "syslog", test_syslog },
+    { "journal", test_journal },
+    { "drop", test_drop },
+    { "failed", test_failed },
+    { NULL, NULL },
+};
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s test\n", argv[0]);
+        return 2;
+    }
+    return run_test(TESTS, argv[1]);
+}
+
+// end.
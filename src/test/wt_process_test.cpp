@@ -0,0 +1,315 @@
+/// whenever_tray
+///
+/// Tests of the native process layer against the fake scheduler: each test
+/// starts the fake with a script, drives it through WTChildProcess as the
+/// tray does (commands on stdin, output read without blocking and split in
+/// lines) and checks the time taken by startup, commands and shutdown
+/// against fixed budgets. The test to run is named on the command line:
+///
+///     wt_process_test path/to/fake_whenever test
+///
+/// and the exit status is 0 if it passes. No display is needed.
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "../wt_process.h"
+#include "../wt_timing.h"
+#include "wt_test.h"
+
+// budgets, generous enough for loaded build machines
+#define BUDGET_SPAWN 100        // milliseconds
+#define BUDGET_READY 500        // milliseconds, besides the scripted delay
+#define BUDGET_ACK 250          // milliseconds
+#define BUDGET_ACK_FLOOD 1000   // milliseconds
+#define BUDGET_EXIT 500         // milliseconds
+#define BUDGET_KILL 500         // milliseconds
+#define BUDGET_WRITE 50         // milliseconds
+
+static const char* fake_path = NULL;
+
+
+// ----------------------------------------------------------------------------
+// the fake scheduler, seen from the tray
+// ----------------------------------------------------------------------------
+
+// A running fake scheduler, whose output is consumed as in the tray
+class FakeScheduler : public WTLineSink {
+public:
+    FakeScheduler()
+        : lines(0), bytes(0), waiting(NULL), started_at(0), sent_at(0), acked_at(0),
+          first_line_at(0), m_out(WT_STREAM_STDOUT, this), m_err(WT_STREAM_STDERR, this) { }
+    ~FakeScheduler() {
+        if (!m_child.Exited()) {
+            int status;
+            m_child.Signal(SIGKILL, true);
+            m_child.Reap(status, true);
+        }
+    }
+
+    // start the fake with the scripted environment
+    bool Start(const std::vector<std::string>& script) {
+        WTSpawnOptions options;
+        options.argv.push_back(fake_path);
+        options.argv.push_back("-L");
+        options.argv.push_back("info");
+        options.argv.push_back("whenever.toml");
+        options.env = WTCurrentEnvironment();
+        for (size_t i = 0; i < script.size(); i++) {
+            WTSetEnvironment(options.env, script[i]);
+        }
+        started_at = now_ms();
+        return m_child.Spawn(options);
+    }
+
+    // send a command, to be acknowledged by a line containing the fragment
+    bool Send(const char* command, const char* ack) {
+        waiting = ack;
+        acked_at = 0;
+        sent_at = now_ms();
+        return m_child.Write(command, strlen(command));
+    }
+
+    // read the output for at most ms milliseconds, or until done is true
+    bool Pump(long ms, std::function<bool()> done) {
+        long long until = now_ms() + ms;
+        char buf[APP_READ_CHUNK];
+        for (;;) {
+            if (done()) {
+                return true;
+            }
+            long long now = now_ms();
+            if (now >= until) {
+                return false;
+            }
+            struct pollfd pfd[2];
+            int nfds = 0;
+            for (int i = 0; i < 2; i++) {
+                WTOutputStream stream = i ? WT_STREAM_STDERR : WT_STREAM_STDOUT;
+                if (m_child.OutputFd(stream) >= 0) {
+                    pfd[nfds].fd = m_child.OutputFd(stream);
+                    pfd[nfds].events = POLLIN;
+                    nfds++;
+                }
+            }
+            int timeout = until - now < 20 ? (int)(until - now) : 20;
+            if (nfds > 0) {
+                poll(pfd, nfds, timeout);
+            } else {
+                usleep(timeout * 1000);
+            }
+            for (int i = 0; i < 2; i++) {
+                WTOutputStream stream = i ? WT_STREAM_STDERR : WT_STREAM_STDOUT;
+                long n = m_child.Read(stream, buf, sizeof(buf));
+                if (n > 0) {
+                    bytes += n;
+                    (i ? m_err : m_out).Feed(buf, n);
+                }
+            }
+            int status;
+            m_child.Reap(status);
+        }
+    }
+
+    // read the output for some time, whatever happens
+    void Drain(long ms) {
+        Pump(ms, []() { return false; });
+    }
+
+    virtual void OnLine(WTOutputStream, const char* line, size_t len) {
+        if (lines++ == 0) {
+            first_line_at = now_ms();
+        }
+        if (waiting && WTLineContains(line, len, waiting)) {
+            waiting = NULL;
+            acked_at = now_ms();
+        }
+    }
+
+    bool Acked() const {
+        return acked_at != 0;
+    }
+    long long AckLatency() const {
+        return acked_at - sent_at;
+    }
+
+    WTChildProcess& Child() {
+        return m_child;
+    }
+
+    unsigned long long lines;
+    unsigned long long bytes;
+    const char* waiting;
+    long long started_at;
+    long long sent_at;
+    long long acked_at;
+    long long first_line_at;
+
+private:
+    WTChildProcess m_child;
+    WTLineSplitter m_out;
+    WTLineSplitter m_err;
+};
+
+// send a command and wait for its acknowledgement, checking the latency
+static bool command(FakeScheduler& fake, const char* cmd, const char* ack, long budget) {
+    if (!check(fake.Send(cmd, ack), "command written")) {
+        return false;
+    }
+    fake.Pump(APP_ACK_TIMEOUT, [&]() { return fake.Acked(); });
+    return check(fake.Acked() && fake.AckLatency() <= budget, "command acknowledged in time",
+                 fake.Acked() ? fake.AckLatency() : APP_ACK_TIMEOUT);
+}
+
+// stop the fake as StopWheneverCommand does: the exit command, then the
+// process group is killed if it is still there after APP_KILL_SLEEP;
+// return true if the fake left by itself
+static bool stop(FakeScheduler& fake, long long& elapsed) {
+    long long start = now_ms();
+    fake.Send("exit\n", NULL);
+    WTChildProcess& child = fake.Child();
+    bool left = fake.Pump(APP_KILL_SLEEP, [&]() { return child.Exited(); });
+    if (!left) {
+        child.Signal(SIGKILL, true);
+        fake.Pump(BUDGET_KILL, [&]() { return child.Exited(); });
+    }
+    elapsed = now_ms() - start;
+    return left;
+}
+
+
+// ----------------------------------------------------------------------------
+// tests
+// ----------------------------------------------------------------------------
+
+// the first line arrives after the scripted delay, and not much later
+static void test_startup() {
+    FakeScheduler fake;
+    long long before = now_ms();
+    check(fake.Start({ "FAKE_WHENEVER_READY_DELAY=300" }), "spawned");
+    long long spawn = now_ms() - before;
+    check(spawn <= BUDGET_SPAWN, "spawn in time", spawn);
+    fake.Pump(300 + BUDGET_READY + 1000, [&]() { return fake.lines > 0; });
+    long long ready = fake.first_line_at - fake.started_at;
+    check(fake.lines > 0 && ready >= 300 && ready <= 300 + BUDGET_READY,
+          "ready in time", fake.lines > 0 ? ready : -1);
+}
+
+// every command is acknowledged within the budget
+static void test_commands() {
+    FakeScheduler fake;
+    check(fake.Start({ "FAKE_WHENEVER_RATE=50" }), "spawned");
+    fake.Drain(200);
+    command(fake, "pause\n", "paus", BUDGET_ACK);
+    command(fake, "resume\n", "resum", BUDGET_ACK);
+    command(fake, "reset_conditions\n", "reset", BUDGET_ACK);
+    long long elapsed;
+    bool left = stop(fake, elapsed);
+    check(left && elapsed <= BUDGET_EXIT, "left after exit", elapsed);
+    check(fake.Child().ExitStatus() == 0, "exit status 0");
+}
+
+// a scheduler ignoring the exit command is killed with its group
+static void test_ignore_exit() {
+    FakeScheduler fake;
+    check(fake.Start({ "FAKE_WHENEVER_IGNORE_EXIT=1" }), "spawned");
+    fake.Drain(100);
+    long long elapsed;
+    bool left = stop(fake, elapsed);
+    check(!left, "still there after exit");
+    check(fake.Child().Exited() && elapsed <= APP_KILL_SLEEP + BUDGET_KILL,
+          "killed in time", elapsed);
+    check(fake.Child().ExitStatus() == -SIGKILL, "killed by SIGKILL");
+}
+
+// a hung scheduler does not acknowledge commands, and can still be killed
+static void test_hang() {
+    FakeScheduler fake;
+    check(fake.Start({ "FAKE_WHENEVER_HANG_AFTER=200", "FAKE_WHENEVER_RATE=50" }), "spawned");
+    fake.Drain(400);
+    unsigned long long lines = fake.lines;
+    check(fake.Send("pause\n", "paus"), "command written");
+    fake.Pump(APP_ACK_TIMEOUT, [&]() { return fake.Acked(); });
+    check(!fake.Acked() && fake.lines == lines, "no output while hung");
+    check(!fake.Child().Exited(), "still alive");
+    long long elapsed;
+    stop(fake, elapsed);
+    check(fake.Child().Exited(), "killed", elapsed);
+}
+
+// a crash is seen as the end of the output and a signal in the status
+static void test_crash() {
+    FakeScheduler fake;
+    check(fake.Start({ "FAKE_WHENEVER_CRASH_AFTER=200", "FAKE_WHENEVER_RATE=50" }), "spawned");
+    WTChildProcess& child = fake.Child();
+    fake.Pump(2000, [&]() { return child.Exited(); });
+    long long elapsed = now_ms() - fake.started_at;
+    check(child.Exited() && elapsed <= 200 + BUDGET_EXIT, "crash detected in time", elapsed);
+    check(child.ExitStatus() == -SIGABRT, "killed by SIGABRT");
+    fake.Drain(100);
+    check(child.OutputFd(WT_STREAM_STDOUT) < 0 && child.OutputFd(WT_STREAM_STDERR) < 0,
+          "pipes closed");
+}
+
+// under a flood of output commands are still acknowledged in time, and
+// the scheduler leaves without being killed
+static void test_flood() {
+    FakeScheduler fake;
+    check(fake.Start({ "FAKE_WHENEVER_RATE=-1", "FAKE_WHENEVER_LINE_SIZE=1024" }), "spawned");
+    fake.Drain(1000);
+    check(fake.bytes >= 1024 * 1024, "output read", (long long)fake.bytes);
+    command(fake, "pause\n", "paus", BUDGET_ACK_FLOOD);
+    command(fake, "resume\n", "resum", BUDGET_ACK_FLOOD);
+    fake.Drain(500);
+    long long elapsed;
+    bool left = stop(fake, elapsed);
+    check(left && elapsed <= BUDGET_ACK_FLOOD, "left after exit", elapsed);
+}
+
+// a flooding scheduler blocked on a full pipe does not block the tray: the
+// command is written at once, and acknowledged when the output is read
+static void test_stalled() {
+    FakeScheduler fake;
+    check(fake.Start({ "FAKE_WHENEVER_RATE=-1", "FAKE_WHENEVER_LINE_SIZE=1024" }), "spawned");
+    usleep(500 * 1000);
+    long long before = now_ms();
+    check(fake.Send("pause\n", "paus"), "command written");
+    long long took = now_ms() - before;
+    check(took <= BUDGET_WRITE, "write did not block", took);
+    fake.Pump(APP_ACK_TIMEOUT, [&]() { return fake.Acked(); });
+    check(fake.Acked() && fake.AckLatency() <= BUDGET_ACK_FLOOD, "acknowledged once read",
+          fake.Acked() ? fake.AckLatency() : APP_ACK_TIMEOUT);
+    long long elapsed;
+    bool left = stop(fake, elapsed);
+    check(left, "left after exit", elapsed);
+}
+
+static const TestCase TESTS[] = {
+    { "startup", test_startup },
+    { "commands", test_commands },
+    { "ignore_exit", test_ignore_exit },
+    { "hang", test_hang },
+    { "crash", test_crash },
+    { "flood", test_flood },
+    { "stalled", test_stalled },
+    { NULL, NULL },
+};
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s fake_whenever test\n", argv[0]);
+        return 2;
+    }
+    fake_path = argv[1];
+    return run_test(TESTS, argv[2]);
+}
+
+// end.
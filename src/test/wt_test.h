@@ -0,0 +1,66 @@
+/// whenever_tray
+///
+/// Scaffolding shared by the tests: each test program has a table of named
+/// tests and runs the one named last on its command line, reporting each
+/// check on a line of its own. The exit status is 0 if all the checks
+/// pass, and a test that does not end within TEST_ALARM seconds is
+/// aborted, so that a deadlock is a failure rather than a test that never
+/// ends.
+
+#ifndef WT_TEST_H
+#define WT_TEST_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+// time after which a stuck test is aborted
+#define TEST_ALARM 60           // seconds
+
+// A test, named on the command line
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+typedef std::chrono::steady_clock test_clock;
+
+static int failures = 0;
+
+inline long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        test_clock::now().time_since_epoch()).count();
+}
+
+// report a check, counting the failures
+inline bool check(bool ok, const char* what, long long value = -1) {
+    if (value >= 0) {
+        printf("%s %s (%lld)\n", ok ? "ok  " : "FAIL", what, value);
+    } else {
+        printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    }
+    if (!ok) {
+        failures++;
+    }
+    return ok;
+}
+
+// run the named test of a table ending with a NULL name
+inline int run_test(const TestCase* tests, const char* name) {
+    alarm(TEST_ALARM);
+    for (int i = 0; tests[i].name; i++) {
+        if (strcmp(tests[i].name, name) == 0) {
+            tests[i].run();
+            return failures ? 1 : 0;
+        }
+    }
+    fprintf(stderr, "unknown test: %s\n", name);
+    return 2;
+}
+
+
+#endif // WT_TEST_H
+
+// end.
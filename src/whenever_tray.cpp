@@ -19,8 +19,10 @@
 ///
 
 // some helpers from the STL for use with TOML and to remain cross-platform
-#include <string>
+#include <climits>
 #include <map>
+#include <string>
+#include <vector>
 #include <chrono>
 #include <thread>
 
@@ -38,14 +40,19 @@
 #include "wx/taskbar.h"
 #include "wx/process.h"
 #include "wx/txtstrm.h"
+#include <wx/datetime.h>
 #include <wx/filename.h>
 #include <wx/stdpaths.h>
 #include <wx/aboutdlg.h>
 #include <wx/arrstr.h>
 #include <wx/bmpbndl.h>
 #include <wx/gdicmn.h>
+#include <wx/weakref.h>
+#include <wx/cmdline.h>
 
 #include "whenever_tray.h"
+#include "wt_stats.h"
+#include "wt_timing.h"
 
 #include "images/icon_svg.h"
 
@@ -73,8 +80,8 @@
 #define APP_AUTHOR "Francesco Garosi"
 #define APP_WEBSITE "https://github.com/almostearthling/"
 
-#define APP_KILL_SLEEP 1500     // milliseconds
-#define APP_START_SLEEP 500     // milliseconds
+#define APP_STATUS_INTERVAL 5000    // milliseconds between status updates
+#define INTENT_TIMER_MAX 3600000    // longest single wait for a pause to expire
 
 // default values for the scheduler executable filename on Windows and UNIX
 #ifdef __WINDOWS__
@@ -91,9 +98,108 @@ const char* WHENEVER_CMD_PAUSE = "pause\n";
 const char* WHENEVER_CMD_RESUME = "resume\n";
 const char* WHENEVER_CMD_RESETCONDS = "reset_conditions\n";
 
+// the above commands, indexed by WTCommand
+const char* WHENEVER_COMMANDS[WT_CMD_COUNT] = {
+    WHENEVER_CMD_PAUSE,
+    WHENEVER_CMD_RESUME,
+    WHENEVER_CMD_RESETCONDS,
+    WHENEVER_CMD_EXIT,
+};
+
+// fragments of scheduler output acknowledging commands (case insensitive),
+// indexed by WTCommand; when no acknowledgement is seen in APP_ACK_TIMEOUT,
+// a command sent to a scheduler that is still alive is considered accepted
+const char* WHENEVER_ACKS[WT_CMD_COUNT] = {
+    "paus",
+    "resum",
+    "reset",
+    NULL,
+};
+
+// structured log record fields that identify the start of a task
+const char* WHENEVER_CTX_TASK = "TASK";
+const char* WHENEVER_WHEN_START = "START";
+
+// names of the scheduler states, indexed by WTSchedulerState
+const char* SCHEDULER_STATE_NAMES[] = {
+    "stopped",
+    "starting",
+    "running",
+    "pausing",
+    "paused",
+    "resuming",
+    "stopping",
+    "waiting",
+};
+
 // configuration file name (to be found in the hidden user data directory)
 const char* CONFIG_FILE = "whenever_tray.toml";
 
+// default interval for the metrics export
+#define METRICS_DEFAULT_INTERVAL 15     // seconds
+
+// default watchdog check interval, and time without signs of life after
+// which the scheduler is considered hung: without a probe an idle
+// scheduler cannot be told from a hung one, so the watchdog is disabled
+// unless an interval is configured
+#define WATCHDOG_DEFAULT_INTERVAL 0     // seconds
+#define WATCHDOG_DEFAULT_TIMEOUT 120    // seconds
+
+// default size of the buffer for the last output of the scheduler
+#define POSTMORTEM_DEFAULT_BUFFER_KB 64
+
+// history file (in the user data directory) and default sampling interval
+const char* HISTORY_FILE = "whenever_tray.history";
+#define HISTORY_DEFAULT_INTERVAL 60     // seconds
+
+// statistics about tasks and conditions (in the user data directory),
+// default interval between updates, bytes of the log parsed at each update,
+// and interval between updates while catching up with a long log
+const char* TASKSTATS_FILE = "whenever_tray.taskstats";
+#define TASKSTATS_DEFAULT_INTERVAL 60   // seconds
+#define TASKSTATS_UPDATE_BYTES (4 * 1024 * 1024)
+#define TASKSTATS_CATCHUP_INTERVAL 250  // milliseconds
+
+// default limit of the size of the trace of a session
+#define TRACE_DEFAULT_MAX_MB 256
+
+// journal of the state intended by the user (in the user data directory)
+const char* INTENT_FILE = "whenever_tray.intent";
+
+// default window of the pressure triggers, and time the pressure has to
+// stay low before the throttle is released
+#define PRESSURE_DEFAULT_WINDOW 2       // seconds
+#define PRESSURE_DEFAULT_RELEASE 30     // seconds
+
+// power supply class directory, default interval between checks of the
+// power supply, and percentage above the pause threshold for resuming
+#define POWER_SUPPLY_ROOT "/sys/class/power_supply"
+#define POWER_DEFAULT_INTERVAL 30       // seconds
+#define POWER_PAUSE_HYSTERESIS 5        // percent
+
+// default maximum delay of the first start when the system is busy, and
+// interval between checks of the startup gate
+#define STARTUP_DEFAULT_MAX_DELAY 180   // seconds
+#define STARTUP_CHECK_INTERVAL 2000     // milliseconds
+
+// time given to `whenever --version` to answer, in the background
+#define VERSION_PROBE_TIMEOUT 5000      // milliseconds
+
+// intervals between checks of the user activity: while the user is away,
+// while a fullscreen application hides the idle time, and the shortest one
+#define IDLE_POLL_AWAY 2000             // milliseconds
+#define IDLE_POLL_FULLSCREEN 10000      // milliseconds
+#define IDLE_POLL_MIN 1000              // milliseconds
+
+// default time the scheduler runs at a quieter log level after a flood
+#define LOGFLOOD_DEFAULT_COOLDOWN 600   // seconds
+
+// interval between checks for the rotation of the log, default number of
+// rotated segments kept and default compression level
+#define ROTATE_CHECK_INTERVAL 60000     // milliseconds
+#define ROTATE_DEFAULT_KEEP 7
+#define ROTATE_DEFAULT_LEVEL 6
+
 // default configuration for the underlying scheduler
 const char* WHENEVER_CONFIG = "whenever.toml";
 const char* WHENEVER_LOG = "whenever.log";
@@ -121,11 +227,222 @@ static WTHiddenFrame* hidden_frame = NULL;
 // WTPipedProcess: implementation
 // ============================================================================
 
+WTPipedProcess::WTPipedProcess(WTHiddenFrame* parent, int child)
+    : wxProcess(parent),
+      m_outSplitter(WT_STREAM_STDOUT, parent),
+      m_errSplitter(WT_STREAM_STDERR, parent)
+#ifndef WT_NATIVE_PROCESS
+      , m_timer(this)
+#endif
+{
+    m_frame = parent;
+    m_parent = parent;
+    m_child = child;
+    m_pid = 0;
+    m_bAlive = true;
+    m_settled = false;
+#ifdef WT_NATIVE_PROCESS
+    m_controller = parent->GetController();
+#else
+    m_killPending = false;
+    Redirect();
+    Bind(wxEVT_TIMER, &WTPipedProcess::OnTimer, this);
+#endif
+}
+
+/// Spawn the scheduler: natively where possible, by the controller thread,
+/// so that the arguments are passed as they are and the priority and
+/// affinity are already set when the scheduler starts, and through
+/// wxExecute otherwise
+bool WTPipedProcess::Launch(const WTSpawnOptions& options, long settle_ms) {
+#ifdef WT_NATIVE_PROCESS
+    if (!m_controller->Running()) {
+        m_bAlive = false;
+        return false;
+    }
+    m_controller->Spawn(m_child, options, settle_ms);
+    return true;
+#else
+    std::vector<const char*> argv;
+    for (size_t i = 0; i < options.argv.size(); i++) {
+        argv.push_back(options.argv[i].c_str());
+    }
+    argv.push_back(NULL);
+    wxExecuteEnv env;
+    for (size_t i = 0; i < options.env.size(); i++) {
+        size_t eq = options.env[i].find('=');
+        if (eq != std::string::npos && eq > 0) {
+            env.env[wxString(options.env[i].substr(0, eq))] =
+                wxString(options.env[i].substr(eq + 1));
+        }
+    }
+    SetPriority(options.priority);
+    long pid = wxExecute(
+        &argv[0],
+        wxEXEC_ASYNC | wxEXEC_HIDE_CONSOLE | wxEXEC_MAKE_GROUP_LEADER,
+        this, &env);
+    if (pid <= 0) {
+        m_bAlive = false;
+        return false;
+    }
+    m_pid = pid;
+    m_timer.StartOnce(settle_ms > 0 ? settle_ms : 1);
+    return true;
+#endif
+}
+
+/// Check whether the process has not exited yet: a native child is known
+/// to be running until the controller has posted its exit
+bool WTPipedProcess::Running() {
+#ifdef WT_NATIVE_PROCESS
+    return m_bAlive;
+#else
+    return m_bAlive && wxProcess::Exists(GetPid());
+#endif
+}
+
+/// Write a command to the scheduler stdin
+bool WTPipedProcess::WriteCommand(const char* text, size_t len) {
+    if (!m_bAlive) {
+        return false;
+    }
+#ifdef WT_NATIVE_PROCESS
+    m_controller->Write(m_child, std::string(text, len));
+    return true;
+#else
+    wxOutputStream* appstdin = GetOutputStream();
+    return appstdin && appstdin->WriteAll(text, len);
+#endif
+}
+
+/// Forcibly terminate the scheduler together with its children, at once or
+/// after the grace period
+bool WTPipedProcess::KillGroup(long grace_ms) {
+    if (!m_bAlive) {
+        return false;
+    }
+#ifdef WT_NATIVE_PROCESS
+    m_controller->Kill(m_child, grace_ms);
+    return true;
+#else
+    if (grace_ms > 0 && !m_timer.IsRunning()) {
+        m_killPending = true;
+        m_timer.StartOnce(grace_ms);
+        return true;
+    }
+    return wxProcess::Kill(GetPid(), wxSIGKILL, wxKILL_CHILDREN) == wxKILL_OK;
+#endif
+}
+
+/// Detach from the frame: a native child is released to the controller,
+/// which kills it if needed and reaps it, and the object is deleted
+void WTPipedProcess::Orphan() {
+    m_frame = NULL;
+    m_parent = NULL;
+    m_outSplitter = WTLineSplitter(WT_STREAM_STDOUT, NULL);
+    m_errSplitter = WTLineSplitter(WT_STREAM_STDERR, NULL);
+#ifdef WT_NATIVE_PROCESS
+    m_controller->Release(m_child);
+    delete this;
+#else
+    m_timer.Stop();
+    Detach();
+#endif
+}
+
+/// A process that leaves before settling is first notified as failed, so
+/// that the frame sees the same sequence of notifications everywhere
 void WTPipedProcess::OnTerminate(int pid, int status) {
     m_bAlive = false;
+#ifndef WT_NATIVE_PROCESS
+    m_timer.Stop();
+    if (!m_settled && m_frame) {
+        m_settled = true;
+        m_frame->OnSchedulerSpawned(this, 0);
+    }
+#endif
+    // collect whatever has been left in the pipes before notifying
+    if (m_frame) {
+#ifndef WT_NATIVE_PROCESS
+        DrainOutput();
+#endif
+        m_outSplitter.Flush();
+        m_errSplitter.Flush();
+        m_frame->OnSchedulerTerminated(this, pid, status);
+    }
     wxProcess::OnTerminate(pid, status);
 }
 
+#ifdef WT_NATIVE_PROCESS
+/// Handle an event of this instance posted by the controller: the frame
+/// may delete the object when notified, thus nothing can follow that
+void WTPipedProcess::HandleEvent(WTControlEvent& event) {
+    switch (event.kind) {
+    case WT_CONTROL_SPAWNED:
+        m_settled = true;
+        m_pid = event.pid;
+        if (m_frame) {
+            m_frame->OnSchedulerSpawned(this, event.pid);
+        }
+        break;
+    case WT_CONTROL_OUTPUT:
+        if (m_parent) {
+            m_parent->TraceOutput(event.stream, event.data.data(), event.data.size());
+        }
+        (event.stream == WT_STREAM_STDERR ? m_errSplitter : m_outSplitter).Feed(
+            event.data.data(), event.data.size());
+        break;
+    case WT_CONTROL_EXITED:
+        OnTerminate(event.pid, event.status);
+        break;
+    }
+}
+#else
+/// The settle time has passed, or the grace period has expired
+void WTPipedProcess::OnTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (!m_settled) {
+        m_settled = true;
+        if (m_frame) {
+            m_frame->OnSchedulerSpawned(this, Running() ? m_pid : 0);
+        }
+    } else if (m_killPending) {
+        m_killPending = false;
+        if (Running()) {
+            KillGroup();
+        }
+    }
+}
+
+/// Read the available output of the scheduler without blocking, and pass
+/// it to the line splitters: at most APP_READ_CHUNK bytes per stream are
+/// read on each call, so that a chatty scheduler cannot starve the GUI
+void WTPipedProcess::DrainOutput() {
+    char buf[APP_READ_CHUNK];
+    wxInputStream* streams[2] = { GetInputStream(), GetErrorStream() };
+    WTLineSplitter* splitters[2] = { &m_outSplitter, &m_errSplitter };
+
+    for (int i = 0; i < 2; i++) {
+        wxInputStream* in = streams[i];
+        size_t n = 0;
+        // Read returns what is available once something has been read,
+        // instead of waiting for the whole buffer
+        while (in && n < sizeof(buf) && in->CanRead()) {
+            size_t got = in->Read(buf + n, sizeof(buf) - n).LastRead();
+            if (got == 0) {
+                break;
+            }
+            n += got;
+        }
+        if (n > 0) {
+            if (m_parent) {
+                m_parent->TraceOutput(i ? WT_STREAM_STDERR : WT_STREAM_STDOUT, buf, n);
+            }
+            splitters[i]->Feed(buf, n);
+        }
+    }
+}
+#endif
+
 
 // ----------------------------------------------------------------------------
 // WTApp: the application class
@@ -133,11 +450,22 @@ void WTPipedProcess::OnTerminate(int pid, int status) {
 
 wxIMPLEMENT_APP(WTApp);
 
+// defined below, with the configuration
+static bool ReadConfiguration(const wxString& cfgfile, const wxString& data_dir, WTConfig& cfg);
+
 bool WTApp::OnInit() {
     if (!wxApp::OnInit()) {
         return false;
     }
 
+    // set the app name in order to use it in determinination of app directory
+    this->SetAppName(APP_NAME);
+
+    // no tray is needed to save an excerpt of the log
+    if (m_excerpt) {
+        return true;
+    }
+
     if (!wxTaskBarIcon::IsAvailable()) {
         wxMessageBox(
             "No tray area support on OS: leaving.",
@@ -146,9 +474,6 @@ bool WTApp::OnInit() {
         return false;
     }
 
-    // set the app name in order to use it in determinination of app directory
-    this->SetAppName(APP_NAME);
-
     // create the main window
     hidden_frame = new WTHiddenFrame(APP_DISPLAY_NAME);
     hidden_frame->Show(DEBUG_SHOW_FRAME);
@@ -156,27 +481,471 @@ bool WTApp::OnInit() {
     return true;
 }
 
+/// Add the options that save an excerpt of the log
+void WTApp::OnInitCmdLine(wxCmdLineParser& parser) {
+    wxApp::OnInitCmdLine(parser);
+    parser.AddOption("", "excerpt-output",
+                     "save an excerpt of the scheduler log to a file, compressed if named *.gz");
+    parser.AddOption("", "excerpt-from", "start of the excerpt, as YYYY-MM-DD HH:MM[:SS]");
+    parser.AddOption("", "excerpt-to", "end of the excerpt, as YYYY-MM-DD HH:MM[:SS]");
+}
+
+// parse a time given for an excerpt, as written in the log: an end given
+// without seconds includes the whole minute
+static bool ParseExcerptTime(const wxString& s, bool end, long long& when) {
+    wxString trimmed(s);
+    std::string t = trimmed.Trim().Trim(false).ToStdString();
+    if (!WTParseTimestamp(t.c_str(), t.size(), when)) {
+        return false;
+    }
+    if (end && t.size() == 16) {
+        when += 59999;
+    }
+    return true;
+}
+
+/// Check the options of an excerpt: without start or end the excerpt
+/// begins with the oldest segment or ends with the live log respectively
+bool WTApp::OnCmdLineParsed(wxCmdLineParser& parser) {
+    if (!wxApp::OnCmdLineParsed(parser)) {
+        return false;
+    }
+    m_excerpt = parser.Found("excerpt-output", &m_excerptOutput);
+    m_excerptFrom = 0;
+    m_excerptTo = LLONG_MAX;
+    wxString s;
+    if (!m_excerpt && (parser.Found("excerpt-from", &s) || parser.Found("excerpt-to", &s))) {
+        fprintf(stderr, "%s: --excerpt-from and --excerpt-to require --excerpt-output\n", APP_NAME);
+        return false;
+    }
+    if ((parser.Found("excerpt-from", &s) && !ParseExcerptTime(s, false, m_excerptFrom))
+        || (parser.Found("excerpt-to", &s) && !ParseExcerptTime(s, true, m_excerptTo))) {
+        fprintf(stderr, "%s: invalid time, expected YYYY-MM-DD HH:MM[:SS]\n", APP_NAME);
+        return false;
+    }
+    return true;
+}
+
+/// Save the requested excerpt of the log, or run the tray
+int WTApp::OnRun() {
+    if (!m_excerpt) {
+        return wxApp::OnRun();
+    }
+    wxStandardPaths paths = wxStandardPaths::Get();
+    wxString data_dir = paths.GetUserDataDir();
+    wxString cfgfile(data_dir + wxFileName::GetPathSeparator() + wxString(CONFIG_FILE));
+    WTConfig config;
+    ReadConfiguration(cfgfile, data_dir, config);
+    WTExcerptStats stats;
+    if (!WTExtractLog(config.log_path.ToStdString(), m_excerptFrom, m_excerptTo,
+                      m_excerptOutput.ToStdString(), m_excerptOutput.EndsWith(".gz"), stats)) {
+        fprintf(stderr, "%s: the excerpt could not be saved to %s\n",
+                APP_NAME, (const char*)m_excerptOutput.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// configuration
+// ----------------------------------------------------------------------------
+
+// read a string entry of a TOML table, if present
+static bool ConfigString(const toml::value& table, const char* key, wxString& value) {
+    if (table.contains(key)) {
+        value = wxString(toml::find<std::string>(table, key));
+        return true;
+    }
+    return false;
+}
+
+// read an integer entry of a TOML table, if present, clamping it to a range
+static bool ConfigLong(const toml::value& table, const char* key, long& value, long min, long max) {
+    if (table.contains(key)) {
+        value = toml::find<long>(table, key);
+        if (value < min) {
+            value = min;
+        } else if (value > max) {
+            value = max;
+        }
+        return true;
+    }
+    return false;
+}
+
+// parse a priority name: normal, low or minimum (the default)
+static unsigned int ParsePriority(const wxString& s) {
+    if (s == "normal")
+        return PRIORITY_NORMAL;
+    else if (s == "low")
+        return PRIORITY_LOW;
+    else
+        return PRIORITY_MINIMUM;
+}
+
+// read the policy for a power source from the power table, if present
+static void ConfigPowerPolicy(const toml::value& power, WTPowerSource source, WTPowerPolicy& policy) {
+    const char* name = WTPowerSourceName(source);
+    if (!power.contains(name)) {
+        return;
+    }
+    const toml::value& table = toml::find(power, name);
+    wxString s;
+    policy.enabled = true;
+    if (ConfigString(table, "priority", s)) {
+        policy.set_priority = true;
+        policy.priority = ParsePriority(s);
+    }
+    if (table.contains("cpus")) {
+        policy.set_cpus = true;
+        policy.cpus = toml::find<std::vector<int> >(table, "cpus");
+    }
+    ConfigLong(table, "pause_below", policy.pause_below, 0, 100);
+}
+
+// read a number of a TOML table, if present, also when written as integer
+static bool ConfigDouble(const toml::value& table, const char* key, double& value) {
+    if (table.contains(key)) {
+        const toml::value& v = toml::find(table, key);
+        value = v.is_integer() ? (double)v.as_integer() : v.as_floating();
+        return true;
+    }
+    return false;
+}
+
+// read a window of the quiet hours: a malformed window, also when its
+// entries have the wrong type, is left out and `false` is returned so that
+// it can be reported, without invalidating the rest of the configuration
+static bool ConfigQuietWindow(const toml::value& table, WTQuietSchedule& schedule) {
+    WTQuietWindow window;
+    wxString days("daily"), start, end;
+    try {
+        ConfigString(table, "days", days);
+        if (!ConfigString(table, "start", start) || !ConfigString(table, "end", end)) {
+            return false;
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    if (!WTParseQuietDays(days.ToStdString(), window.days)
+        || !WTParseClockTime(start.ToStdString(), window.start)
+        || !WTParseClockTime(end.ToStdString(), window.end)) {
+        return false;
+    }
+    schedule.Add(window);
+    return true;
+}
+
+// read a boolean entry of a TOML table, if present
+static bool ConfigBool(const toml::value& table, const char* key, bool& value) {
+    if (table.contains(key)) {
+        value = toml::find<bool>(table, key);
+        return true;
+    }
+    return false;
+}
+
+/// Read the configuration file: the entries that are not found are set to
+/// their default values, and `false` is returned if the file is missing or
+/// malformed (in which case all entries are set to their default values)
+static bool ReadConfiguration(const wxString& cfgfile, const wxString& data_dir, WTConfig& cfg) {
+    cfg.command_path = wxString(WHENEVER_COMMAND);
+    cfg.logview_command_path = wxString(LOGVIEW_DEFAULT_COMMAND);
+    cfg.config_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_CONFIG);
+    cfg.log_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_LOG);
+    cfg.log_level = wxString(WHENEVER_LOGLEVEL);
+    cfg.priority = PRIORITY_MINIMUM;
+    cfg.cpus.clear();
+    cfg.env.clear();
+    cfg.metrics_dir = wxString();
+    cfg.metrics_interval = METRICS_DEFAULT_INTERVAL;
+    cfg.history_interval = HISTORY_DEFAULT_INTERVAL;
+    cfg.postmortem_dir = data_dir;
+    cfg.postmortem_buffer_kb = POSTMORTEM_DEFAULT_BUFFER_KB;
+    cfg.watchdog_interval = WATCHDOG_DEFAULT_INTERVAL;
+    cfg.watchdog_timeout = WATCHDOG_DEFAULT_TIMEOUT;
+    cfg.restart_handover = false;
+    cfg.pause_flag = wxString();
+    cfg.pause_expiry = 0;
+    for (int i = 0; i < WT_PRESSURE_COUNT; i++) {
+        cfg.pressure_threshold[i] = 0;
+    }
+    cfg.pressure_window = PRESSURE_DEFAULT_WINDOW;
+    cfg.pressure_release = PRESSURE_DEFAULT_RELEASE;
+    cfg.pressure_pause = true;
+    for (int i = 0; i < WT_POWER_COUNT; i++) {
+        cfg.power_policy[i].enabled = false;
+        cfg.power_policy[i].set_priority = false;
+        cfg.power_policy[i].priority = PRIORITY_MINIMUM;
+        cfg.power_policy[i].set_cpus = false;
+        cfg.power_policy[i].cpus.clear();
+        cfg.power_policy[i].pause_below = 0;
+    }
+    cfg.power_root = wxString(POWER_SUPPLY_ROOT);
+    cfg.power_interval = POWER_DEFAULT_INTERVAL;
+    cfg.startup_delay = 0;
+    cfg.startup_max_delay = STARTUP_DEFAULT_MAX_DELAY;
+    cfg.startup_load = 0;
+    cfg.startup_pressure = 0;
+    cfg.startup_disk = 0;
+    cfg.idle_resume = 0;
+    cfg.idle_fullscreen = true;
+    cfg.quiet_hours = WTQuietSchedule();
+    cfg.quiet_hours_skipped = 0;
+    cfg.logflood_rate = 0;
+    cfg.logflood_level = wxString("");
+    cfg.logflood_cooldown = LOGFLOOD_DEFAULT_COOLDOWN;
+    cfg.log_rotate_size = 0;
+    cfg.log_rotate_age = 0;
+    cfg.log_rotate_keep = ROTATE_DEFAULT_KEEP;
+    cfg.log_compress_level = ROTATE_DEFAULT_LEVEL;
+    cfg.forward_format = wxString("");
+    cfg.forward_socket = wxString("");
+    cfg.forward_ident = wxString("whenever");
+    cfg.task_stats_interval = TASKSTATS_DEFAULT_INTERVAL;
+    cfg.trace_file = wxString("");
+    cfg.trace_max_mb = TRACE_DEFAULT_MAX_MB;
+    WTConfig defaults = cfg;
+
+    try {
+        auto res_conf = toml::parse(cfgfile.ToStdString());
+        if (!res_conf.is_table() || !res_conf.contains("whenever_tray")) {
+            return true;
+        }
+        auto conf = toml::find(res_conf, "whenever_tray");
+        ConfigString(conf, "whenever_command", cfg.command_path);
+        ConfigString(conf, "whenever_config", cfg.config_path);
+        ConfigString(conf, "whenever_logfile", cfg.log_path);
+        wxString allowed = wxString("/error/warn/info/debug/trace/");
+        if (ConfigString(conf, "whenever_loglevel", cfg.log_level)) {
+            if (allowed.find(wxString::Format("/%s/", cfg.log_level)) == wxNOT_FOUND)  {
+                cfg.log_level = wxString(WHENEVER_LOGLEVEL);
+            }
+        }
+        wxString s;
+        if (ConfigString(conf, "whenever_priority", s)) {
+            cfg.priority = ParsePriority(s);
+        }
+        if (conf.contains("whenever_cpus")) {
+            cfg.cpus = toml::find<std::vector<int> >(conf, "whenever_cpus");
+        }
+        if (conf.contains("whenever_environment")) {
+            std::map<std::string, std::string> vars =
+                toml::find<std::map<std::string, std::string> >(conf, "whenever_environment");
+            for (std::map<std::string, std::string>::const_iterator it = vars.begin();
+                 it != vars.end(); ++it) {
+                cfg.env.push_back(it->first + "=" + it->second);
+            }
+        }
+        ConfigString(conf, "logview_command", cfg.logview_command_path);
+        ConfigString(conf, "metrics_dir", cfg.metrics_dir);
+        ConfigLong(conf, "metrics_interval", cfg.metrics_interval, 1, 3600);
+        ConfigLong(conf, "history_interval", cfg.history_interval, 0, 86400);
+        ConfigString(conf, "postmortem_dir", cfg.postmortem_dir);
+        ConfigLong(conf, "postmortem_buffer_kb", cfg.postmortem_buffer_kb, 1, 16384);
+        ConfigLong(conf, "watchdog_interval", cfg.watchdog_interval, 0, 3600);
+        ConfigLong(conf, "watchdog_timeout", cfg.watchdog_timeout, 5, 86400);
+        ConfigBool(conf, "restart_handover", cfg.restart_handover);
+        ConfigString(conf, "whenever_pause_flag", cfg.pause_flag);
+        ConfigLong(conf, "pause_expiry", cfg.pause_expiry, 0, 525600);
+        ConfigLong(conf, "pressure_cpu", cfg.pressure_threshold[WT_PRESSURE_CPU], 0, 100);
+        ConfigLong(conf, "pressure_memory", cfg.pressure_threshold[WT_PRESSURE_MEMORY], 0, 100);
+        ConfigLong(conf, "pressure_io", cfg.pressure_threshold[WT_PRESSURE_IO], 0, 100);
+        // unprivileged triggers need a window that is a multiple of 2 seconds
+        if (ConfigLong(conf, "pressure_window", cfg.pressure_window, 2, 10)) {
+            cfg.pressure_window += cfg.pressure_window % 2;
+        }
+        ConfigLong(conf, "pressure_release", cfg.pressure_release, 1, 3600);
+        if (ConfigString(conf, "pressure_action", s)) {
+            cfg.pressure_pause = s != "priority";
+        }
+        ConfigLong(conf, "startup_delay", cfg.startup_delay, 0, 3600);
+        ConfigLong(conf, "startup_max_delay", cfg.startup_max_delay, 0, 3600);
+        ConfigDouble(conf, "startup_load", cfg.startup_load);
+        ConfigLong(conf, "startup_pressure", cfg.startup_pressure, 0, 100);
+        ConfigLong(conf, "startup_disk", cfg.startup_disk, 0, 100);
+        ConfigLong(conf, "idle_resume", cfg.idle_resume, 0, 86400);
+        ConfigBool(conf, "idle_fullscreen", cfg.idle_fullscreen);
+        ConfigLong(conf, "logflood_rate", cfg.logflood_rate, 0, 1048576);
+        if (ConfigString(conf, "logflood_level", cfg.logflood_level)) {
+            if (allowed.find(wxString::Format("/%s/", cfg.logflood_level)) == wxNOT_FOUND)  {
+                cfg.logflood_level = wxString("");
+            }
+        }
+        ConfigLong(conf, "logflood_cooldown", cfg.logflood_cooldown, 10, 86400);
+        ConfigLong(conf, "log_rotate_size", cfg.log_rotate_size, 0, 1048576);
+        ConfigLong(conf, "log_rotate_age", cfg.log_rotate_age, 0, 87600);
+        ConfigLong(conf, "log_rotate_keep", cfg.log_rotate_keep, 1, 1000);
+        ConfigLong(conf, "log_compress_level", cfg.log_compress_level, 0, 9);
+        if (ConfigString(conf, "forward_format", cfg.forward_format)) {
+            if (cfg.forward_format != "syslog" && cfg.forward_format != "journal") {
+                cfg.forward_format = wxString("");
+            }
+        }
+        ConfigString(conf, "forward_socket", cfg.forward_socket);
+        ConfigString(conf, "forward_ident", cfg.forward_ident);
+        ConfigLong(conf, "task_stats_interval", cfg.task_stats_interval, 0, 86400);
+        ConfigString(conf, "trace_file", cfg.trace_file);
+        ConfigLong(conf, "trace_max_mb", cfg.trace_max_mb, 0, 1048576);
+        if (conf.contains("quiet_hours")) {
+            const std::vector<toml::value>& windows =
+                toml::find<std::vector<toml::value> >(conf, "quiet_hours");
+            for (size_t i = 0; i < windows.size(); i++) {
+                if (!ConfigQuietWindow(windows[i], cfg.quiet_hours)) {
+                    cfg.quiet_hours_skipped++;
+                }
+            }
+        }
+        if (conf.contains("power")) {
+            const toml::value& power = toml::find(conf, "power");
+            ConfigPowerPolicy(power, WT_POWER_AC, cfg.power_policy[WT_POWER_AC]);
+            ConfigPowerPolicy(power, WT_POWER_BATTERY, cfg.power_policy[WT_POWER_BATTERY]);
+            ConfigString(power, "sysfs_root", cfg.power_root);
+            ConfigLong(power, "interval", cfg.power_interval, 1, 3600);
+        }
+    }
+    catch (...) {
+        cfg = defaults;
+        return false;
+    }
+    return true;
+}
+
 
 // ----------------------------------------------------------------------------
 // WTHiddenFrame: the hidden application frame
 // ----------------------------------------------------------------------------
 
+// identifiers for the frame timers
+enum {
+    ID_POLL_TIMER = 20001,
+    ID_STATUS_TIMER,
+    ID_METRICS_TIMER,
+    ID_HISTORY_TIMER,
+    ID_WATCHDOG_TIMER,
+    ID_INTENT_TIMER,
+    ID_PRESSURE_EVENT,
+    ID_POWER_TIMER,
+    ID_STARTUP_TIMER,
+    ID_IDLE_TIMER,
+    ID_QUIET_EVENT,
+    ID_LOGFLOOD_EVENT,
+    ID_LOGCOOLDOWN_TIMER,
+    ID_ROTATE_TIMER,
+    ID_COMPRESSED_EVENT,
+    ID_EXCERPT_EVENT,
+    ID_VERSION_EVENT,
+    ID_CONTROL_EVENT,
+    ID_TASKSTATS_TIMER,
+};
+
 // event table
 wxBEGIN_EVENT_TABLE(WTHiddenFrame, wxFrame)
     EVT_BUTTON(wxID_EXIT, WTHiddenFrame::OnExit)
     EVT_CLOSE(WTHiddenFrame::OnCloseWindow)
+    EVT_TIMER(ID_POLL_TIMER, WTHiddenFrame::OnPollTimer)
+    EVT_TIMER(ID_STATUS_TIMER, WTHiddenFrame::OnStatusTimer)
+    EVT_TIMER(ID_METRICS_TIMER, WTHiddenFrame::OnMetricsTimer)
+    EVT_TIMER(ID_HISTORY_TIMER, WTHiddenFrame::OnHistoryTimer)
+    EVT_TIMER(ID_WATCHDOG_TIMER, WTHiddenFrame::OnWatchdogTimer)
+    EVT_TIMER(ID_INTENT_TIMER, WTHiddenFrame::OnIntentTimer)
+    EVT_THREAD(ID_PRESSURE_EVENT, WTHiddenFrame::OnPressureEvent)
+    EVT_TIMER(ID_POWER_TIMER, WTHiddenFrame::OnPowerTimer)
+    EVT_TIMER(ID_STARTUP_TIMER, WTHiddenFrame::OnStartupTimer)
+    EVT_TIMER(ID_IDLE_TIMER, WTHiddenFrame::OnIdleTimer)
+    EVT_THREAD(ID_QUIET_EVENT, WTHiddenFrame::OnQuietEvent)
+    EVT_THREAD(ID_LOGFLOOD_EVENT, WTHiddenFrame::OnLogFloodEvent)
+    EVT_TIMER(ID_LOGCOOLDOWN_TIMER, WTHiddenFrame::OnLogCooldownTimer)
+    EVT_TIMER(ID_ROTATE_TIMER, WTHiddenFrame::OnRotateTimer)
+    EVT_THREAD(ID_COMPRESSED_EVENT, WTHiddenFrame::OnCompressedEvent)
+    EVT_THREAD(ID_EXCERPT_EVENT, WTHiddenFrame::OnExcerptEvent)
+    EVT_THREAD(ID_VERSION_EVENT, WTHiddenFrame::OnVersionEvent)
+    EVT_THREAD(ID_CONTROL_EVENT, WTHiddenFrame::OnControlEvent)
+    EVT_TIMER(ID_TASKSTATS_TIMER, WTHiddenFrame::OnTaskStatsTimer)
 wxEND_EVENT_TABLE()
 
-WTHiddenFrame::WTHiddenFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, title) {
+WTHiddenFrame::WTHiddenFrame(const wxString& title)
+    : wxFrame(NULL, wxID_ANY, title),
+      m_pollTimer(this, ID_POLL_TIMER),
+      m_statusTimer(this, ID_STATUS_TIMER),
+      m_metricsTimer(this, ID_METRICS_TIMER),
+      m_watchdogTimer(this, ID_WATCHDOG_TIMER),
+      m_intentTimer(this, ID_INTENT_TIMER),
+      m_powerTimer(this, ID_POWER_TIMER),
+      m_startupTimer(this, ID_STARTUP_TIMER),
+      m_idleTimer(this, ID_IDLE_TIMER),
+      m_logCooldownTimer(this, ID_LOGCOOLDOWN_TIMER),
+      m_rotateTimer(this, ID_ROTATE_TIMER),
+      m_historyTimer(this, ID_HISTORY_TIMER),
+      m_taskStatsTimer(this, ID_TASKSTATS_TIMER) {
+    // the configuration is read and parsed by a worker thread, while the
+    // icons are rasterized and registered here, since toolkit calls have
+    // to stay on the GUI thread: everything else waits for the former
+    long long init_start = WTMonotonicMillis();
+    wxStandardPaths paths = wxStandardPaths::Get();
+    wxString data_dir = paths.GetUserDataDir();
+    wxString cfgfile(data_dir + wxFileName::GetPathSeparator() + wxString(CONFIG_FILE));
+    bool config_ok = false;
+    long long config_ms = 0;
+    std::thread config_thread([this, cfgfile, data_dir, &config_ok, &config_ms]() {
+        long long start = WTMonotonicMillis();
+        config_ok = ReadConfiguration(cfgfile, data_dir, m_config);
+        config_ms = WTMonotonicMillis() - start;
+    });
+
     // build icons from the embedded SVG data
     wxBitmapBundle bmp_bundle =
         wxBitmapBundle::FromSVG(ICON_SVG, wxSize(32, 32));
     wxIcon tbicon = bmp_bundle.GetIcon(wxSize(16, 16));
     wxIcon frameicon = bmp_bundle.GetIcon(wxSize(32, 32));
 
+    // the greyed out icon is shown while the first start is delayed
+    m_trayIcon = tbicon;
+    m_waitingIcon.CopyFromBitmap(bmp_bundle.GetBitmap(wxSize(16, 16)).ConvertToDisabled());
+
+    long long icons_ms = WTMonotonicMillis() - init_start;
+
     // initialize process reference members
     m_process = NULL;
+    m_childSerial = 0;
     m_pid = 0;
+    m_state = WT_STATE_STOPPED;
+    m_cmdSentAt = 0;
+    m_pendingCmd = WT_CMD_COUNT;
+    m_taskBarIcon = NULL;
+    m_standby = NULL;
+    m_standbySentAt = 0;
+    m_handoverPaused = false;
+    m_handoverStopping = false;
+    m_startPaused = false;
+    m_restartPending = false;
+    m_restartPaused = false;
+
+    // initialize the figures shown in the menu
+    m_startCount = 0;
+    m_startedAt = 0;
+    m_lastTaskAt = 0;
+    m_lastTaskName[0] = 0;
+    m_hasSample = false;
+    m_cpuPercent = 0;
+    m_historyLatencySum = 0;
+    m_historyLatencyCount = 0;
+
+    // initialize the watchdog figures
+    m_ackSeen = false;
+    m_lastActivity = 0;
+    m_watchdogCpuMs = 0;
+    m_watchdogLogSize = wxInvalidSize;
+    m_handoverAt = 0;
+    m_autoPause = 0;
+    m_autoPauseStale = false;
+    m_throttled = false;
+    m_powerSource = WT_POWER_COUNT;
+    m_priority = PRIORITY_MINIMUM;
+    m_logFlooding = false;
+    m_lastRotation = 0;
 
     // set the frame icon
     SetIcon(frameicon);
@@ -201,219 +970,676 @@ WTHiddenFrame::WTHiddenFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, ti
     }
 #endif
 
-    // get the configuration
-    wxStandardPaths paths = wxStandardPaths::Get();
-    wxString data_dir = paths.GetUserDataDir();
-    wxString cfgfile(data_dir + wxFileName::GetPathSeparator() + wxString(CONFIG_FILE));
-    wxString command_path, config_path, log_path, log_level, logview_command_path;
-    unsigned int priority = PRIORITY_MINIMUM;
-    wxString t_cmdver;
-    wxArrayString t_cmdout;
-
-    try {
-        auto res_conf = toml::parse(cfgfile.ToStdString());
-        if (!res_conf.is_table() && !res_conf.contains("whenever_tray")) {
-            command_path = wxString(WHENEVER_COMMAND);
-            logview_command_path = wxString(LOGVIEW_DEFAULT_COMMAND);
-            config_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_CONFIG);
-            log_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_LOG);
-            log_level = wxString(WHENEVER_LOGLEVEL);
-        } else {
-            // there might be better ways to extract the configuration, but
-            // this is quick and does the job: anyway all the local variables
-            // used during the process are thrown away after initialization
-            auto conf = toml::find<std::map<std::string, std::string>>(res_conf, "whenever_tray");
-            auto e1 = conf.find("whenever_command");
-            if (e1 != conf.end()) {
-                command_path = wxString(conf["whenever_command"]);
-            } else {
-                command_path = wxString(WHENEVER_COMMAND);
-            }
-            auto e2 = conf.find("whenever_config");
-            if (e2 != conf.end()) {
-                config_path = wxString(conf["whenever_config"]);
-            } else {
-                config_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_CONFIG);
-            }
-            auto e3 = conf.find("whenever_logfile");
-            if (e3 != conf.end()) {
-                log_path = wxString(conf["whenever_logfile"]);
-            } else {
-                log_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_LOG);
-            }
-            auto e4 = conf.find("whenever_loglevel");
-            if (e4 != conf.end()) {
-                log_level = wxString(conf["whenever_loglevel"]);
-                wxString allowed = wxString("/error/warn/info/debug/trace/");
-                if (allowed.find(wxString::Format("/%s/", log_level)) == wxNOT_FOUND)  {
-                    log_level = wxString(WHENEVER_LOGLEVEL);
-                }
-            } else {
-                log_level = wxString(WHENEVER_LOGLEVEL);
-            }
-            auto e5 = conf.find("whenever_priority");
-            if (e5 != conf.end()) {
-                auto s = wxString(conf["whenever_priority"]);
-                wxString allowed = wxString("/normal/low/minimum/");
-                if (allowed.find(wxString::Format("/%s/", s)) == wxNOT_FOUND) {
-                    priority = PRIORITY_MINIMUM;
-                } else {
-                    if (s == "normal")
-                        priority = PRIORITY_NORMAL;
-                    else if (s == "low")
-                        priority = PRIORITY_LOW;
-                    else
-                        priority = PRIORITY_MINIMUM;
-                }
-            }
-            auto e6 = conf.find("logview_command");
-            if (e6 != conf.end()) {
-                logview_command_path = wxString(conf["logview_command"]);
-            } else {
-                logview_command_path = wxString(LOGVIEW_DEFAULT_COMMAND);
-            }
-        }
-    }
-    catch (...) {
+    // wait for the configuration
+    config_thread.join();
+    if (!config_ok) {
         wxMessageBox(
             "Could not read/parse configuration file:\n"
             "please check for presence or errors.\n"
             "Default values will be used.",
             "Warning",
             wxOK | wxICON_EXCLAMATION);
-        command_path = wxString(WHENEVER_COMMAND);
-        logview_command_path = wxString(LOGVIEW_DEFAULT_COMMAND);
-        config_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_CONFIG);
-        log_path = data_dir + wxFileName::GetPathSeparator() + wxString(WHENEVER_LOG);
-        log_level = wxString(WHENEVER_LOGLEVEL);
     }
+    m_priority = m_config.priority;
+
+    // the version of the scheduler is only shown in the about box, thus it
+    // is retrieved in the background while the scheduler is being started
+    m_cmdVersion = "unknown version";
+#ifdef WT_NATIVE_PROCESS
+    WTSpawnOptions probe;
+    probe.argv.push_back(m_config.command_path.ToStdString());
+    probe.argv.push_back("--version");
+    probe.env = WTCurrentEnvironment();
+    m_versionThread = std::thread([this, probe]() {
+        long long start = WTMonotonicMillis();
+        std::string version;
+        WTProbeCommand(probe, VERSION_PROBE_TIMEOUT, version);
+        wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_VERSION_EVENT);
+        event->SetString(wxString(version));
+        event->SetExtraLong((long)(WTMonotonicMillis() - start));
+        wxQueueEvent(this, event);
+    });
+#endif
 
-    // retrieve the version of Whenever directly from the command line
-    t_cmdver << "\"" << command_path << "\"" << wxString(" --version");
-    wxExecute(t_cmdver, t_cmdout, wxEXEC_SYNC | wxEXEC_HIDE_CONSOLE);
-    if (t_cmdout.IsEmpty()) {
-        m_cmdVersion = "unknown version";
-    } else {
-        m_cmdVersion = t_cmdout[0];
+    // metrics are exported only if a directory has been specified
+    m_metricsExporter.SetDirectory(m_config.metrics_dir.ToStdString());
+    if (m_metricsExporter.Enabled()) {
+        m_metricsTimer.Start(m_config.metrics_interval * 1000);
     }
 
-    // build a minimal command that logs where requested and start it
-    m_cmdLine
-        << "\"" << command_path << "\""
-        << wxString(" -L ") << log_level << (" -l ")
-        << "\"" << log_path << "\""
-        << " "
-        << "\"" << config_path << "\"";
-
-    // save the command line for the log viewer command
-    m_cmdLineLogView
-        << "\"" << logview_command_path << "\"" << " "
-        << "\"" << log_path << "\"";
-
-    if (!StartWheneverCommand(priority)) {
-        wxMessageBox(
-            "Could not start scheduler process:\n"
-            "please check configuration file.",
-            "Error",
-            wxOK | wxICON_EXCLAMATION);
-        Close(true);
+    // the last output of the scheduler is kept for post-mortem reports
+    m_postMortem.SetDirectory(m_config.postmortem_dir.ToStdString());
+    m_postMortem.SetCapacity(m_config.postmortem_buffer_kb * 1024);
+
+    // the scheduler comes back in the state last requested by the user,
+    // unless the request has expired in the meantime
+    m_intentJournal.SetPath((data_dir + wxFileName::GetPathSeparator()
+                             + wxString(INTENT_FILE)).ToStdString());
+    if (m_intentJournal.Load(m_intent)
+        && m_intent.Expired(wxGetUTCTimeMillis().GetValue())) {
+        m_intent = WTIntent();
     }
-}
-
-/// Destructor: stop process, if any, then delete dynamic data. The exit
-/// handlers defined below leave gracefully
-WTHiddenFrame::~WTHiddenFrame() {
-    StopWheneverCommand();
-    delete m_taskBarIcon;
-}
-
-// See above
-void WTHiddenFrame::OnExit(wxCommandEvent& WXUNUSED(event)) {
-    Close(true);
-}
+    ArmIntentTimer();
 
-// See above
-void WTHiddenFrame::OnCloseWindow(wxCloseEvent& WXUNUSED(event)) {
-    Destroy();
-}
+    // the pressure monitor is only started if a threshold is given
+    for (int i = 0; i < WT_PRESSURE_COUNT; i++) {
+        m_pressure.SetThreshold((WTPressureResource)i, m_config.pressure_threshold[i]);
+    }
+    m_pressure.SetWindow(m_config.pressure_window * 1000);
+    m_pressure.SetRelease(m_config.pressure_release * 1000);
+    if (!m_pressure.Start(this)) {
+        for (int i = 0; i < WT_PRESSURE_COUNT; i++) {
+            if (m_config.pressure_threshold[i] > 0) {
+                m_postMortem.AddNote("pressure: the pressure triggers cannot be registered");
+                break;
+            }
+        }
+    }
 
-/// Interface to start the underlying command (same on Windows and UNIX)
-bool WTHiddenFrame::StartWheneverCommand(unsigned int priority) {
-    if (!m_process) {
-        m_process = new WTPipedProcess(this);
+    // build a minimal command that logs where requested and start it: the
+    // arguments are passed as they are, thus no quoting is needed, and the
+    // scheduler receives the environment of the tray with the configured
+    // variables added or replaced
+    m_spawnOptions.argv.push_back(m_config.command_path.ToStdString());
+    m_spawnOptions.argv.push_back("-L");
+    m_spawnOptions.argv.push_back(m_config.log_level.ToStdString());
+    m_spawnOptions.argv.push_back("-l");
+    m_spawnOptions.argv.push_back(m_config.log_path.ToStdString());
+    m_spawnOptions.argv.push_back(m_config.config_path.ToStdString());
+    m_spawnOptions.env = WTCurrentEnvironment();
+    for (size_t i = 0; i < m_config.env.size(); i++) {
+        WTSetEnvironment(m_spawnOptions.env, m_config.env[i]);
     }
-    // run the scheduler at selected priority
-    m_process->SetPriority(priority);
-    m_pid = wxExecute(
-        m_cmdLine,
-        wxEXEC_ASYNC | wxEXEC_HIDE_CONSOLE | wxEXEC_MAKE_GROUP_LEADER,
-        m_process);
-    SLEEP(APP_START_SLEEP);
-    if (!m_process->Alive()) {
-        m_pid = 0;
+    m_spawnOptions.cpus = m_config.cpus;
+#ifdef WT_NATIVE_PROCESS
+    if (!m_controller.Start(this)) {
+        m_postMortem.AddNote("process: the controller thread cannot be started");
     }
-    if (!m_pid) {
-        return false;
+#endif
+
+    // the policy for the current power source is applied before starting
+    // the scheduler, and then whenever the source changes
+    if (m_config.power_policy[WT_POWER_AC].enabled
+        || m_config.power_policy[WT_POWER_BATTERY].enabled) {
+        wxTimerEvent power_event;
+        OnPowerTimer(power_event);
+        m_powerTimer.Start(m_config.power_interval * 1000);
     }
-    return true;
-}
 
-/// Interface to stop the scheduler: uses the communication channel (stdin)
-bool WTHiddenFrame::StopWheneverCommand() {
-    if (m_pid && m_process->Exists(m_pid)) {
-        // in most cases the command is expected to work and the scheduler
-        // will exit cleanly in a short while (normally is a fraction of a
-        // second, because *whenever* will try to react to commands at most
-        // after 0.5 seconds), but in case something goes wrong this wrapper
-        // will try to explicitly kill the scheduler: in this case `false`
-        // is returned to remind that something has failed - although the
-        // current implementation just ignores this return value
-        wxOutputStream* appstdin = m_process->GetOutputStream();
-        if (appstdin) {
-            // shorten the command in order to remove the trailing zero
-            appstdin->WriteAll(WHENEVER_CMD_EXIT, strlen(WHENEVER_CMD_EXIT));
-            SLEEP(APP_KILL_SLEEP);
-        }
-        if (!m_process->Exists(m_pid)) {
-            m_pid = 0;
-            return true;
+    // in idle mode the scheduler only runs while the user is away: the
+    // first check is done now, so that it is started paused if needed
+    if (m_config.idle_resume > 0) {
+        if (m_idle.Open()) {
+            wxTimerEvent idle_event;
+            OnIdleTimer(idle_event);
         } else {
-            m_process->Kill(m_pid, wxSIGKILL, wxKILL_CHILDREN);
-            SLEEP(APP_KILL_SLEEP);
-            return false;
+            m_postMortem.AddNote("idle: session idle time not available");
         }
-    } else {
-        return false;
     }
-}
 
-/// Interface to pause the scheduler: uses the communication channel (stdin)
-bool WTHiddenFrame::PauseWhenever() {
-    if (m_pid && m_process->Exists(m_pid)) {
-        wxOutputStream* appstdin = m_process->GetOutputStream();
-        if (appstdin) {
-            // shorten the command in order to remove the trailing zero
-            appstdin->WriteAll(WHENEVER_CMD_PAUSE, strlen(WHENEVER_CMD_PAUSE));
-            return true;
+    // the quiet hours are checked now, so that the scheduler is started
+    // paused within a window, and then whenever the state may change
+    if (m_config.quiet_hours_skipped > 0) {
+        char note[64];
+        snprintf(note, sizeof(note), "quiet: %ld malformed windows ignored",
+                 m_config.quiet_hours_skipped);
+        m_postMortem.AddNote(note);
+    }
+    if (!m_config.quiet_hours.Empty()) {
+        if (m_quietTimer.Start(this)) {
+            UpdateQuietHours();
         } else {
-            return false;
+            m_postMortem.AddNote("quiet: the timer could not be created");
         }
-    } else {
-        return false;
     }
-}
 
-/// Interface to resume the scheduler: uses the communication channel (stdin)
-bool WTHiddenFrame::ResumeWhenever() {
-    if (m_pid && m_process->Exists(m_pid)) {
-        wxOutputStream* appstdin = m_process->GetOutputStream();
-        if (appstdin) {
-            // shorten the command in order to remove the trailing zero
-            appstdin->WriteAll(WHENEVER_CMD_RESUME, strlen(WHENEVER_CMD_RESUME));
-            return true;
-        } else {
-            return false;
+    // the session is traced if requested, overwriting a previous trace
+    if (!m_config.trace_file.IsEmpty()
+        && !m_trace.Open(m_config.trace_file.ToStdString(),
+                         (unsigned long long)m_config.trace_max_mb * 1024 * 1024)) {
+        m_postMortem.AddNote("trace: the trace file cannot be created");
+    }
+
+    // save the arguments for the log viewer command
+    m_logViewArgv.push_back(m_config.logview_command_path.ToStdString());
+    m_logViewArgv.push_back(m_config.log_path.ToStdString());
+
+    // the scheduler is started right away, unless the startup gate holds
+    // it until the system has settled after the login
+    m_startupGate.SetDelays(m_config.startup_delay * 1000, m_config.startup_max_delay * 1000);
+    m_startupGate.SetLoad(m_config.startup_load);
+    m_startupGate.SetPressure(m_config.startup_pressure);
+    m_startupGate.SetDisk(m_config.startup_disk);
+    if (m_startupGate.Enabled()) {
+        m_startupGate.Begin(WTMonotonicMillis());
+        SetSchedulerState(WT_STATE_WAITING);
+        m_taskBarIcon->SetIcon(m_waitingIcon, wxString(APP_NAME_LONG) + " (waiting)");
+        m_taskBarIcon->SetStatusLine(WT_STATUS_UPTIME, "Waiting for the system to settle");
+        m_startupTimer.Start(STARTUP_CHECK_INTERVAL);
+    } else {
+        LaunchScheduler();
+    }
+
+    // what follows does not affect how the scheduler is started, thus it
+    // is done once it has been spawned: the history is recorded unless the
+    // sampling interval is zero
+    m_historyPath = data_dir + wxFileName::GetPathSeparator() + wxString(HISTORY_FILE);
+    if (m_config.history_interval > 0 && m_history.Open(m_historyPath.ToStdString())) {
+        m_historyTimer.Start(m_config.history_interval * 1000);
+    }
+
+    // statistics about tasks and conditions go on from where the previous
+    // session left them, unless they are disabled
+    m_taskStatsPath = data_dir + wxFileName::GetPathSeparator() + wxString(TASKSTATS_FILE);
+    m_taskStats.SetLogPath(m_config.log_path.ToStdString());
+    if (m_config.task_stats_interval > 0) {
+        m_taskStats.Load(m_taskStatsPath.ToStdString());
+        m_taskStatsTimer.Start(TASKSTATS_CATCHUP_INTERVAL);
+    }
+
+    // the growth of the log is measured only if a limit is given
+    m_logWatcher.SetPath(m_config.log_path.ToStdString());
+    m_logWatcher.SetThreshold(m_config.logflood_rate * 1024.0);
+    if (m_config.logflood_rate > 0 && !m_logWatcher.Start(this)) {
+        m_postMortem.AddNote("log: the growth of the log cannot be watched");
+    }
+
+    // the age of the log is counted from the last rotation, and segments
+    // left uncompressed by a previous session are compressed now
+    if (m_config.log_rotate_size > 0 || m_config.log_rotate_age > 0) {
+        std::vector<std::string> segments;
+        WTListLogSegments(m_config.log_path.ToStdString(), segments);
+        m_lastRotation = time(NULL);
+        if (!segments.empty()) {
+            WTLogSegmentTime(segments.back(), m_lastRotation);
+        }
+        if (m_config.log_compress_level > 0) {
+            m_compressor.SetPrune(m_config.log_path.ToStdString(), m_config.log_rotate_keep);
+            m_compressor.Start(m_config.log_compress_level, this);
+            for (size_t i = 0; i < segments.size(); i++) {
+                if (!wxString(segments[i]).EndsWith(WT_LOG_GZ_SUFFIX)) {
+                    m_compressor.Enqueue(segments[i]);
+                }
+            }
+        }
+        m_rotateTimer.Start(ROTATE_CHECK_INTERVAL);
+    }
+
+    // the output is forwarded to syslog or to the journal if requested
+    if (!m_config.forward_format.IsEmpty()) {
+        WTForwardFormat format = m_config.forward_format == "journal"
+            ? WT_FORWARD_JOURNAL : WT_FORWARD_SYSLOG;
+        std::string socket = m_config.forward_socket.ToStdString();
+        if (socket.empty()) {
+            socket = format == WT_FORWARD_JOURNAL
+                ? WT_FORWARD_JOURNAL_SOCKET : WT_FORWARD_SYSLOG_SOCKET;
+        }
+        m_forwarder.SetSocket(socket, format);
+        m_forwarder.SetIdentifier(m_config.forward_ident.ToStdString());
+        if (!m_forwarder.Start()) {
+            m_postMortem.AddNote("forward: the output cannot be forwarded");
+        }
+    }
+
+    char note[128];
+    snprintf(note, sizeof(note), "init: ready in %lld ms (configuration %lld ms, icons %lld ms)",
+             WTMonotonicMillis() - init_start, config_ms, icons_ms);
+    m_postMortem.AddNote(note);
+
+#ifndef WT_NATIVE_PROCESS
+    // without native processes the version can only be retrieved
+    // synchronously, which is done once the scheduler has been started
+    wxString t_cmdver;
+    wxArrayString t_cmdout;
+    t_cmdver << "\"" << m_config.command_path << "\"" << wxString(" --version");
+    wxExecute(t_cmdver, t_cmdout, wxEXEC_SYNC | wxEXEC_HIDE_CONSOLE);
+    if (!t_cmdout.IsEmpty()) {
+        m_cmdVersion = t_cmdout[0];
+    }
+#endif
+}
+
+/// Start the scheduler for the first time
+void WTHiddenFrame::LaunchScheduler() {
+    if (!StartWheneverCommand(m_priority)) {
+        StartFailed();
+    }
+}
+
+/// The scheduler could not be started, or left before settling: the tray
+/// leaves if it has never been started, since it would be of no use
+void WTHiddenFrame::StartFailed() {
+    m_restartPending = false;
+    m_restartPaused = false;
+    if (m_startCount == 0) {
+        wxMessageBox(
+            "Could not start scheduler process:\n"
+            "please check configuration file.",
+            "Error",
+            wxOK | wxICON_EXCLAMATION);
+        Close(true);
+    } else {
+        m_postMortem.AddNote("start: the scheduler could not be started");
+    }
+}
+
+/// Check the startup gate, and start the scheduler once the system has
+/// settled or the maximum delay has expired
+void WTHiddenFrame::OnStartupTimer(wxTimerEvent& WXUNUSED(event)) {
+    long long now = WTMonotonicMillis();
+    WTStartupDecision decision = m_startupGate.Check(now);
+    if (decision == WT_STARTUP_WAIT) {
+        m_taskBarIcon->SetStatusLine(WT_STATUS_UPTIME, wxString::Format(
+            "Waiting for the system to settle (%s)", m_startupGate.Blocker()));
+        return;
+    }
+    m_startupTimer.Stop();
+    m_metrics.startup_delay = m_startupGate.Waited(now) / 1000.0;
+    char note[96];
+    snprintf(note, sizeof(note), "startup: %s after %.1f s",
+             decision == WT_STARTUP_SETTLED ? "system settled" : "maximum delay reached",
+             m_metrics.startup_delay);
+    m_postMortem.AddNote(note);
+    m_taskBarIcon->SetIcon(m_trayIcon, APP_NAME_LONG);
+    LaunchScheduler();
+}
+
+/// Destructor: stop process, if any, then delete dynamic data. The exit
+/// handlers defined below leave gracefully
+WTHiddenFrame::~WTHiddenFrame() {
+    m_pressure.Stop();
+    m_quietTimer.Stop();
+    m_logWatcher.Stop();
+    m_logCooldownTimer.Stop();
+    m_rotateTimer.Stop();
+    m_compressor.Stop();
+    m_forwarder.Stop();
+    m_trace.Close();
+    if (m_excerptThread.joinable()) {
+        m_excerptThread.join();
+    }
+    if (m_versionThread.joinable()) {
+        m_versionThread.join();
+    }
+    m_powerTimer.Stop();
+    m_startupTimer.Stop();
+    m_idleTimer.Stop();
+    m_pollTimer.Stop();
+    m_statusTimer.Stop();
+    m_metricsTimer.Stop();
+    m_historyTimer.Stop();
+    m_taskStatsTimer.Stop();
+    if (m_config.task_stats_interval > 0) {
+        m_taskStats.Save(m_taskStatsPath.ToStdString());
+    }
+    m_watchdogTimer.Stop();
+    m_intentTimer.Stop();
+    ShutdownScheduler();
+    delete m_taskBarIcon;
+}
+
+// See above
+void WTHiddenFrame::OnExit(wxCommandEvent& WXUNUSED(event)) {
+    Close(true);
+}
+
+// See above
+void WTHiddenFrame::OnCloseWindow(wxCloseEvent& WXUNUSED(event)) {
+    Destroy();
+}
+
+/// Interface to start the underlying command (same on Windows and UNIX)
+bool WTHiddenFrame::StartWheneverCommand(unsigned int priority) {
+    // a process object is used for one scheduler instance only: the one of
+    // a previous instance, whose termination might not have been notified
+    // yet, is detached and deletes itself when it receives the notification
+    if (m_process) {
+        m_process->Orphan();
+    }
+    m_process = new WTPipedProcess(this, ++m_childSerial);
+    // run the scheduler at selected priority: if it is intended to be
+    // paused, and the scheduler supports it, it is started already paused
+    // so that no task can run in the meantime
+    SetSchedulerState(WT_STATE_STARTING);
+    if (m_intent.paused && m_intent.Expired(wxGetUTCTimeMillis().GetValue())) {
+        SetIntent(false, "pause expired");
+    }
+    m_spawnOptions.priority = priority;
+    WTSpawnOptions options = m_spawnOptions;
+    bool paused = m_intent.paused || m_autoPause != 0 || m_restartPaused;
+    m_autoPauseStale = false;
+    bool start_paused = paused && !m_config.pause_flag.IsEmpty();
+    if (start_paused) {
+        options.argv.insert(options.argv.end() - 1, m_config.pause_flag.ToStdString());
+    }
+    // otherwise the pause command is written at once: the pipe keeps it
+    // until the scheduler reads its input, so that it does not run unpaused
+    // until it has settled after APP_START_SLEEP
+    m_startPaused = start_paused;
+    m_pid = 0;
+    if (!m_process->Launch(options, APP_START_SLEEP)) {
+        m_process->Orphan();
+        m_process = NULL;
+        SetSchedulerState(WT_STATE_STOPPED);
+        return false;
+    }
+    if (paused && !start_paused && SendCommand(WT_CMD_PAUSE)) {
+        m_startPaused = true;
+    }
+    return true;
+}
+
+/// Called by the process handler once the scheduler has been running for
+/// the settle time, or as soon as it has failed, in which case the PID is 0
+void WTHiddenFrame::OnSchedulerSpawned(WTPipedProcess* process, long pid) {
+    if (process == m_standby) {
+        if (!pid) {
+            HandoverFailed("handover: standby scheduler not started");
+            return;
         }
+        m_standbySentAt = wxGetLocalTimeMillis();
+        m_postMortem.AddNote("handover: standby scheduler started");
+        return;
+    }
+    if (process != m_process) {
+        return;
+    }
+    if (!pid) {
+        m_process->Orphan();
+        m_process = NULL;
+        SetSchedulerState(WT_STATE_STOPPED);
+        StartFailed();
+        return;
+    }
+    m_pid = pid;
+    SchedulerStarted(m_startPaused ? WT_STATE_PAUSED : WT_STATE_RUNNING);
+
+    // the reasons to pause may have changed while the scheduler was
+    // starting, since the commands wait for it to settle: the state it was
+    // started in is corrected now
+    bool paused = m_intent.paused || m_autoPause != 0 || m_restartPaused;
+    m_restartPaused = false;
+    m_autoPauseStale = false;
+    if (paused) {
+        PauseWhenever();
+    } else {
+        ResumeWhenever();
+    }
+}
+
+/// Reset the figures that refer to a single scheduler instance, and start
+/// the timers that follow it, once the new instance is known to be alive
+void WTHiddenFrame::SchedulerStarted(WTSchedulerState state) {
+    SetSchedulerState(state);
+    m_pendingCmd = WT_CMD_COUNT;
+    if (m_throttled && !m_config.pressure_pause) {
+        WTSetGroupPriority(m_pid, PRIORITY_MINIMUM);
+    }
+    m_startCount++;
+    m_metrics.starts = m_startCount;
+    m_metrics.restarts = m_startCount - 1;
+    m_startedAt = WTMonotonicMillis();
+    m_hasSample = false;
+    m_postMortem.Start(m_pid, WTJoinArgv(m_spawnOptions.argv));
+    if (m_trace.IsOpen()) {
+        std::string cmdline = WTJoinArgv(m_spawnOptions.argv);
+        m_trace.Record(WT_TRACE_START, cmdline.c_str(), cmdline.size());
+    }
+    m_ackSeen = false;
+    m_lastActivity = wxGetLocalTimeMillis();
+    m_watchdogCpuMs = 0;
+    m_watchdogLogSize = wxInvalidSize;
+    m_pollTimer.Start(APP_POLL_INTERVAL);
+    m_statusTimer.Start(APP_STATUS_INTERVAL);
+    if (m_config.watchdog_interval > 0) {
+        m_watchdogTimer.Start(m_config.watchdog_interval * 1000);
+    }
+    UpdateStatusLines();
+}
+
+/// Interface to stop the scheduler: uses the communication channel (stdin)
+bool WTHiddenFrame::StopWheneverCommand() {
+    if (!SchedulerExists()) {
+        return false;
+    }
+    if (m_state == WT_STATE_STOPPING) {
+        return true;
+    }
+    // in most cases the command is expected to work and the scheduler will
+    // exit cleanly in a short while (normally is a fraction of a second,
+    // because *whenever* will try to react to commands at most after 0.5
+    // seconds), but in case something goes wrong its process group is
+    // killed after APP_KILL_SLEEP: the termination is notified in both
+    // cases, and nothing waits for it here
+    SetSchedulerState(WT_STATE_STOPPING);
+    m_process->KillGroup(SendCommand(WT_CMD_EXIT) ? APP_KILL_SLEEP : 0);
+    return true;
+}
+
+/// Restart the scheduler, bringing it back to the paused state if needed:
+/// in handover mode the old instance keeps running until the new one is
+/// ready, and a normal restart is only performed if the handover fails.
+/// A normal restart starts the new instance once the old one has left
+bool WTHiddenFrame::RestartWhenever() {
+    if (m_standby || m_restartPending) {
+        return true;
+    }
+    bool paused = m_state == WT_STATE_PAUSED || m_state == WT_STATE_PAUSING;
+    if (m_config.restart_handover && SchedulerExists() && m_state != WT_STATE_STOPPING
+        && HandoverWhenever(paused)) {
+        return true;
+    }
+    m_restartPaused = paused;
+    if (SchedulerExists()) {
+        m_restartPending = true;
+        return StopWheneverCommand();
+    }
+    return StartWheneverCommand(m_priority);
+}
+
+/// Look for the acknowledgement of the pause command
+void WTStandbySink::OnLine(WTOutputStream WXUNUSED(stream), const char* line, size_t len) {
+    if (WTLineContains(line, len, WHENEVER_ACKS[WT_CMD_PAUSE])) {
+        paused = true;
+    }
+}
+
+/// Hand over to a new scheduler instance: the new instance is started and
+/// immediately paused, and only when it is ready (that is, it acknowledged
+/// the pause, or it is still alive after APP_ACK_TIMEOUT) the old one is
+/// told to exit, and the new one is resumed once the old one has left, so
+/// that the scheduling gap is reduced to the exit of the old instance and
+/// a command round trip. The old instance is left untouched if the new one
+/// does not become ready
+bool WTHiddenFrame::HandoverWhenever(bool paused) {
+    m_standbySink = WTStandbySink();
+    m_standby = new WTPipedProcess(this, ++m_childSerial);
+    m_standby->SetStandby(&m_standbySink);
+    m_standbySentAt = 0;
+    m_handoverPaused = paused;
+    m_handoverStopping = false;
+    m_spawnOptions.priority = m_priority;
+    // the standby must never run together with the current instance: it is
+    // started paused as in StartWheneverCommand, or else the pause command
+    // is written at once, before the scheduler reads its input
+    WTSpawnOptions options = m_spawnOptions;
+    bool start_paused = !m_config.pause_flag.IsEmpty();
+    if (start_paused) {
+        options.argv.insert(options.argv.end() - 1, m_config.pause_flag.ToStdString());
+    }
+    if (!m_standby->Launch(options, 0)) {
+        m_standby->Orphan();
+        m_standby = NULL;
+        m_postMortem.AddNote("handover: standby scheduler not started");
+        m_metrics.handover_failures++;
+        return false;
+    }
+    if (!start_paused) {
+        const char* text = WHENEVER_COMMANDS[WT_CMD_PAUSE];
+        m_standby->WriteCommand(text, strlen(text));
+    }
+    return true;
+}
+
+/// Check whether the standby scheduler is ready, and if so tell the old
+/// instance to leave
+void WTHiddenFrame::CheckHandover() {
+    if (!m_standby || m_handoverStopping || m_standbySentAt == 0) {
+        return;
+    }
+    if (m_standbySink.paused || wxGetLocalTimeMillis() - m_standbySentAt >= APP_ACK_TIMEOUT) {
+        m_handoverStopping = true;
+        if (!StopWheneverCommand()) {
+            HandoverAdopt();
+        }
+    }
+}
+
+/// The standby scheduler did not become ready: it is discarded, and the
+/// scheduler is restarted normally
+void WTHiddenFrame::HandoverFailed(const char* note) {
+    m_postMortem.AddNote(note);
+    m_metrics.handover_failures++;
+    if (m_standby) {
+        m_standby->Orphan();
+        m_standby = NULL;
+    }
+    m_restartPaused = m_handoverPaused;
+    if (SchedulerExists()) {
+        m_restartPending = true;
+        StopWheneverCommand();
+    } else if (!StartWheneverCommand(m_priority)) {
+        StartFailed();
+    }
+}
+
+/// The old instance has left: the standby takes its place
+void WTHiddenFrame::HandoverAdopt() {
+    if (m_process) {
+        m_process->Orphan();
+    }
+    m_process = m_standby;
+    m_standby = NULL;
+    m_handoverStopping = false;
+    m_process->Adopt(this);
+    m_pid = m_process->Pid();
+    m_metrics.handovers++;
+    SchedulerStarted(WT_STATE_PAUSED);
+    m_ackSeen = m_standbySink.paused;
+    m_postMortem.AddNote("handover: standby scheduler adopted");
+    if (!m_handoverPaused) {
+        m_handoverAt = wxGetLocalTimeMillis();
+        ResumeWhenever();
+    }
+}
+
+/// Stop the scheduler when the tray leaves: this is the only case in which
+/// the GUI waits for it, at most APP_KILL_SLEEP before it is killed
+void WTHiddenFrame::ShutdownScheduler() {
+    if (m_standby) {
+        m_standby->Orphan();
+        m_standby = NULL;
+    }
+    if (SchedulerExists() && m_state != WT_STATE_STOPPING) {
+        SetSchedulerState(WT_STATE_STOPPING);
+        SendCommand(WT_CMD_EXIT);
+    }
+#ifdef WT_NATIVE_PROCESS
+    m_controller.Stop(APP_KILL_SLEEP);
+#else
+    for (int waited = 0; waited < APP_KILL_SLEEP && SchedulerExists(); waited += APP_KILL_POLL) {
+        SLEEP(APP_KILL_POLL);
+    }
+    if (SchedulerExists()) {
+        m_process->KillGroup();
+    }
+#endif
+    if (m_process) {
+        // the process may notify its termination after the frame is gone
+        m_process->Orphan();
+        m_process = NULL;
+    }
+}
+
+/// Record the intended state in the journal: a pause expires after the
+/// configured time, if any
+void WTHiddenFrame::SetIntent(bool paused, const char* reason) {
+    long long now = wxGetUTCTimeMillis().GetValue();
+    m_intent.paused = paused;
+    m_intent.reason = reason;
+    m_intent.set_at = now;
+    m_intent.expires_at = paused && m_config.pause_expiry > 0
+        ? now + m_config.pause_expiry * 60000LL : 0;
+    m_intentJournal.Save(m_intent);
+    ArmIntentTimer();
+}
+
+/// Schedule the expiry of the intended pause, if any: long delays are
+/// split, and the timer is armed again until the pause has expired
+void WTHiddenFrame::ArmIntentTimer() {
+    m_intentTimer.Stop();
+    if (m_intent.paused && m_intent.expires_at != 0) {
+        long long left = m_intent.expires_at - wxGetUTCTimeMillis().GetValue();
+        if (left > INTENT_TIMER_MAX) {
+            left = INTENT_TIMER_MAX;
+        }
+        m_intentTimer.StartOnce(left > 0 ? (int)left : 1);
+    }
+}
+
+/// Resume the scheduler when the pause requested by the user expires: if
+/// the scheduler is not running, only the intent is changed, and it is
+/// applied when the scheduler starts
+void WTHiddenFrame::OnIntentTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (!m_intent.paused || !m_intent.Expired(wxGetUTCTimeMillis().GetValue())) {
+        ArmIntentTimer();
+    } else if (m_state == WT_STATE_PAUSED && m_autoPause == 0) {
+        ResumeWhenever("pause expired");
+    } else {
+        SetIntent(false, "pause expired");
+    }
+}
+
+/// Interface to pause the scheduler: uses the communication channel (stdin),
+/// and when a reason is given the pause is recorded as the intended state;
+/// a scheduler already paused automatically only gets the intent, so that
+/// it is not resumed when the automatic pause ends
+bool WTHiddenFrame::PauseWhenever(const char* reason) {
+    if (reason && IsAutoPausedOnly()) {
+        SetIntent(true, reason);
+        if (m_taskBarIcon) {
+            m_taskBarIcon->UpdateMenu();
+        }
+        return true;
+    }
+    // redundant requests are suppressed before they reach the pipe
+    if (m_state != WT_STATE_RUNNING) {
+        return false;
+    }
+    if (SchedulerExists() && SendCommand(WT_CMD_PAUSE)) {
+        SetSchedulerState(WT_STATE_PAUSING);
+        if (reason) {
+            SetIntent(true, reason);
+        }
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/// Interface to resume the scheduler: uses the communication channel (stdin),
+/// and when a reason is given the resumption is recorded as intended state
+bool WTHiddenFrame::ResumeWhenever(const char* reason) {
+    // redundant requests are suppressed before they reach the pipe
+    if (m_state != WT_STATE_PAUSED) {
+        return false;
+    }
+    if (SchedulerExists() && SendCommand(WT_CMD_RESUME)) {
+        SetSchedulerState(WT_STATE_RESUMING);
+        if (reason) {
+            SetIntent(false, reason);
+        }
+        return true;
     } else {
         return false;
     }
@@ -421,24 +1647,849 @@ bool WTHiddenFrame::ResumeWhenever() {
 
 /// Interface to reset conditions: uses the communication channel (stdin)
 bool WTHiddenFrame::ResetConditions() {
-    if (m_pid && m_process->Exists(m_pid)) {
-        wxOutputStream* appstdin = m_process->GetOutputStream();
-        if (appstdin) {
-            // shorten the command in order to remove the trailing zero
-            appstdin->WriteAll(WHENEVER_CMD_RESETCONDS, strlen(WHENEVER_CMD_RESETCONDS));
-            return true;
+    if (SchedulerExists()) {
+        return SendCommand(WT_CMD_RESETCONDS);
+    } else {
+        return false;
+    }
+}
+
+/// Write a command to the scheduler stdin, recording the time it was sent
+/// so that the acknowledgement latency can be determined
+bool WTHiddenFrame::SendCommand(WTCommand cmd) {
+    if (!m_process) {
+        return false;
+    }
+    // shorten the command in order to remove the trailing zero
+    const char* text = WHENEVER_COMMANDS[cmd];
+    if (!m_process->WriteCommand(text, strlen(text))) {
+        return false;
+    }
+    m_cmdSentAt = wxGetLocalTimeMillis();
+    m_pendingCmd = cmd;
+    m_metrics.commands[cmd]++;
+    if (m_trace.IsOpen()) {
+        m_trace.Record(WT_TRACE_STDIN, text, strlen(text));
+    }
+    return true;
+}
+
+/// Record the acknowledgement latency of the pending command: once the
+/// scheduler has acknowledged a command, the watchdog relies on it
+void WTHiddenFrame::AcknowledgeCommand(bool acknowledged) {
+    if (m_pendingCmd < WT_CMD_COUNT) {
+        if (acknowledged) {
+            m_metrics.latency[m_pendingCmd].Observe(
+                (wxGetLocalTimeMillis() - m_cmdSentAt).ToDouble());
+            m_ackSeen = true;
+            m_lastActivity = wxGetLocalTimeMillis();
         } else {
-            return false;
+            m_metrics.unacknowledged[m_pendingCmd]++;
+        }
+        m_pendingCmd = WT_CMD_COUNT;
+    }
+}
+
+/// Check whether the scheduler process is still running
+bool WTHiddenFrame::SchedulerExists() {
+    return m_pid && m_process && m_process->Running();
+}
+
+/// Change the state of the scheduler as seen by the tray: transitions are
+/// noted in the post-mortem output, and the first transition to running
+/// after a handover closes the scheduling gap
+void WTHiddenFrame::SetSchedulerState(WTSchedulerState state) {
+    if (state != m_state) {
+        char note[64];
+        snprintf(note, sizeof(note), "state: %s -> %s",
+                 SCHEDULER_STATE_NAMES[m_state], SCHEDULER_STATE_NAMES[state]);
+        m_postMortem.AddNote(note);
+        if (m_handoverAt != 0 && state != WT_STATE_RESUMING) {
+            if (state == WT_STATE_RUNNING) {
+                m_metrics.handover_gap.Observe(
+                    (wxGetLocalTimeMillis() - m_handoverAt).ToDouble());
+            }
+            m_handoverAt = 0;
+        }
+        m_state = state;
+        m_metrics.up = IsSchedulerAlive();
+        m_metrics.paused = state == WT_STATE_PAUSED;
+        if (m_taskBarIcon) {
+            m_taskBarIcon->UpdateMenu();
+        }
+    }
+}
+
+/// Receive a line of scheduler output, and check whether it acknowledges
+/// the command that is currently pending, if any
+void WTHiddenFrame::OnLine(WTOutputStream stream, const char* line, size_t len) {
+    m_postMortem.AddLine(stream, line, len);
+    m_lastActivity = wxGetLocalTimeMillis();
+
+    // check whether the line acknowledges the pending command, if any
+    if (m_pendingCmd < WT_CMD_COUNT && WHENEVER_ACKS[m_pendingCmd]
+        && WTLineContains(line, len, WHENEVER_ACKS[m_pendingCmd])) {
+        AcknowledgeCommand(true);
+        if (m_state == WT_STATE_PAUSING) {
+            SetSchedulerState(WT_STATE_PAUSED);
+        } else if (m_state == WT_STATE_RESUMING) {
+            SetSchedulerState(WT_STATE_RUNNING);
         }
+        SettleAutoPause();
+    }
+
+    // count lines and bytes by level: unparsable lines have unknown level
+    WTLogRecord rec;
+    bool parsed = WTParseLogLine(line, len, rec);
+    m_metrics.log_lines[rec.level]++;
+    m_metrics.log_bytes[rec.level] += len + 1;
+    m_forwarder.Forward(line, len, rec.level, m_pid);
+
+    // remember the last task that has been started by the scheduler
+    if (parsed && rec.context.Is(WHENEVER_CTX_TASK) && rec.when.Is(WHENEVER_WHEN_START)) {
+        size_t n = rec.name.len < sizeof(m_lastTaskName) - 1
+            ? rec.name.len : sizeof(m_lastTaskName) - 1;
+        memcpy(m_lastTaskName, rec.name.ptr, n);
+        m_lastTaskName[n] = 0;
+        m_lastTaskAt = wxGetLocalTimeMillis();
+    }
+}
+
+/// Called by the process handler when the scheduler has exited: a restart
+/// or a handover waiting for it to leave goes on from here
+void WTHiddenFrame::OnSchedulerTerminated(WTPipedProcess* process, int WXUNUSED(pid), int status) {
+    if (process == m_standby) {
+        // the object deletes itself after the notification
+        m_standby = NULL;
+        HandoverFailed("handover: standby scheduler left");
+        return;
+    }
+    if (process != m_process) {
+        return;
+    }
+    if (m_pendingCmd == WT_CMD_EXIT) {
+        AcknowledgeCommand(status != -wxSIGKILL);
+    }
+    m_metrics.exited = true;
+    m_metrics.last_exit_status = status;
+    if (m_trace.IsOpen()) {
+        char text[16];
+        int n = snprintf(text, sizeof(text), "%d", status);
+        m_trace.Record(WT_TRACE_EXIT, text, n);
+        m_trace.Flush();
+    }
+
+    // a clean exit, also when requested by the tray, yields a zero status
+    if (status != 0) {
+        m_postMortem.WriteReport(status);
+    }
+
+    // the process object deletes itself after the notification, and only
+    // the current process object notifies its termination to the frame
+    m_process = NULL;
+    m_pid = 0;
+    if (!m_standby) {
+        m_pollTimer.Stop();
+    }
+    m_watchdogTimer.Stop();
+    SetSchedulerState(WT_STATE_STOPPED);
+    UpdateStatusLines();
+
+    if (m_standby && m_handoverStopping) {
+        HandoverAdopt();
+    } else if (m_restartPending) {
+        m_restartPending = false;
+        if (!StartWheneverCommand(m_priority)) {
+            StartFailed();
+        }
+    }
+}
+
+// format a duration in a compact form, with a resolution of one minute
+static wxString FormatDuration(long long ms) {
+    long long minutes = ms / 60000;
+    if (minutes >= 24 * 60) {
+        return wxString::Format("%ldd %02ldh %02ldm",
+            (long)(minutes / (24 * 60)), (long)((minutes / 60) % 24), (long)(minutes % 60));
+    } else {
+        return wxString::Format("%ldh %02ldm", (long)(minutes / 60), (long)(minutes % 60));
+    }
+}
+
+/// Refresh the status lines in the menu at APP_STATUS_INTERVAL at most
+void WTHiddenFrame::OnStatusTimer(wxTimerEvent& WXUNUSED(event)) {
+    m_trace.Flush();
+    UpdateStatusLines();
+}
+
+/// Compute the status lines: the menu itself is only touched when a text
+/// actually changes
+void WTHiddenFrame::UpdateStatusLines() {
+    bool alive = IsSchedulerAlive();
+
+    if (alive) {
+        m_taskBarIcon->SetStatusLine(WT_STATUS_UPTIME, wxString::Format(
+            "Uptime: %s", FormatDuration(WTMonotonicMillis() - m_startedAt)));
+    } else {
+        m_taskBarIcon->SetStatusLine(WT_STATUS_UPTIME, "Scheduler not running");
+    }
+
+    if (m_lastTaskAt != 0) {
+        wxDateTime when(m_lastTaskAt);
+        m_taskBarIcon->SetStatusLine(WT_STATUS_LASTTASK, wxString::Format(
+            "Last task: %s at %s", m_lastTaskName, when.FormatISOTime()));
+    } else {
+        m_taskBarIcon->SetStatusLine(WT_STATUS_LASTTASK, "Last task: none");
+    }
+
+    m_taskBarIcon->SetStatusLine(WT_STATUS_RESTARTS, wxString::Format(
+        "Restarts: %u", m_startCount > 0 ? m_startCount - 1 : 0));
+
+    // CPU is computed between consecutive samples, thus it is shown from
+    // the second sample onwards; values are rounded to limit updates
+    WTProcessSample sample;
+    if (alive && m_pid && WTSampleProcess(m_pid, sample)) {
+        double rss = (double)sample.rss_bytes / (1024.0 * 1024.0);
+        if (m_hasSample) {
+            m_cpuPercent = WTCpuPercent(m_lastSample, sample);
+            m_postMortem.SetSample(sample, m_cpuPercent);
+            m_taskBarIcon->SetStatusLine(WT_STATUS_RESOURCES, wxString::Format(
+                "CPU: %.1f%%, RSS: %.1f MB", m_cpuPercent, rss));
+        } else {
+            m_taskBarIcon->SetStatusLine(WT_STATUS_RESOURCES, wxString::Format(
+                "CPU: -, RSS: %.1f MB", rss));
+        }
+        m_lastSample = sample;
+        m_hasSample = true;
+        m_metrics.cpu_seconds = sample.cpu_ms / 1000.0;
+        m_metrics.rss_bytes = sample.rss_bytes;
+    } else {
+        m_taskBarIcon->SetStatusLine(WT_STATUS_RESOURCES, "CPU: -, RSS: -");
+        m_hasSample = false;
+        m_metrics.rss_bytes = 0;
+    }
+
+    if (!alive) {
+        m_statusTimer.Stop();
+    }
+}
+
+/// Periodically collect the scheduler output and expire pending commands:
+/// *whenever* reacts to commands within 0.5 seconds, thus a scheduler that
+/// is still alive after APP_ACK_TIMEOUT has accepted the command
+void WTHiddenFrame::OnPollTimer(wxTimerEvent& WXUNUSED(event)) {
+#ifndef WT_NATIVE_PROCESS
+    if (m_process && m_process->Alive()) {
+        m_process->DrainOutput();
+    }
+    if (m_standby && m_standby->Alive()) {
+        m_standby->DrainOutput();
+    }
+#endif
+    CheckHandover();
+    if (m_pendingCmd < WT_CMD_COUNT && m_pendingCmd != WT_CMD_EXIT
+        && wxGetLocalTimeMillis() - m_cmdSentAt >= APP_ACK_TIMEOUT) {
+        AcknowledgeCommand(false);
+        if ((m_state == WT_STATE_PAUSING || m_state == WT_STATE_RESUMING)
+            && SchedulerExists()) {
+            SetSchedulerState(m_state == WT_STATE_PAUSING ? WT_STATE_PAUSED : WT_STATE_RUNNING);
+        }
+        SettleAutoPause();
+    }
+}
+
+/// Liveness watchdog: a scheduler that is alive but does not write any
+/// output, does not write to the log and does not use CPU for
+/// watchdog_timeout seconds is considered hung and is restarted. Nothing
+/// is sent to the scheduler, since every command has side effects, and
+/// the watchdog is armed only after the scheduler has acknowledged at
+/// least a command, so that it never fires for a scheduler whose output
+/// cannot be seen; a paused scheduler is expected to be silent, and is
+/// not checked
+void WTHiddenFrame::OnWatchdogTimer(wxTimerEvent& WXUNUSED(event)) {
+    wxLongLong now = wxGetLocalTimeMillis();
+    if (m_state != WT_STATE_RUNNING) {
+        m_lastActivity = now;
+        return;
+    }
+
+    // progress of CPU time and growth of the log file are signs of life
+    WTProcessSample sample;
+    if (m_pid && WTSampleProcess(m_pid, sample)) {
+        if (sample.cpu_ms != m_watchdogCpuMs) {
+            m_lastActivity = now;
+        }
+        m_watchdogCpuMs = sample.cpu_ms;
+    }
+    wxULongLong log_size = wxFileName::GetSize(m_config.log_path);
+    if (log_size != m_watchdogLogSize) {
+        m_lastActivity = now;
+    }
+    m_watchdogLogSize = log_size;
+
+    if (m_ackSeen && now - m_lastActivity >= m_config.watchdog_timeout * 1000L) {
+        m_metrics.hangs++;
+        m_postMortem.WriteReport(0, "hang detected by the watchdog");
+        RestartWhenever();
+    }
+}
+
+/// Receive a pressure change from the monitor thread, and pass it to the
+/// GUI thread
+void WTHiddenFrame::OnPressureChange(bool high, WTPressureResource resource, double avg10) {
+    wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_PRESSURE_EVENT);
+    event->SetInt(resource);
+    event->SetExtraLong(high ? 1 : 0);
+    event->SetPayload(avg10);
+    wxQueueEvent(this, event);
+}
+
+/// Throttle the scheduler when the system is under pressure, by pausing it
+/// or by lowering its priority, and restore it when the pressure is gone:
+/// the original priority can only be restored where raising it is allowed
+void WTHiddenFrame::OnPressureEvent(wxThreadEvent& event) {
+    WTPressureResource resource = (WTPressureResource)event.GetInt();
+    bool high = event.GetExtraLong() != 0;
+    double avg10 = event.GetPayload<double>();
+    char note[128];
+
+    if (high && !m_throttled) {
+        m_throttled = true;
+        m_metrics.throttles[resource]++;
+        snprintf(note, sizeof(note), "pressure: %s at %.2f%%, %s",
+                 WTPressureResourceName(resource), avg10,
+                 m_config.pressure_pause ? "scheduler paused" : "priority lowered");
+        m_postMortem.AddNote(note);
+        if (m_config.pressure_pause) {
+            SetAutoPause(WT_AUTOPAUSE_PRESSURE, true);
+        } else {
+            WTSetGroupPriority(m_pid, PRIORITY_MINIMUM);
+        }
+    } else if (!high && m_throttled) {
+        m_throttled = false;
+        m_metrics.throttle_releases++;
+        snprintf(note, sizeof(note), "pressure: %s down to %.2f%%, released",
+                 WTPressureResourceName(resource), avg10);
+        m_postMortem.AddNote(note);
+        if (m_config.pressure_pause) {
+            SetAutoPause(WT_AUTOPAUSE_PRESSURE, false);
+        } else if (!WTSetGroupPriority(m_pid, m_priority)) {
+            m_postMortem.AddNote("pressure: the priority could not be restored");
+        }
+    }
+    m_metrics.throttled = m_throttled;
+}
+
+/// Pause the scheduler when the first reason to pause it arises, and resume
+/// it when the last one is gone: a scheduler paused by the user is never
+/// resumed here. While the scheduler is starting or a command is in
+/// flight the change is kept, and applied once the scheduler has settled
+void WTHiddenFrame::SetAutoPause(unsigned int reason, bool active) {
+    unsigned int previous = m_autoPause;
+    if (active) {
+        m_autoPause |= reason;
+    } else {
+        m_autoPause &= ~reason;
+    }
+    if ((previous == 0) == (m_autoPause == 0)) {
+        return;
+    }
+    if (m_state == WT_STATE_STARTING || m_state == WT_STATE_PAUSING
+        || m_state == WT_STATE_RESUMING) {
+        m_autoPauseStale = true;
+    } else if (m_autoPause != 0) {
+        PauseWhenever();
+    } else if (!m_intent.paused) {
+        ResumeWhenever();
+    }
+}
+
+/// Apply the last change of the automatic pauses that arrived while the
+/// scheduler could not follow it, once it is running or paused
+void WTHiddenFrame::SettleAutoPause() {
+    if (!m_autoPauseStale || (m_state != WT_STATE_RUNNING && m_state != WT_STATE_PAUSED)) {
+        return;
+    }
+    m_autoPauseStale = false;
+    if (m_autoPause != 0) {
+        PauseWhenever();
+    } else if (!m_intent.paused) {
+        ResumeWhenever();
+    }
+}
+
+/// Apply the policy of a power source to the running scheduler, and to the
+/// next instances: nothing needs to be restarted
+void WTHiddenFrame::ApplyPowerPolicy(WTPowerSource source) {
+    const WTPowerPolicy& policy = m_config.power_policy[source];
+    char note[64];
+    snprintf(note, sizeof(note), "power: running on %s", WTPowerSourceName(source));
+    m_postMortem.AddNote(note);
+    m_priority = policy.set_priority ? policy.priority : m_config.priority;
+    m_spawnOptions.cpus = policy.set_cpus ? policy.cpus : m_config.cpus;
+    if (m_pid) {
+        // a scheduler throttled by priority keeps the minimum priority, and
+        // gets the new one when the pressure is released
+        if (!(m_throttled && !m_config.pressure_pause)
+            && !WTSetGroupPriority(m_pid, m_priority)) {
+            m_postMortem.AddNote("power: the priority could not be changed");
+        }
+        if ((policy.set_cpus || !m_config.cpus.empty())
+            && !WTSetProcessAffinity(m_pid, m_spawnOptions.cpus)) {
+            m_postMortem.AddNote("power: the affinity could not be changed");
+        }
+    }
+}
+
+/// Check the power supply: the policy is applied when the source changes,
+/// and while on battery the scheduler is paused below the configured
+/// capacity, until the system is on external power again or the capacity
+/// exceeds the threshold by POWER_PAUSE_HYSTERESIS
+void WTHiddenFrame::OnPowerTimer(wxTimerEvent& WXUNUSED(event)) {
+    WTPowerStatus status;
+    if (!WTReadPowerStatus(m_config.power_root.ToStdString(), status)) {
+        return;
+    }
+    m_metrics.on_battery = status.source == WT_POWER_BATTERY;
+    m_metrics.battery_percent = status.battery_percent;
+    if (status.source != m_powerSource) {
+        if (m_powerSource != WT_POWER_COUNT) {
+            m_metrics.power_transitions++;
+        }
+        m_powerSource = status.source;
+        ApplyPowerPolicy(status.source);
+    }
+
+    long pause_below = m_config.power_policy[WT_POWER_BATTERY].pause_below;
+    bool low = false;
+    if (status.source == WT_POWER_BATTERY && pause_below > 0 && status.battery_percent >= 0) {
+        if (m_autoPause & WT_AUTOPAUSE_BATTERY) {
+            low = status.battery_percent < pause_below + POWER_PAUSE_HYSTERESIS;
+        } else {
+            low = status.battery_percent < pause_below;
+        }
+    }
+    if (low != ((m_autoPause & WT_AUTOPAUSE_BATTERY) != 0)) {
+        m_postMortem.AddNote(low ? "power: battery low, scheduler paused"
+                                 : "power: battery no longer low");
+        SetAutoPause(WT_AUTOPAUSE_BATTERY, low);
+    }
+}
+
+/// Check the activity of the user, pausing the scheduler while the user is
+/// active or a fullscreen application runs: while the user is active the
+/// next check is scheduled for when the idle time could reach the threshold
+/// at the earliest, thus the display is rarely queried, while a user who is
+/// away is checked often so that the scheduler is paused as soon as they
+/// come back
+void WTHiddenFrame::OnIdleTimer(wxTimerEvent& WXUNUSED(event)) {
+    unsigned long idle_ms;
+    long threshold = m_config.idle_resume * 1000;
+    if (!m_idle.IdleMillis(idle_ms)) {
+        m_idleTimer.StartOnce(threshold);
+        return;
+    }
+    bool fullscreen = m_config.idle_fullscreen && m_idle.Fullscreen();
+    bool away = (long)idle_ms >= threshold && !fullscreen;
+    m_metrics.user_away = away;
+    if (away == ((m_autoPause & WT_AUTOPAUSE_USER) != 0)) {
+        m_postMortem.AddNote(away ? "idle: user away" : fullscreen
+                             ? "idle: fullscreen application" : "idle: user active");
+        SetAutoPause(WT_AUTOPAUSE_USER, !away);
+    }
+
+    long next;
+    if (away) {
+        next = IDLE_POLL_AWAY;
+    } else if ((long)idle_ms < threshold) {
+        next = threshold - (long)idle_ms;
+    } else {
+        next = IDLE_POLL_FULLSCREEN;
+    }
+    m_idleTimer.StartOnce(next < IDLE_POLL_MIN ? IDLE_POLL_MIN : next);
+}
+
+/// Receive the expiration of the quiet hours timer from its thread
+void WTHiddenFrame::OnDeadline(bool clock_changed) {
+    wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_QUIET_EVENT);
+    event->SetInt(clock_changed ? 1 : 0);
+    wxQueueEvent(this, event);
+}
+
+/// The state of the quiet hours may have changed, or the clock has been
+/// set: in both cases the state and the next deadline are computed anew
+void WTHiddenFrame::OnQuietEvent(wxThreadEvent& event) {
+    if (event.GetInt()) {
+        m_postMortem.AddNote("quiet: the clock has changed");
+    }
+    UpdateQuietHours();
+}
+
+/// Pause or resume the scheduler according to the quiet hours, through the
+/// same path as the other automatic pauses, and arm the timer for the next
+/// instant at which the state may change
+void WTHiddenFrame::UpdateQuietHours() {
+    time_t next;
+    bool quiet = m_config.quiet_hours.Quiet(time(NULL), next);
+    if (quiet != ((m_autoPause & WT_AUTOPAUSE_QUIET) != 0)) {
+        m_postMortem.AddNote(quiet ? "quiet: quiet hours begin" : "quiet: quiet hours end");
+        SetAutoPause(WT_AUTOPAUSE_QUIET, quiet);
+    }
+    m_metrics.quiet = quiet;
+    m_quietTimer.Arm(next);
+}
+
+/// Receive the beginning or the end of a log flood from the watcher thread
+void WTHiddenFrame::OnLogFlood(bool flooding, double rate) {
+    wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_LOGFLOOD_EVENT);
+    event->SetInt(flooding ? 1 : 0);
+    event->SetPayload(rate);
+    wxQueueEvent(this, event);
+}
+
+/// Replace the log level passed to the scheduler: it takes effect at the
+/// next start of the scheduler
+void WTHiddenFrame::SetLogLevel(const wxString& level) {
+    for (size_t i = 0; i + 1 < m_spawnOptions.argv.size(); i++) {
+        if (m_spawnOptions.argv[i] == "-L") {
+            m_spawnOptions.argv[i + 1] = level.ToStdString();
+            break;
+        }
+    }
+}
+
+/// React to a log flood: an alert is raised and, if a quieter level is
+/// configured, the scheduler is restarted at that level for the cool-down
+/// period; every decision is noted in the post-mortem output
+void WTHiddenFrame::OnLogFloodEvent(wxThreadEvent& event) {
+    double rate = event.GetPayload<double>();
+    char note[128];
+    m_logFlooding = event.GetInt() != 0;
+    if (!m_logFlooding) {
+        snprintf(note, sizeof(note), "log: growth back to %.0f KB/s", rate / 1024.0);
+        m_postMortem.AddNote(note);
+        return;
+    }
+
+    m_metrics.log_floods++;
+    snprintf(note, sizeof(note), "log: growing at %.0f KB/s, above %ld KB/s",
+             rate / 1024.0, m_config.logflood_rate);
+    m_postMortem.AddNote(note);
+#if wxUSE_TASKBARICON_BALLOONS
+    m_taskBarIcon->ShowBalloon(APP_DISPLAY_NAME, wxString::Format(
+        "The scheduler log is growing at %.0f KB/s", rate / 1024.0), 0, wxICON_WARNING);
+#endif
+
+    if (!m_config.logflood_level.IsEmpty() && !m_metrics.log_level_reduced) {
+        snprintf(note, sizeof(note), "log: restarting the scheduler at level %s for %ld s",
+                 (const char*)m_config.logflood_level.c_str(), m_config.logflood_cooldown);
+        m_postMortem.AddNote(note);
+        m_metrics.log_level_reduced = true;
+        SetLogLevel(m_config.logflood_level);
+        if (IsSchedulerAlive()) {
+            RestartWhenever();
+        }
+        m_logCooldownTimer.StartOnce(m_config.logflood_cooldown * 1000);
+    }
+}
+
+/// At the end of the cool-down the configured log level is restored, unless
+/// the log is still flooding, in which case the cool-down is extended
+void WTHiddenFrame::OnLogCooldownTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (m_logFlooding) {
+        m_postMortem.AddNote("log: still flooding, cool-down extended");
+        m_logCooldownTimer.StartOnce(m_config.logflood_cooldown * 1000);
+        return;
+    }
+    m_postMortem.AddNote("log: cool-down over, restoring the log level");
+    m_metrics.log_level_reduced = false;
+    SetLogLevel(m_config.log_level);
+    if (IsSchedulerAlive()) {
+        RestartWhenever();
+    }
+}
+
+/// Rotate the log: the log is renamed and the scheduler is restarted, so
+/// that it opens a new log; the old instance keeps writing to the renamed
+/// file until it exits, thus no line is lost
+bool WTHiddenFrame::RotateLog() {
+    time_t now = time(NULL);
+    std::string segment = WTLogSegmentName(m_config.log_path.ToStdString(), now);
+    if (!wxRenameFile(m_config.log_path, segment, false)) {
+        m_postMortem.AddNote("log: the log could not be rotated");
+        return false;
+    }
+    m_lastRotation = now;
+    m_metrics.log_rotations++;
+    m_rotatedSegments.push_back(segment);
+    m_taskStats.LogRotated(segment);
+    if (IsSchedulerAlive()) {
+        RestartWhenever();
+    }
+    return true;
+}
+
+/// Queue the segments rotated at the previous check, then rotate the log
+/// if it has grown too large or too old; segments beyond the configured
+/// number are removed once the new ones are complete
+void WTHiddenFrame::OnRotateTimer(wxTimerEvent& WXUNUSED(event)) {
+    // what is left of the rotated log is parsed before the segment can be
+    // compressed or pruned, however large it is; a segment that cannot be
+    // read any further is given up
+    while (!m_rotatedSegments.empty() && m_taskStats.Rotating()) {
+        unsigned long long offset = m_taskStats.Offset();
+        if (!UpdateTaskStats() || m_taskStats.Offset() == offset) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < m_rotatedSegments.size(); i++) {
+        if (m_config.log_compress_level > 0) {
+            m_compressor.Enqueue(m_rotatedSegments[i]);
+        }
+    }
+    if (!m_rotatedSegments.empty() && m_config.log_compress_level == 0) {
+        WTPruneLogSegments(m_config.log_path.ToStdString(), m_config.log_rotate_keep);
+    }
+    m_rotatedSegments.clear();
+
+    wxULongLong size = wxFileName::GetSize(m_config.log_path);
+    if (size == wxInvalidSize || size == 0) {
+        return;
+    }
+    if ((m_config.log_rotate_size > 0
+         && size.GetValue() >= (unsigned long long)m_config.log_rotate_size * 1024 * 1024)
+        || (m_config.log_rotate_age > 0
+            && time(NULL) - m_lastRotation >= m_config.log_rotate_age * 3600)) {
+        RotateLog();
+    }
+}
+
+/// Receive the completion of a compression from the compressor thread
+void WTHiddenFrame::OnSegmentCompressed(const std::string& path, bool ok,
+                                        const WTCompressStats& stats) {
+    wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_COMPRESSED_EVENT);
+    event->SetString(wxString(path));
+    event->SetInt(ok ? 1 : 0);
+    event->SetPayload(stats);
+    wxQueueEvent(this, event);
+}
+
+/// Account for a compressed segment: the oldest segments are removed by the
+/// compressor thread once its queue is empty
+void WTHiddenFrame::OnCompressedEvent(wxThreadEvent& event) {
+    char note[160];
+    if (!event.GetInt()) {
+        snprintf(note, sizeof(note), "log: %s could not be compressed",
+                 (const char*)wxFileName(event.GetString()).GetFullName().c_str());
+        m_postMortem.AddNote(note);
+        return;
+    }
+    WTCompressStats stats = event.GetPayload<WTCompressStats>();
+    m_metrics.log_compressed_in += stats.bytes_in;
+    m_metrics.log_compressed_out += stats.bytes_out;
+    m_metrics.log_compress_seconds += stats.seconds;
+    snprintf(note, sizeof(note), "log: compressed %.1f MB to %.1f MB at %.1f MB/s",
+             stats.bytes_in / 1048576.0, stats.bytes_out / 1048576.0,
+             stats.seconds > 0 ? stats.bytes_in / 1048576.0 / stats.seconds : 0.0);
+    m_postMortem.AddNote(note);
+}
+
+/// Export the metrics to the textfile collector directory
+void WTHiddenFrame::OnMetricsTimer(wxTimerEvent& WXUNUSED(event)) {
+    m_metrics.log_rate = m_logWatcher.Rate();
+    WTForwardStats forward = m_forwarder.Stats();
+    m_metrics.forward_sent = forward.sent;
+    m_metrics.forward_dropped = forward.dropped;
+    m_metrics.forward_failed = forward.failed;
+    m_metricsExporter.Write(m_metrics);
+}
+
+/// Append a sample to the history file: the command latency is averaged
+/// over the commands acknowledged since the previous sample
+void WTHiddenFrame::OnHistoryTimer(wxTimerEvent& WXUNUSED(event)) {
+    double latency_sum = 0;
+    unsigned long long latency_count = 0;
+    for (int i = 0; i < WT_CMD_COUNT; i++) {
+        latency_sum += m_metrics.latency[i].sum_ms;
+        latency_count += m_metrics.latency[i].count;
+    }
+
+    WTHistoryRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.timestamp = wxGetUTCTimeMillis().GetValue();
+    if (IsSchedulerAlive() && m_hasSample) {
+        rec.rss_bytes = m_lastSample.rss_bytes;
+        rec.cpu_permille = (uint32_t)(m_cpuPercent * 10.0);
+    }
+    rec.restarts = m_startCount > 0 ? m_startCount - 1 : 0;
+    if (latency_count > m_historyLatencyCount) {
+        rec.latency_ms = (uint32_t)((latency_sum - m_historyLatencySum)
+                                    / (latency_count - m_historyLatencyCount));
+    }
+    m_historyLatencySum = latency_sum;
+    m_historyLatencyCount = latency_count;
+    m_history.Append(rec);
+}
+
+/// Parse the part of the log written since the last update: the statistics
+/// are saved and shown once the update is complete, and true is returned
+/// if it has been cut short, with more of the log left
+bool WTHiddenFrame::UpdateTaskStats() {
+    if (m_config.task_stats_interval == 0) {
+        return false;
+    }
+    unsigned long long offset = m_taskStats.Offset();
+    bool more = m_taskStats.Update(TASKSTATS_UPDATE_BYTES);
+    if (!more && m_taskStats.Offset() != offset) {
+        m_taskStats.Save(m_taskStatsPath.ToStdString());
+        if (m_statsFrame) {
+            m_statsFrame->ReloadTasks();
+        }
+    }
+    return more;
+}
+
+/// Keep the statistics up to date: while a long log is being caught up
+/// with, the updates follow each other closely, so that the tray stays
+/// responsive and the statistics are complete soon
+void WTHiddenFrame::OnTaskStatsTimer(wxTimerEvent& WXUNUSED(event)) {
+    int interval = UpdateTaskStats()
+        ? TASKSTATS_CATCHUP_INTERVAL : (int)m_config.task_stats_interval * 1000;
+    if (m_taskStatsTimer.GetInterval() != interval) {
+        m_taskStatsTimer.Start(interval);
+    }
+}
+
+/// Show the statistics window, creating it if needed
+bool WTHiddenFrame::ShowStatistics() {
+    UpdateTaskStats();
+    if (m_statsFrame) {
+        m_statsFrame->Reload();
     } else {
+        m_statsFrame = new WTStatsFrame(this, m_historyPath, &m_taskStats);
+    }
+    m_statsFrame->Show();
+    m_statsFrame->Raise();
+    return true;
+}
+
+/// Ask for the time range and the destination of an excerpt of the log,
+/// and save it in the background
+bool WTHiddenFrame::SaveLogExcerpt() {
+    if (m_excerptThread.joinable()) {
+        wxMessageBox("An excerpt of the log is already being saved.",
+                     APP_DISPLAY_NAME, wxOK | wxICON_INFORMATION);
+        return false;
+    }
+    long long from, to;
+    wxString s = wxGetTextFromUser("Start of the excerpt (YYYY-MM-DD HH:MM):", APP_DISPLAY_NAME,
+                                   wxDateTime(time(NULL) - 3600).Format("%Y-%m-%d %H:%M"));
+    if (s.IsEmpty()) {
+        return false;
+    }
+    if (!ParseExcerptTime(s, false, from)) {
+        wxMessageBox("Invalid start time.", APP_DISPLAY_NAME, wxOK | wxICON_EXCLAMATION);
+        return false;
+    }
+    s = wxGetTextFromUser("End of the excerpt (YYYY-MM-DD HH:MM):", APP_DISPLAY_NAME,
+                          wxDateTime(time(NULL)).Format("%Y-%m-%d %H:%M"));
+    if (s.IsEmpty()) {
+        return false;
+    }
+    if (!ParseExcerptTime(s, true, to)) {
+        wxMessageBox("Invalid end time.", APP_DISPLAY_NAME, wxOK | wxICON_EXCLAMATION);
         return false;
     }
+    wxString path = wxFileSelector("Save Log Excerpt", "", "whenever-excerpt.log.gz", "gz",
+                                   "Compressed logs (*.gz)|*.gz|Logs (*.log)|*.log",
+                                   wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (path.IsEmpty()) {
+        return false;
+    }
+
+    std::string log_path = m_config.log_path.ToStdString();
+    std::string out_path = path.ToStdString();
+    bool compress = path.EndsWith(".gz");
+    m_excerptThread = std::thread([this, log_path, out_path, from, to, compress]() {
+        WTExcerptStats stats;
+        bool ok = WTExtractLog(log_path, from, to, out_path, compress, stats);
+        wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_EXCERPT_EVENT);
+        event->SetInt(ok ? 1 : 0);
+        event->SetString(wxString(out_path));
+        event->SetPayload(stats);
+        wxQueueEvent(this, event);
+    });
+    return true;
+}
+
+/// Report the completion of an excerpt
+void WTHiddenFrame::OnExcerptEvent(wxThreadEvent& event) {
+    m_excerptThread.join();
+    if (!event.GetInt()) {
+        wxMessageBox("The excerpt of the log could not be saved to\n" + event.GetString(),
+                     APP_DISPLAY_NAME, wxOK | wxICON_EXCLAMATION);
+        return;
+    }
+    WTExcerptStats stats = event.GetPayload<WTExcerptStats>();
+    char note[160];
+    snprintf(note, sizeof(note), "log: excerpt of %.1f MB from %u segments saved in %.1f s",
+             stats.bytes_out / 1048576.0, stats.segments, stats.seconds);
+    m_postMortem.AddNote(note);
+#if wxUSE_TASKBARICON_BALLOONS
+    m_taskBarIcon->ShowBalloon(APP_DISPLAY_NAME, wxString::Format(
+        "Log excerpt saved to %s", wxFileName(event.GetString()).GetFullName()));
+#endif
+}
+
+/// Receive the notification that the controller has queued events, and
+/// pass it to the GUI thread: one notification covers a whole batch
+void WTHiddenFrame::OnControlEvents() {
+    wxQueueEvent(this, new wxThreadEvent(wxEVT_THREAD, ID_CONTROL_EVENT));
+}
+
+/// Take the events queued by the controller, and pass each of them to the
+/// handle of its instance: events of instances that have been discarded
+/// in the meantime are dropped
+void WTHiddenFrame::OnControlEvent(wxThreadEvent& WXUNUSED(event)) {
+#ifdef WT_NATIVE_PROCESS
+    std::vector<WTControlEvent> events;
+    m_controller.TakeEvents(events);
+    for (size_t i = 0; i < events.size(); i++) {
+        WTPipedProcess* process = NULL;
+        if (m_process && m_process->Child() == events[i].child) {
+            process = m_process;
+        } else if (m_standby && m_standby->Child() == events[i].child) {
+            process = m_standby;
+        }
+        if (process) {
+            process->HandleEvent(events[i]);
+        }
+    }
+    CheckHandover();
+#endif
+}
+
+/// Keep the version of the scheduler retrieved in the background
+void WTHiddenFrame::OnVersionEvent(wxThreadEvent& event) {
+    m_versionThread.join();
+    if (!event.GetString().IsEmpty()) {
+        m_cmdVersion = event.GetString();
+    }
+    char note[96];
+    snprintf(note, sizeof(note), "init: version %s in %ld ms",
+             event.GetString().IsEmpty() ? "not available" : "retrieved", event.GetExtraLong());
+    m_postMortem.AddNote(note);
 }
 
 /// Interface to resume the scheduler: uses the communication channel (stdin)
 bool WTHiddenFrame::ShowWheneverLog() {
-    if (m_pid && m_process->Exists(m_pid)) {
-        if (wxExecute(m_cmdLineLogView, wxEXEC_ASYNC) < 0) {
+    if (SchedulerExists()) {
+        std::vector<const char*> argv;
+        for (size_t i = 0; i < m_logViewArgv.size(); i++) {
+            argv.push_back(m_logViewArgv[i].c_str());
+        }
+        argv.push_back(NULL);
+        if (wxExecute(&argv[0], wxEXEC_ASYNC) <= 0) {
             return false;
         } else {
             return true;
@@ -454,10 +2505,16 @@ bool WTHiddenFrame::ShowWheneverLog() {
 // ----------------------------------------------------------------------------
 
 enum {
-    PU_PAUSE = 10001,
+    PU_STATUS_UPTIME = 10001,
+    PU_STATUS_LASTTASK,
+    PU_STATUS_RESTARTS,
+    PU_STATUS_RESOURCES,
+    PU_PAUSE,
     PU_RESUME,
     PU_RESET_CONDITIONS,
     PU_SHOW_LOG,
+    PU_SAVE_EXCERPT,
+    PU_SHOW_STATS,
     PU_ABOUT,
     PU_EXIT,
 };
@@ -467,18 +2524,20 @@ wxBEGIN_EVENT_TABLE(WheneverTrayIcon, wxTaskBarIcon)
     EVT_MENU(PU_RESUME, WheneverTrayIcon::OnMenuResume)
     EVT_MENU(PU_RESET_CONDITIONS, WheneverTrayIcon::OnMenuResetConditions)
     EVT_MENU(PU_SHOW_LOG, WheneverTrayIcon::OnMenuShowLog)
+    EVT_MENU(PU_SAVE_EXCERPT, WheneverTrayIcon::OnMenuSaveExcerpt)
+    EVT_MENU(PU_SHOW_STATS, WheneverTrayIcon::OnMenuShowStats)
     EVT_MENU(PU_EXIT, WheneverTrayIcon::OnMenuExit)
     EVT_MENU(PU_ABOUT, WheneverTrayIcon::OnMenuAbout)
 wxEND_EVENT_TABLE()
 
 /// Handle Menu: (Tray) -> &Pause
 void WheneverTrayIcon::OnMenuPause(wxCommandEvent&) {
-    hidden_frame->PauseWhenever();
+    hidden_frame->PauseWhenever("user");
 }
 
 /// Handle Menu: (Tray) -> Res&ume
 void WheneverTrayIcon::OnMenuResume(wxCommandEvent&) {
-    hidden_frame->ResumeWhenever();
+    hidden_frame->ResumeWhenever("user");
 }
 
 /// Handle Menu: (Tray) -> Reset &Conditions
@@ -491,9 +2550,18 @@ void WheneverTrayIcon::OnMenuShowLog(wxCommandEvent&) {
     hidden_frame->ShowWheneverLog();
 }
 
+/// Handle Menu: (Tray) -> Sa&ve Log Excerpt
+void WheneverTrayIcon::OnMenuSaveExcerpt(wxCommandEvent&) {
+    hidden_frame->SaveLogExcerpt();
+}
+
+/// Handle Menu: (Tray) -> Show &Statistics
+void WheneverTrayIcon::OnMenuShowStats(wxCommandEvent&) {
+    hidden_frame->ShowStatistics();
+}
+
 /// Handle Menu: (Tray) -> E&xit
 void WheneverTrayIcon::OnMenuExit(wxCommandEvent&) {
-    hidden_frame->StopWheneverCommand();
     hidden_frame->Close(true);
 }
 
@@ -519,25 +2587,73 @@ void WheneverTrayIcon::OnMenuAbout(wxCommandEvent&) {
     wxAboutBox(aboutInfo);
 }
 
-/// Create the main popup menu that activates by right-clicking tray icon
-wxMenu* WheneverTrayIcon::CreatePopupMenu() {
-    wxMenu* menu = new wxMenu;
-    menu->Append(PU_PAUSE, "&Pause Scheduler");
-    menu->Append(PU_RESUME, "Res&ume Scheduler");
-    menu->Append(PU_RESET_CONDITIONS, "Reset &Conditions");
-    menu->Append(PU_SHOW_LOG, "Show &Log...");
-    menu->AppendSeparator();
-    menu->Append(PU_ABOUT, "&About...");
+/// Build the main popup menu that activates by right-clicking tray icon:
+/// the menu is built only once, and then kept up to date in place
+void WheneverTrayIcon::BuildMenu() {
+    m_menu = new wxMenu;
+    for (int i = 0; i < WT_STATUS_COUNT; i++) {
+        m_menu->Append(PU_STATUS_UPTIME + i, m_status[i].IsEmpty() ? wxString("-") : m_status[i]);
+        m_menu->Enable(PU_STATUS_UPTIME + i, false);
+    }
+    m_menu->AppendSeparator();
+    m_menu->AppendCheckItem(PU_PAUSE, "&Pause Scheduler");
+    m_menu->AppendCheckItem(PU_RESUME, "Res&ume Scheduler");
+    m_menu->Append(PU_RESET_CONDITIONS, "Reset &Conditions");
+    m_menu->Append(PU_SHOW_LOG, "Show &Log...");
+    m_menu->Append(PU_SAVE_EXCERPT, "Sa&ve Log Excerpt...");
+    m_menu->Append(PU_SHOW_STATS, "Show &Statistics...");
+    m_menu->AppendSeparator();
+    m_menu->Append(PU_ABOUT, "&About...");
     /* OSX has built-in quit menu for the dock menu, but not for the status item */
 #ifdef __WXOSX__
     if (OSXIsStatusItem())
 #endif
     {
-        menu->AppendSeparator();
-        menu->Append(PU_EXIT, "E&xit");
+        m_menu->AppendSeparator();
+        m_menu->Append(PU_EXIT, "E&xit");
+    }
+    UpdateMenu();
+}
+
+/// Reflect the state of the scheduler in the menu entries
+void WheneverTrayIcon::UpdateMenu() {
+    if (!m_menu) {
+        return;
+    }
+    WTSchedulerState state = hidden_frame->GetSchedulerState();
+    bool alive = hidden_frame->IsSchedulerAlive();
+
+    m_menu->Check(PU_PAUSE, state == WT_STATE_PAUSED || state == WT_STATE_PAUSING);
+    m_menu->Check(PU_RESUME, state == WT_STATE_RUNNING || state == WT_STATE_RESUMING);
+    m_menu->Enable(PU_PAUSE, state == WT_STATE_RUNNING || hidden_frame->IsAutoPausedOnly());
+    m_menu->Enable(PU_RESUME, state == WT_STATE_PAUSED);
+    m_menu->Enable(PU_RESET_CONDITIONS, alive);
+    m_menu->Enable(PU_SHOW_LOG, alive);
+}
+
+/// Change the text of a status line, only touching the menu if it differs
+void WheneverTrayIcon::SetStatusLine(WTStatusLine line, const wxString& text) {
+    if (m_status[line] == text) {
+        return;
+    }
+    m_status[line] = text;
+    if (m_menu) {
+        m_menu->SetLabel(PU_STATUS_UPTIME + line, text);
+    }
+}
+
+/// Return the cached menu: unlike CreatePopupMenu, the returned menu is not
+/// deleted by wxTaskBarIcon after being shown
+wxMenu* WheneverTrayIcon::GetPopupMenu() {
+    if (!m_menu) {
+        BuildMenu();
     }
-    return menu;
+    return m_menu;
 }
 
+/// Destructor: the cached menu is owned by the icon
+WheneverTrayIcon::~WheneverTrayIcon() {
+    delete m_menu;
+}
 
 // end.
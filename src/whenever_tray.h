@@ -7,10 +7,174 @@
 ///
 /// Based on the *wxTaskBarIcon demo* by Julian Smart for wxWidgets.
 
-// Define a new application
+#include "wt_output.h"
+#include "wt_sysinfo.h"
+#include "wt_metrics.h"
+#include "wt_history.h"
+#include "wt_postmortem.h"
+#include "wt_process.h"
+#include "wt_controller.h"
+#include "wt_intent.h"
+#include "wt_pressure.h"
+#include "wt_power.h"
+#include "wt_startup.h"
+#include "wt_idle.h"
+#include "wt_quiet.h"
+#include "wt_logwatch.h"
+#include "wt_logrotate.h"
+#include "wt_forward.h"
+#include "wt_excerpt.h"
+#include "wt_taskstats.h"
+#include "wt_trace.h"
+
+// State of the scheduler as tracked by the tray: the transitional states
+// are used while a command is waiting to be acknowledged by the scheduler,
+// and the waiting state before the first start, while the system settles
+enum WTSchedulerState {
+    WT_STATE_STOPPED = 0,
+    WT_STATE_STARTING,
+    WT_STATE_RUNNING,
+    WT_STATE_PAUSING,
+    WT_STATE_PAUSED,
+    WT_STATE_RESUMING,
+    WT_STATE_STOPPING,
+    WT_STATE_WAITING,
+};
+
+// Policy applied to the scheduler while running on a power source: each
+// setting is only applied if present in the configuration
+struct WTPowerPolicy {
+    bool enabled;
+    bool set_priority;
+    unsigned int priority;
+    bool set_cpus;
+    std::vector<int> cpus;
+    long pause_below;           // battery percentage, 0 to never pause
+};
+
+// Reasons for which the tray pauses the scheduler by itself: the scheduler
+// is resumed when none of them holds, unless the user has paused it
+enum WTAutoPause {
+    WT_AUTOPAUSE_PRESSURE = 0x01,
+    WT_AUTOPAUSE_BATTERY = 0x02,
+    WT_AUTOPAUSE_USER = 0x04,
+    WT_AUTOPAUSE_QUIET = 0x08,
+};
+
+// Configuration of the tray, read from the TOML configuration file
+struct WTConfig {
+    wxString command_path;
+    wxString config_path;
+    wxString log_path;
+    wxString log_level;
+    wxString logview_command_path;
+    unsigned int priority;
+    std::vector<int> cpus;              // CPU affinity, empty for any CPU
+    std::vector<std::string> env;       // extra "NAME=value" variables
+
+    // metrics export: disabled when no directory is given
+    wxString metrics_dir;
+    long metrics_interval;      // seconds
+
+    // history sampling: disabled when the interval is zero
+    long history_interval;      // seconds
+
+    // post-mortem reports on abnormal scheduler exit
+    wxString postmortem_dir;
+    long postmortem_buffer_kb;
+
+    // hang watchdog: disabled when the check interval is zero
+    long watchdog_interval;     // seconds
+    long watchdog_timeout;      // seconds
+
+    // restart by handing over to a new scheduler started in advance
+    bool restart_handover;
+
+    // option that starts the scheduler paused (the pause command is sent
+    // at startup if empty), and expiry of the pauses requested by the user
+    wxString pause_flag;
+    long pause_expiry;          // minutes
+
+    // throttling under system pressure: thresholds are percentages of
+    // stalled time, and zero disables the resource
+    long pressure_threshold[WT_PRESSURE_COUNT];
+    long pressure_window;       // seconds
+    long pressure_release;      // seconds
+    bool pressure_pause;        // pause, rather than lower the priority
+
+    // policies by power source: disabled unless a policy is given
+    WTPowerPolicy power_policy[WT_POWER_COUNT];
+    wxString power_root;
+    long power_interval;        // seconds
+
+    // startup gate: delays and thresholds, 0 to ignore a threshold
+    long startup_delay;         // seconds
+    long startup_max_delay;     // seconds
+    double startup_load;        // load average per CPU
+    long startup_pressure;      // percent
+    long startup_disk;          // percent
+
+    // activity of the user: the scheduler only runs after this idle time
+    long idle_resume;           // seconds, 0 to disable
+    bool idle_fullscreen;       // a fullscreen application is activity
+
+    // recurring windows of local time in which the scheduler is paused,
+    // and number of malformed windows that have been left out
+    WTQuietSchedule quiet_hours;
+    long quiet_hours_skipped;
+
+    // log flood guard: growth rate, and level used during the cool-down
+    long logflood_rate;         // KB/s, 0 to disable
+    wxString logflood_level;    // empty to only raise an alert
+    long logflood_cooldown;     // seconds
+
+    // rotation of the log by size or age, 0 to disable either, and
+    // compression of the rotated segments, 0 to leave them uncompressed
+    long log_rotate_size;       // MB
+    long log_rotate_age;        // hours
+    long log_rotate_keep;       // segments
+    long log_compress_level;    // 1 to 9
+
+    // forwarding of the output to syslog or to the journal: disabled when
+    // no format is given, the socket defaults to the one of the format
+    wxString forward_format;
+    wxString forward_socket;
+    wxString forward_ident;
+
+    // statistics about tasks and conditions, parsed from the log: disabled
+    // when the interval is zero
+    long task_stats_interval;   // seconds
+
+    // trace of the input and output of the scheduler: disabled when no
+    // file is given, and stopped when it reaches its size, 0 for no limit
+    wxString trace_file;
+    long trace_max_mb;          // MB
+};
+
+// Non-clickable status lines shown at the top of the tray menu
+enum WTStatusLine {
+    WT_STATUS_UPTIME = 0,
+    WT_STATUS_LASTTASK,
+    WT_STATUS_RESTARTS,
+    WT_STATUS_RESOURCES,
+    WT_STATUS_COUNT,
+};
+
+// Define a new application: when an excerpt of the log is requested on
+// the command line, it is saved and the application leaves at once
 class WTApp : public wxApp {
 public:
+    WTApp() : m_excerpt(false) { }
     virtual bool OnInit() wxOVERRIDE;
+    virtual int OnRun() wxOVERRIDE;
+    virtual void OnInitCmdLine(wxCmdLineParser& parser) wxOVERRIDE;
+    virtual bool OnCmdLineParsed(wxCmdLineParser& parser) wxOVERRIDE;
+
+private:
+    bool m_excerpt;
+    long long m_excerptFrom;
+    long long m_excerptTo;
+    wxString m_excerptOutput;
 };
 
 // Define the taskbar icon interface
@@ -22,24 +186,51 @@ public:
 #else
     WheneverTrayIcon()
 #endif
-    { }
+    {
+        m_menu = NULL;
+    }
+    ~WheneverTrayIcon();
+
+    // in-place update of the menu, which is built only once
+    void UpdateMenu();
+    void SetStatusLine(WTStatusLine line, const wxString& text);
 
     void OnMenuExit(wxCommandEvent&);
     void OnMenuPause(wxCommandEvent&);
     void OnMenuResume(wxCommandEvent&);
     void OnMenuResetConditions(wxCommandEvent&);
     void OnMenuShowLog(wxCommandEvent&);
+    void OnMenuShowStats(wxCommandEvent&);
+    void OnMenuSaveExcerpt(wxCommandEvent&);
     void OnMenuAbout(wxCommandEvent&);
-    virtual wxMenu* CreatePopupMenu() wxOVERRIDE;
+    virtual wxMenu* GetPopupMenu() wxOVERRIDE;
+
+private:
+    void BuildMenu();
+
+    wxMenu* m_menu;
+    wxString m_status[WT_STATUS_COUNT];
 
     wxDECLARE_EVENT_TABLE();
 };
 
-// forward declaration
+// forward declarations
 class WTPipedProcess;
+class WTStatsFrame;
+
+// Receives the output of a scheduler on standby during a handover, looking
+// for the acknowledgement of the pause command sent to it at startup
+class WTStandbySink : public WTLineSink {
+public:
+    WTStandbySink() : paused(false) { }
+    virtual void OnLine(WTOutputStream stream, const char* line, size_t len) wxOVERRIDE;
+    bool paused;
+};
 
 // Define a new frame type: this is going to be our main frame
-class WTHiddenFrame : public wxFrame {
+class WTHiddenFrame : public wxFrame, public WTLineSink, public WTPressureListener,
+                      public WTDeadlineListener, public WTLogRateListener,
+                      public WTCompressListener, public WTControlListener {
 public:
     // ctor(s)
     WTHiddenFrame(const wxString& title);
@@ -48,53 +239,301 @@ public:
     // interface to the underlying *whenever* process
     bool StartWheneverCommand(unsigned int priority);
     bool StopWheneverCommand();
-    bool PauseWhenever();
-    bool ResumeWhenever();
+    bool RestartWhenever();
+    bool PauseWhenever(const char* reason = NULL);
+    bool ResumeWhenever(const char* reason = NULL);
     bool ResetConditions();
     bool ShowWheneverLog();
+    bool ShowStatistics();
+    bool SaveLogExcerpt();
     wxString GetWheneverVersion() {
         return m_cmdVersion.Clone();
     }
 
+    // state model, updated by acknowledgements and process lifecycle
+    WTSchedulerState GetSchedulerState() {
+        return m_state;
+    }
+    bool IsSchedulerAlive() {
+        return m_state != WT_STATE_STOPPED && m_state != WT_STATE_STOPPING
+            && m_state != WT_STATE_WAITING;
+    }
+    bool IsAutoPausedOnly() {
+        return m_state == WT_STATE_PAUSED && m_autoPause != 0 && !m_intent.paused;
+    }
+    virtual void OnLine(WTOutputStream stream, const char* line, size_t len) wxOVERRIDE;
+    void TraceOutput(WTOutputStream stream, const char* data, size_t len) {
+        if (m_trace.IsOpen()) {
+            m_trace.Record(stream == WT_STREAM_STDERR ? WT_TRACE_STDERR : WT_TRACE_STDOUT,
+                           data, len);
+        }
+    }
+    void OnSchedulerSpawned(WTPipedProcess* process, long pid);
+    void OnSchedulerTerminated(WTPipedProcess* process, int pid, int status);
+#ifdef WT_NATIVE_PROCESS
+    WTProcessController* GetController() {
+        return &m_controller;
+    }
+#endif
+    virtual void OnPressureChange(bool high, WTPressureResource resource, double avg10) wxOVERRIDE;
+    virtual void OnDeadline(bool clock_changed) wxOVERRIDE;
+    virtual void OnLogFlood(bool flooding, double rate) wxOVERRIDE;
+    virtual void OnSegmentCompressed(const std::string& path, bool ok,
+                                     const WTCompressStats& stats) wxOVERRIDE;
+    virtual void OnControlEvents() wxOVERRIDE;
+
 protected:
     // event handlers (these functions should _not_ be virtual)
     void OnExit(wxCommandEvent& event);
     void OnCloseWindow(wxCloseEvent& event);
+    void OnPollTimer(wxTimerEvent& event);
+    void OnStatusTimer(wxTimerEvent& event);
+    void OnMetricsTimer(wxTimerEvent& event);
+    void OnHistoryTimer(wxTimerEvent& event);
+    void OnTaskStatsTimer(wxTimerEvent& event);
+    void OnWatchdogTimer(wxTimerEvent& event);
+    void OnIntentTimer(wxTimerEvent& event);
+    void OnPressureEvent(wxThreadEvent& event);
+    void OnPowerTimer(wxTimerEvent& event);
+    void OnStartupTimer(wxTimerEvent& event);
+    void OnIdleTimer(wxTimerEvent& event);
+    void OnQuietEvent(wxThreadEvent& event);
+    void OnLogFloodEvent(wxThreadEvent& event);
+    void OnLogCooldownTimer(wxTimerEvent& event);
+    void OnRotateTimer(wxTimerEvent& event);
+    void OnCompressedEvent(wxThreadEvent& event);
+    void OnExcerptEvent(wxThreadEvent& event);
+    void OnVersionEvent(wxThreadEvent& event);
+    void OnControlEvent(wxThreadEvent& event);
 
     WheneverTrayIcon* m_taskBarIcon;
 
 private:
+    bool SendCommand(WTCommand cmd);
+    void AcknowledgeCommand(bool acknowledged);
+    void SetSchedulerState(WTSchedulerState state);
+    void UpdateStatusLines();
+    bool SchedulerExists();
+    bool HandoverWhenever(bool paused);
+    void CheckHandover();
+    void HandoverFailed(const char* note);
+    void HandoverAdopt();
+    void StartFailed();
+    void ShutdownScheduler();
+    void SchedulerStarted(WTSchedulerState state);
+    void SetIntent(bool paused, const char* reason);
+    void ArmIntentTimer();
+    void SetAutoPause(unsigned int reason, bool active);
+    void SettleAutoPause();
+    void LaunchScheduler();
+    void UpdateQuietHours();
+    void SetLogLevel(const wxString& level);
+    bool RotateLog();
+    bool UpdateTaskStats();
+    void ApplyPowerPolicy(WTPowerSource source);
+
     WTPipedProcess* m_process;
+    int m_childSerial;
+    WTConfig m_config;
+    WTSchedulerState m_state;
+    WTCommand m_pendingCmd;
+    wxLongLong m_cmdSentAt;
+    wxTimer m_pollTimer;
+
+    // figures shown in the status lines
+    wxTimer m_statusTimer;
+    unsigned int m_startCount;
+    long long m_startedAt;
+    wxLongLong m_lastTaskAt;
+    char m_lastTaskName[64];
+    WTProcessSample m_lastSample;
+    bool m_hasSample;
+    double m_cpuPercent;
+
+    // metrics, exported periodically if configured
+    WTMetrics m_metrics;
+    WTMetricsExporter m_metricsExporter;
+    wxTimer m_metricsTimer;
+
+    // signs of life checked by the watchdog
+    wxTimer m_watchdogTimer;
+    bool m_ackSeen;
+    wxLongLong m_lastActivity;
+    long long m_watchdogCpuMs;
+    wxULongLong m_watchdogLogSize;
+
+    // time the old scheduler left during a handover, while the new one
+    // has not been resumed yet
+    wxLongLong m_handoverAt;
+
+    // scheduler on standby during a handover: it takes the place of the
+    // current one when ready, once the current one has left; the time it
+    // was found alive starts the wait for its acknowledgement
+    WTPipedProcess* m_standby;
+    WTStandbySink m_standbySink;
+    wxLongLong m_standbySentAt;
+    bool m_handoverPaused;
+    bool m_handoverStopping;
+
+    // state to reach once the scheduler being started has settled, and
+    // restart waiting for the current scheduler to leave
+    bool m_startPaused;
+    bool m_restartPending;
+    bool m_restartPaused;
+
+#ifdef WT_NATIVE_PROCESS
+    // thread that owns the scheduler processes and their pipes
+    WTProcessController m_controller;
+#endif
+
+    // intended state, reapplied whenever the scheduler starts, and expiry
+    // of the intended pause, which does not depend on the scheduler
+    WTIntentJournal m_intentJournal;
+    WTIntent m_intent;
+    wxTimer m_intentTimer;
+
+    // pauses decided by the tray, as a mask of WTAutoPause values, and
+    // whether the mask changed while the scheduler could not follow it
+    unsigned int m_autoPause;
+    bool m_autoPauseStale;
+
+    // throttling under system pressure
+    WTPressureMonitor m_pressure;
+    bool m_throttled;
+
+    // policy for the current power source, and current priority
+    wxTimer m_powerTimer;
+    WTPowerSource m_powerSource;
+    unsigned int m_priority;
+
+    // gate that delays the first start, and the icons shown meanwhile
+    WTStartupGate m_startupGate;
+    wxTimer m_startupTimer;
+    wxIcon m_trayIcon;
+    wxIcon m_waitingIcon;
+
+    // activity of the user, checked at adaptive intervals
+    WTIdleMonitor m_idle;
+    wxTimer m_idleTimer;
+
+    // single timer waiting for the next change of the quiet hours
+    WTWallClockTimer m_quietTimer;
+
+    // log flood guard, and cool-down at a quieter log level
+    WTLogWatcher m_logWatcher;
+    wxTimer m_logCooldownTimer;
+    bool m_logFlooding;
+
+    // rotation of the log, and compression of the segments: a segment is
+    // queued at the check following its rotation, when the scheduler that
+    // wrote it has surely exited
+    wxTimer m_rotateTimer;
+    time_t m_lastRotation;
+    std::vector<std::string> m_rotatedSegments;
+    WTLogCompressor m_compressor;
+
+    // forwarding of the output lines to syslog or to the journal
+    WTLogForwarder m_forwarder;
+
+    // trace of the session, for replaying it offline
+    WTTraceWriter m_trace;
+
+    // excerpt of the log being saved in the background
+    std::thread m_excerptThread;
+
+    // last output and figures, for the post-mortem reports
+    WTPostMortem m_postMortem;
+
+    // persistent history of samples, and the window that shows it
+    WTHistoryFile m_history;
+    wxString m_historyPath;
+    wxTimer m_historyTimer;
+    double m_historyLatencySum;
+    unsigned long long m_historyLatencyCount;
+    wxWeakRef<WTStatsFrame> m_statsFrame;
+
+    // statistics about tasks and conditions, and the file that keeps them
+    WTTaskStats m_taskStats;
+    wxString m_taskStatsPath;
+    wxTimer m_taskStatsTimer;
 
     long m_pid;
-    wxString m_cmdLine;
-    wxString m_cmdLineLogView;
+    WTSpawnOptions m_spawnOptions;
+    std::vector<std::string> m_logViewArgv;
     wxString m_cmdVersion;
+    std::thread m_versionThread;
 
     // any class wishing to process wxWidgets events must use this macro
     wxDECLARE_EVENT_TABLE();
 };
 
-// This is the handler for process termination events, specialized for
-// output redirection and capture
+// Handle of a scheduler instance, notifying the frame of its lifecycle:
+// where available, the process is owned by the controller thread, and the
+// handle only queues requests and receives the events of its instance,
+// otherwise wxExecute is used, with timers for the settle time and for the
+// grace period before killing
 class WTPipedProcess : public wxProcess {
 public:
-    WTPipedProcess(WTHiddenFrame* parent) : wxProcess(parent) {
-        m_parent = parent;
-        Redirect();
-        m_bAlive = true;
+    WTPipedProcess(WTHiddenFrame* parent, int child);
+    // spawn the process: the frame is notified once the process has been
+    // running for the settle time, or as soon as it has failed
+    bool Launch(const WTSpawnOptions& options, long settle_ms);
+    int Child() const {
+        return m_child;
+    }
+    long Pid() const {
+        return m_pid;
     }
     bool Alive() {
         return m_bAlive;
     }
+    // check whether the process is still running, even before its
+    // termination has been notified where it is polled
+    bool Running();
+    bool WriteCommand(const char* text, size_t len);
+    // kill the process group after the grace period, unless the process
+    // has left in the meantime
+    bool KillGroup(long grace_ms = 0);
+    // detach from the frame: the object is deleted, or deletes itself on
+    // termination, and the frame is not notified anymore
+    void Orphan();
+    // while on standby the output is passed to the given sink and is not
+    // traced, until the frame adopts the process
+    void SetStandby(WTLineSink* sink) {
+        m_parent = NULL;
+        m_outSplitter.SetSink(sink);
+        m_errSplitter.SetSink(sink);
+    }
+    void Adopt(WTHiddenFrame* parent) {
+        m_parent = parent;
+        m_outSplitter.SetSink(parent);
+        m_errSplitter.SetSink(parent);
+    }
+#ifdef WT_NATIVE_PROCESS
+    void HandleEvent(WTControlEvent& event);
+#else
+    void DrainOutput();
+#endif
 
     virtual void OnTerminate(int pid, int status) wxOVERRIDE;
 
 protected:
+    WTHiddenFrame* m_frame;
     WTHiddenFrame* m_parent;
-    wxString m_cmd;
+    int m_child;
+    long m_pid;
     bool m_bAlive;
-};
+    bool m_settled;
+    WTLineSplitter m_outSplitter;
+    WTLineSplitter m_errSplitter;
+#ifdef WT_NATIVE_PROCESS
+    WTProcessController* m_controller;
+#else
+    void OnTimer(wxTimerEvent& event);
 
+    wxTimer m_timer;
+    bool m_killPending;
+#endif
+};
 
 // end.
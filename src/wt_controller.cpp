@@ -0,0 +1,591 @@
+/// whenever_tray
+///
+/// Controller thread of the scheduler processes.
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+
+#include "wt_controller.h"
+
+#ifdef WT_NATIVE_PROCESS
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+// key of the wake-up pipe, while the keys of the output pipes are made of
+// the identifier of the child and the index of the stream, and the key of
+// the exit descriptor of a child uses a further index
+#define CONTROL_WAKE_KEY (~0ULL)
+#define CONTROL_KEY(child, index) (((unsigned long long)(unsigned int)(child) << 8) | (index))
+#define CONTROL_EXIT_INDEX 3
+
+// interval between checks of the children while stopping
+#define CONTROL_SHUTDOWN_POLL 20    // milliseconds
+
+static long long control_now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the wake-up pipe and the exit descriptors are also waited for while the
+// reads are held
+static bool control_always_watched(unsigned long long key) {
+    return key == CONTROL_WAKE_KEY || (key & 0xff) == CONTROL_EXIT_INDEX;
+}
+
+// A child owned by the controller thread
+struct WTProcessController::Child {
+    Child(int child) : id(child), settled(false), settle_at(0), kill_at(0), released(false) { }
+
+    int id;
+    WTChildProcess process;
+    bool settled;
+    long long settle_at;
+    long long kill_at;          // 0 if no kill is due
+    bool released;
+};
+
+
+// ============================================================================
+// WTProcessController: implementation
+// ============================================================================
+
+WTProcessController::WTProcessController()
+    : m_listener(NULL), m_pendingBytes(0), m_held(false), m_reading(true) {
+    m_wake[0] = m_wake[1] = -1;
+#if defined(__linux__)
+    m_epoll = -1;
+#endif
+}
+
+WTProcessController::~WTProcessController() {
+    Stop();
+}
+
+/// Create the wake-up pipe and start the thread
+bool WTProcessController::Start(WTControlListener* listener) {
+    if (m_thread.joinable()) {
+        return true;
+    }
+    if (pipe(m_wake) != 0) {
+        m_wake[0] = m_wake[1] = -1;
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(m_wake[i], F_SETFD, FD_CLOEXEC);
+        fcntl(m_wake[i], F_SETFL, fcntl(m_wake[i], F_GETFL) | O_NONBLOCK);
+    }
+#if defined(__linux__)
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0) {
+        close(m_wake[0]);
+        close(m_wake[1]);
+        m_wake[0] = m_wake[1] = -1;
+        return false;
+    }
+#endif
+    m_listener = listener;
+    m_reading = true;
+    m_held = false;
+    m_pendingBytes = 0;
+    Watch(m_wake[0], CONTROL_WAKE_KEY);
+    m_thread = std::thread(&WTProcessController::Run, this);
+    return true;
+}
+
+/// Stop the thread, waiting for the children to leave within the grace
+/// period: this is the only request the caller waits for
+void WTProcessController::Stop(long grace_ms) {
+    if (m_thread.joinable()) {
+        Request request;
+        request.kind = REQUEST_STOP;
+        request.child = 0;
+        request.ms = grace_ms;
+        Queue(request);
+        m_thread.join();
+    }
+    if (m_wake[0] >= 0) {
+        Unwatch(m_wake[0]);
+        close(m_wake[0]);
+        close(m_wake[1]);
+        m_wake[0] = m_wake[1] = -1;
+    }
+#if defined(__linux__)
+    if (m_epoll >= 0) {
+        close(m_epoll);
+        m_epoll = -1;
+    }
+#endif
+    m_fds.clear();
+    m_keys.clear();
+    m_events.clear();
+    m_requests.clear();
+}
+
+void WTProcessController::Spawn(int child, const WTSpawnOptions& options, long settle_ms) {
+    Request request;
+    request.kind = REQUEST_SPAWN;
+    request.child = child;
+    request.options = options;
+    request.ms = settle_ms;
+    Queue(request);
+}
+
+void WTProcessController::Write(int child, const std::string& data) {
+    Request request;
+    request.kind = REQUEST_WRITE;
+    request.child = child;
+    request.data = data;
+    request.ms = 0;
+    Queue(request);
+}
+
+void WTProcessController::Kill(int child, long grace_ms) {
+    Request request;
+    request.kind = REQUEST_KILL;
+    request.child = child;
+    request.ms = grace_ms;
+    Queue(request);
+}
+
+void WTProcessController::Release(int child) {
+    Request request;
+    request.kind = REQUEST_RELEASE;
+    request.child = child;
+    request.ms = 0;
+    Queue(request);
+}
+
+/// Append a request and wake the thread up
+void WTProcessController::Queue(Request& request) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(request);
+    }
+    char c = 0;
+    if (m_wake[1] >= 0 && write(m_wake[1], &c, 1) < 0) {
+        // the pipe is full, thus the thread is going to wake up anyway
+    }
+}
+
+/// Append an event, notifying the listener if it is the first of a batch
+void WTProcessController::Post(WTControlEvent& event) {
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        notify = m_events.empty();
+        m_pendingBytes += event.data.size();
+        m_events.push_back(WTControlEvent());
+        m_events.back().kind = event.kind;
+        m_events.back().child = event.child;
+        m_events.back().pid = event.pid;
+        m_events.back().status = event.status;
+        m_events.back().stream = event.stream;
+        m_events.back().data.swap(event.data);
+    }
+    if (notify && m_listener) {
+        m_listener->OnControlEvents();
+    }
+}
+
+/// Hand over the queued events: if the reads were held, the thread is
+/// woken up to resume them
+void WTProcessController::TakeEvents(std::vector<WTControlEvent>& events) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        events.clear();
+        events.swap(m_events);
+        m_pendingBytes = 0;
+        wake = m_held;
+    }
+    char c = 0;
+    if (wake && m_wake[1] >= 0 && write(m_wake[1], &c, 1) < 0) {
+        // as above
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// the controller thread
+// ----------------------------------------------------------------------------
+
+/// The loop: wait for output, requests or the next deadline, then carry
+/// out the requests and check the children
+void WTProcessController::Run() {
+    std::vector<unsigned long long> ready;
+    long long next_reap = 0;
+    for (;;) {
+        // the nearest deadline, and a periodic check while there are children
+        // whose exit cannot be waited for
+        long long now = control_now();
+        long timeout = -1;
+        for (size_t i = 0; i < m_children.size(); i++) {
+            Child* c = m_children[i];
+            long long deadlines[2] = { c->settled ? 0 : c->settle_at, c->kill_at };
+            for (int j = 0; j < 2; j++) {
+                if (deadlines[j]) {
+                    long left = deadlines[j] > now ? (long)(deadlines[j] - now) : 0;
+                    timeout = timeout < 0 || left < timeout ? left : timeout;
+                }
+            }
+            if (c->process.ExitFd() < 0
+                && (timeout < 0 || timeout > WT_CONTROL_REAP_INTERVAL)) {
+                timeout = WT_CONTROL_REAP_INTERVAL;
+            }
+        }
+
+        Wait(timeout, ready);
+        bool closed = false;
+        for (size_t i = 0; i < ready.size(); i++) {
+            if (ready[i] == CONTROL_WAKE_KEY) {
+                char buf[64];
+                while (read(m_wake[0], buf, sizeof(buf)) > 0) { }
+                continue;
+            }
+            Child* c = Find((int)(unsigned int)(ready[i] >> 8));
+            int index = (int)(ready[i] & 0xff);
+            if (c && (index == CONTROL_EXIT_INDEX || !ReadOutput(c, index, false))) {
+                closed = true;
+            }
+        }
+
+        std::deque<Request> requests;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            requests.swap(m_requests);
+        }
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (requests[i].kind == REQUEST_STOP) {
+                Shutdown(requests[i].ms);
+                return;
+            }
+            Handle(requests[i]);
+        }
+
+        // children are reaped when they exit or their output ends, and
+        // periodically where their exit cannot be waited for, in case they
+        // leave children behind that keep the pipes open
+        now = control_now();
+        bool reap = closed || now >= next_reap;
+        if (reap) {
+            next_reap = now + WT_CONTROL_REAP_INTERVAL;
+        }
+        for (size_t i = m_children.size(); i-- > 0;) {
+            CheckChild(m_children[i], now, reap);
+        }
+
+        bool hold;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            hold = m_pendingBytes >= WT_CONTROL_OUTPUT_MAX;
+            m_held = hold;
+        }
+        if (hold == m_reading) {
+            HoldReads(hold);
+        }
+    }
+}
+
+/// Carry out a request
+void WTProcessController::Handle(Request& request) {
+    Child* c = Find(request.child);
+    switch (request.kind) {
+    case REQUEST_SPAWN:
+        if (!c) {
+            c = new Child(request.child);
+            if (!c->process.Spawn(request.options)) {
+                WTControlEvent event;
+                event.kind = WT_CONTROL_SPAWNED;
+                event.child = request.child;
+                event.pid = 0;
+                event.status = errno;
+                event.stream = WT_STREAM_STDOUT;
+                Post(event);
+                delete c;
+                return;
+            }
+            c->settle_at = control_now() + request.ms;
+            Watch(c->process.OutputFd(WT_STREAM_STDOUT), CONTROL_KEY(c->id, 1));
+            Watch(c->process.OutputFd(WT_STREAM_STDERR), CONTROL_KEY(c->id, 2));
+            Watch(c->process.ExitFd(), CONTROL_KEY(c->id, CONTROL_EXIT_INDEX));
+            m_children.push_back(c);
+        }
+        break;
+    case REQUEST_WRITE:
+        if (c && !c->released && !c->process.Exited()) {
+            c->process.Write(request.data.data(), request.data.size());
+        }
+        break;
+    case REQUEST_KILL:
+        if (c && !c->process.Exited()) {
+            if (request.ms <= 0) {
+                c->process.Signal(SIGKILL, true);
+            } else if (!c->kill_at) {
+                c->kill_at = control_now() + request.ms;
+            }
+        }
+        break;
+    case REQUEST_RELEASE:
+        if (c && !c->released) {
+            c->released = true;
+            c->kill_at = 0;
+            if (!c->process.Exited()) {
+                c->process.Signal(SIGKILL, true);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+WTProcessController::Child* WTProcessController::Find(int id) {
+    for (size_t i = 0; i < m_children.size(); i++) {
+        if (m_children[i]->id == id) {
+            return m_children[i];
+        }
+    }
+    return NULL;
+}
+
+/// Read a chunk of output, or all the output available up to the limit:
+/// false when the pipe has reached its end
+bool WTProcessController::ReadOutput(Child* c, int index, bool all) {
+    WTOutputStream stream = index == 2 ? WT_STREAM_STDERR : WT_STREAM_STDOUT;
+    char buf[WT_CONTROL_READ_CHUNK];
+    size_t total = 0;
+    for (;;) {
+        int fd = c->process.OutputFd(stream);
+        if (fd < 0) {
+            return false;
+        }
+        long n = c->process.Read(stream, buf, sizeof(buf));
+        if (n == 0) {
+            // the descriptor has been closed, which also removes it from
+            // the epoll set
+            Unwatch(fd);
+            return false;
+        }
+        if (n < 0) {
+            return true;
+        }
+        if (!c->released) {
+            WTControlEvent event;
+            event.kind = WT_CONTROL_OUTPUT;
+            event.child = c->id;
+            event.pid = c->process.Pid();
+            event.status = 0;
+            event.stream = stream;
+            event.data.assign(buf, n);
+            Post(event);
+        }
+        total += n;
+        if (!all || total >= WT_CONTROL_OUTPUT_MAX) {
+            return true;
+        }
+    }
+}
+
+/// Check whether a child has exited, settled or has to be killed: a child
+/// that has exited is removed once its remaining output has been posted
+void WTProcessController::CheckChild(Child* c, long long now, bool reap) {
+    int status;
+    bool closed = c->process.OutputFd(WT_STREAM_STDOUT) < 0
+        && c->process.OutputFd(WT_STREAM_STDERR) < 0;
+    if (reap || closed || c->released) {
+        c->process.Reap(status);
+    }
+    if (c->process.Exited()) {
+        if (!c->released) {
+            ReadOutput(c, 1, true);
+            ReadOutput(c, 2, true);
+            WTControlEvent event;
+            event.child = c->id;
+            event.pid = c->process.Pid();
+            event.stream = WT_STREAM_STDOUT;
+            if (!c->settled) {
+                event.kind = WT_CONTROL_SPAWNED;
+                event.pid = 0;
+                event.status = 0;
+                Post(event);
+                event.pid = c->process.Pid();
+            }
+            event.kind = WT_CONTROL_EXITED;
+            event.status = c->process.ExitStatus();
+            Post(event);
+        }
+        Remove(c);
+        return;
+    }
+    if (!c->settled && now >= c->settle_at) {
+        c->settled = true;
+        if (!c->released) {
+            WTControlEvent event;
+            event.kind = WT_CONTROL_SPAWNED;
+            event.child = c->id;
+            event.pid = c->process.Pid();
+            event.status = 0;
+            event.stream = WT_STREAM_STDOUT;
+            Post(event);
+        }
+    }
+    if (c->kill_at && now >= c->kill_at) {
+        c->kill_at = 0;
+        c->process.Signal(SIGKILL, true);
+    }
+}
+
+/// Forget a child: its exit descriptor stays readable once it has exited,
+/// thus it is removed at once
+void WTProcessController::Remove(Child* c) {
+    int fds[3] = {
+        c->process.OutputFd(WT_STREAM_STDOUT),
+        c->process.OutputFd(WT_STREAM_STDERR),
+        c->process.ExitFd(),
+    };
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            Unwatch(fds[i]);
+        }
+    }
+    for (size_t i = 0; i < m_children.size(); i++) {
+        if (m_children[i] == c) {
+            m_children.erase(m_children.begin() + i);
+            break;
+        }
+    }
+    delete c;
+}
+
+/// Children still running are killed when the grace period expires, and
+/// their output is read meanwhile, so that they are not blocked on a full
+/// pipe while leaving
+void WTProcessController::Shutdown(long grace_ms) {
+    long long until = control_now() + grace_ms;
+    for (size_t i = 0; i < m_children.size(); i++) {
+        m_children[i]->released = true;
+    }
+    if (!m_reading) {
+        HoldReads(false);
+    }
+    std::vector<unsigned long long> ready;
+    while (!m_children.empty()) {
+        long long now = control_now();
+        for (size_t i = m_children.size(); i-- > 0;) {
+            Child* c = m_children[i];
+            int status;
+            if (!c->process.Exited() && !c->process.Reap(status) && now >= until) {
+                c->process.Signal(SIGKILL, true);
+                c->process.Reap(status, true);
+            }
+            if (c->process.Exited()) {
+                Remove(c);
+            }
+        }
+        if (!m_children.empty()) {
+            Wait(CONTROL_SHUTDOWN_POLL, ready);
+            for (size_t i = 0; i < ready.size(); i++) {
+                Child* c = control_always_watched(ready[i])
+                    ? NULL : Find((int)(unsigned int)(ready[i] >> 8));
+                if (c) {
+                    ReadOutput(c, (int)(ready[i] & 0xff), false);
+                }
+            }
+        }
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// the set of descriptors waited for
+// ----------------------------------------------------------------------------
+
+void WTProcessController::Watch(int fd, unsigned long long key) {
+    if (fd < 0) {
+        return;
+    }
+    m_fds.push_back(fd);
+    m_keys.push_back(key);
+#if defined(__linux__)
+    if (m_reading || control_always_watched(key)) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = key;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+#endif
+}
+
+void WTProcessController::Unwatch(int fd) {
+    for (size_t i = 0; i < m_fds.size(); i++) {
+        if (m_fds[i] == fd) {
+            m_fds.erase(m_fds.begin() + i);
+            m_keys.erase(m_keys.begin() + i);
+#if defined(__linux__)
+            struct epoll_event ev;
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, &ev);
+#endif
+            return;
+        }
+    }
+}
+
+/// Stop or resume waiting for the output: the descriptors are removed from
+/// the epoll set rather than left there without events, since a pipe that
+/// has been closed on the other end would still be reported
+void WTProcessController::HoldReads(bool hold) {
+    m_reading = !hold;
+#if defined(__linux__)
+    for (size_t i = 0; i < m_fds.size(); i++) {
+        if (!control_always_watched(m_keys[i])) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = m_keys[i];
+            epoll_ctl(m_epoll, hold ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, m_fds[i], &ev);
+        }
+    }
+#endif
+}
+
+/// Wait for the descriptors, returning the keys of the ready ones
+int WTProcessController::Wait(long timeout, std::vector<unsigned long long>& ready) {
+    ready.clear();
+#if defined(__linux__)
+    struct epoll_event evs[16];
+    int n = epoll_wait(m_epoll, evs, 16, (int)timeout);
+    for (int i = 0; i < n; i++) {
+        ready.push_back(evs[i].data.u64);
+    }
+#else
+    std::vector<struct pollfd> pfds;
+    std::vector<unsigned long long> keys;
+    for (size_t i = 0; i < m_fds.size(); i++) {
+        if (m_reading || control_always_watched(m_keys[i])) {
+            struct pollfd pfd;
+            pfd.fd = m_fds[i];
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            pfds.push_back(pfd);
+            keys.push_back(m_keys[i]);
+        }
+    }
+    int n = poll(&pfds[0], pfds.size(), (int)timeout);
+    for (int i = 0; n > 0 && i < (int)pfds.size(); i++) {
+        if (pfds[i].revents) {
+            ready.push_back(keys[i]);
+        }
+    }
+#endif
+    return n;
+}
+
+#endif // WT_NATIVE_PROCESS
+
+
+// end.
@@ -0,0 +1,166 @@
+/// whenever_tray
+///
+/// Controller of the scheduler processes: a single thread owns the child
+/// processes, their pipes and the deadlines of their lifecycle, and waits
+/// for all of them at once, with epoll on Linux and poll elsewhere. The GUI
+/// never touches a process directly: it queues requests (spawn, write to
+/// the standard input, kill after a grace period, release), which are
+/// carried out by the controller thread, and takes back the events queued
+/// by the controller (output read, a child that has settled after being
+/// spawned, a child that has exited). The listener is notified from the
+/// controller thread whenever the queue of events stops being empty, thus
+/// once for each batch of events.
+///
+/// The output not yet taken by the GUI is bounded: above
+/// WT_CONTROL_OUTPUT_MAX bytes the pipes are not read until the events are
+/// taken, so that a flooding scheduler is held by its full pipe rather
+/// than filling the memory of the tray.
+///
+/// On Linux the exit of a child is waited for together with its output,
+/// through its pidfd, thus it is seen at once also when processes left
+/// behind keep its pipes open; elsewhere, and on kernels without pidfds,
+/// the children are checked every WT_CONTROL_REAP_INTERVAL.
+///
+/// Children are identified by a number chosen by the caller, which tags
+/// their events. The controller is only available where the scheduler is
+/// spawned natively, that is on POSIX systems.
+///
+/// This module does not depend on wxWidgets.
+
+#ifndef WT_CONTROLLER_H
+#define WT_CONTROLLER_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wt_process.h"
+
+// bytes read from a pipe at once, output waiting to be taken above which
+// the pipes are not read, and interval between checks of the children
+// that may have exited while their pipes are still open, when their exit
+// cannot be waited for
+#define WT_CONTROL_READ_CHUNK 16384
+#define WT_CONTROL_OUTPUT_MAX (1024 * 1024)
+#define WT_CONTROL_REAP_INTERVAL 100    // milliseconds
+
+// kinds of events queued by the controller
+enum WTControlEventKind {
+    WT_CONTROL_SPAWNED = 0,     // the settle time has passed, or the spawn failed
+    WT_CONTROL_OUTPUT,          // a chunk of output
+    WT_CONTROL_EXITED,          // the child has exited, all its output precedes
+};
+
+// An event concerning a child
+struct WTControlEvent {
+    WTControlEventKind kind;
+    int child;
+    long pid;                   // spawned: 0 if the child is not running
+    int status;                 // spawned: errno; exited: exit code or -signal
+    WTOutputStream stream;      // output only
+    std::string data;           // output only
+};
+
+// Receiver of the notification that events are waiting: it is called from
+// the controller thread, thus it should only schedule the events to be
+// taken by the thread that owns the children
+class WTControlListener {
+public:
+    virtual ~WTControlListener() { }
+    virtual void OnControlEvents() = 0;
+};
+
+#ifdef WT_NATIVE_PROCESS
+
+// The controller thread, with its queues of requests and events
+class WTProcessController {
+public:
+    WTProcessController();
+    ~WTProcessController();
+
+    bool Start(WTControlListener* listener);
+
+    // stop the thread: the children still running are given at most the
+    // grace period to leave, and are then killed with their process group
+    void Stop(long grace_ms = 0);
+    bool Running() const {
+        return m_thread.joinable();
+    }
+
+    // spawn a child: a spawned event follows once the child has been
+    // running for the settle time, or as soon as it has left before
+    void Spawn(int child, const WTSpawnOptions& options, long settle_ms);
+
+    // write to the standard input of a child
+    void Write(int child, const std::string& data);
+
+    // kill the process group of a child if it has not exited after the
+    // grace period, or at once if the period is zero
+    void Kill(int child, long grace_ms = 0);
+
+    // forget a child, killing it if still running: no more events follow
+    void Release(int child);
+
+    // take the events queued so far, resuming the reads if they were held
+    void TakeEvents(std::vector<WTControlEvent>& events);
+
+private:
+    enum RequestKind {
+        REQUEST_SPAWN = 0,
+        REQUEST_WRITE,
+        REQUEST_KILL,
+        REQUEST_RELEASE,
+        REQUEST_STOP,
+    };
+    struct Request {
+        RequestKind kind;
+        int child;
+        WTSpawnOptions options;
+        std::string data;
+        long ms;
+    };
+    struct Child;
+
+    void Queue(Request& request);
+    void Post(WTControlEvent& event);
+    void Run();
+    void Handle(Request& request);
+    Child* Find(int id);
+    bool ReadOutput(Child* child, int index, bool all);
+    void CheckChild(Child* child, long long now, bool reap);
+    void Remove(Child* child);
+    void Watch(int fd, unsigned long long key);
+    void Unwatch(int fd);
+    void HoldReads(bool hold);
+    int Wait(long timeout, std::vector<unsigned long long>& ready);
+    void Shutdown(long grace_ms);
+
+    WTControlListener* m_listener;
+    std::thread m_thread;
+    int m_wake[2];
+
+    // shared with the other threads
+    std::mutex m_mutex;
+    std::deque<Request> m_requests;
+    std::vector<WTControlEvent> m_events;
+    size_t m_pendingBytes;
+    bool m_held;
+
+    // owned by the controller thread
+    std::vector<Child*> m_children;
+    bool m_reading;
+#if defined(__linux__)
+    int m_epoll;
+#endif
+    std::vector<int> m_fds;
+    std::vector<unsigned long long> m_keys;
+};
+
+#endif // WT_NATIVE_PROCESS
+
+
+#endif // WT_CONTROLLER_H
+
+// end.
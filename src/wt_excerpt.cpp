@@ -0,0 +1,501 @@
+/// whenever_tray
+///
+/// Excerpts of the scheduler log by time range.
+
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include <zlib.h>
+
+#include "wt_excerpt.h"
+#include "wt_logreader.h"
+#include "wt_output.h"
+#include "wt_sysinfo.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#define WT_EXCERPT_SENDFILE
+#if defined(SYS_copy_file_range)
+#define WT_EXCERPT_COPY_FILE_RANGE
+#endif
+#endif
+
+#if defined(_WIN32)
+#define EXCERPT_OPEN_READ (_O_RDONLY | _O_BINARY)
+#define EXCERPT_OPEN_WRITE (_O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY)
+#else
+#define EXCERPT_OPEN_READ (O_RDONLY | O_CLOEXEC)
+#define EXCERPT_OPEN_WRITE (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC)
+#endif
+
+// size of the chunks read while locating a time, and of the buffers used
+// when the data has to pass through user space
+#define EXCERPT_PROBE 4096
+#define EXCERPT_BUFFER (64 * 1024)
+
+// bytes at the beginning of a line where its timestamp is looked for
+#define EXCERPT_HEAD 48
+
+// window below which the bisection gives way to a linear scan
+#define EXCERPT_SCAN_WINDOW (64 * 1024)
+
+// compression level of the lines compressed on the way
+#define EXCERPT_LEVEL 6
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+// read at an offset, without moving the file position where possible
+static long read_at(int fd, unsigned long long offset, char* buf, size_t len) {
+#ifdef _WIN32
+    if (_lseeki64(fd, (__int64)offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return _read(fd, buf, (unsigned int)len);
+#else
+    return (long)pread(fd, buf, len, (off_t)offset);
+#endif
+}
+
+// size of an open file
+static bool file_size(int fd, unsigned long long& size) {
+#ifdef _WIN32
+    struct _stati64 st;
+    if (_fstati64(fd, &st) != 0) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+#endif
+    size = (unsigned long long)st.st_size;
+    return true;
+}
+
+// write a whole buffer
+static bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        long n = (long)write(fd, data, (unsigned int)len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// copy a range of a file to the current position of another one: the
+// kernel copies the data where possible, user space is the last resort
+static bool copy_range(int in_fd, unsigned long long offset, int out_fd,
+                       unsigned long long len, unsigned long long& copied) {
+#ifdef WT_EXCERPT_COPY_FILE_RANGE
+    loff_t in_off = (loff_t)offset;
+    while (len > 0) {
+        long n = syscall(SYS_copy_file_range, in_fd, &in_off, out_fd, NULL,
+                         (size_t)(len < (1ULL << 30) ? len : (1ULL << 30)), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        copied += n;
+        len -= n;
+    }
+    offset = (unsigned long long)in_off;
+#endif
+#ifdef WT_EXCERPT_SENDFILE
+    off_t sf_off = (off_t)offset;
+    while (len > 0) {
+        ssize_t n = sendfile(out_fd, in_fd, &sf_off,
+                             (size_t)(len < (1ULL << 30) ? len : (1ULL << 30)));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        copied += n;
+        len -= n;
+    }
+    offset = (unsigned long long)sf_off;
+#endif
+    std::vector<char> buf(len > 0 ? EXCERPT_BUFFER : 0);
+    while (len > 0) {
+        long n = read_at(in_fd, offset, &buf[0], len < buf.size() ? (size_t)len : buf.size());
+        if (n <= 0 || !write_all(out_fd, &buf[0], n)) {
+            return false;
+        }
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Finds the dated lines of a file, reading a small chunk at each step
+class WTLineProbe {
+public:
+    WTLineProbe(int fd, unsigned long long size) : m_fd(fd), m_size(size) { }
+
+    // find the first dated line starting at or after pos, returning its
+    // offset and timestamp, or false if there is none before the end
+    bool Next(unsigned long long pos, unsigned long long& start, long long& ts) {
+        char buf[EXCERPT_PROBE];
+        bool at_line = pos == 0;
+        if (!at_line) {
+            pos--;      // the line starts at pos if it follows a newline
+        }
+        while (pos < m_size) {
+            long n = read_at(m_fd, pos, buf, sizeof(buf));
+            if (n <= 0) {
+                return false;
+            }
+            long i = 0;
+            while (i < n) {
+                if (at_line) {
+                    if (Dated(buf + i, n - i, ts)
+                        || (n - i < EXCERPT_HEAD && pos + n < m_size && Reread(pos + i, ts))) {
+                        start = pos + i;
+                        return true;
+                    }
+                }
+                const char* nl = (const char*)memchr(buf + i, '\n', n - i);
+                if (!nl) {
+                    at_line = false;
+                    break;
+                }
+                i = (long)(nl - buf) + 1;
+                at_line = true;
+            }
+            pos += n;
+        }
+        return false;
+    }
+
+private:
+    // a line is dated if it begins with a bracketed timestamp
+    static bool Dated(const char* s, long len, long long& ts) {
+        if (len > EXCERPT_HEAD) {
+            len = EXCERPT_HEAD;
+        }
+        const char* close = len > 1 && s[0] == '[' ? (const char*)memchr(s, ']', len) : NULL;
+        return close && WTParseTimestamp(s + 1, close - s - 1, ts);
+    }
+
+    // a line near the end of a chunk is read again from its beginning
+    bool Reread(unsigned long long pos, long long& ts) {
+        char head[EXCERPT_HEAD];
+        long n = read_at(m_fd, pos, head, sizeof(head));
+        return n > 0 && Dated(head, n, ts);
+    }
+
+    int m_fd;
+    unsigned long long m_size;
+};
+
+// locate the first line dated at or after a time: the search bisects the
+// file on the dated lines, then scans the remaining window
+static unsigned long long locate(int fd, unsigned long long size, long long when) {
+    WTLineProbe probe(fd, size);
+    unsigned long long lo = 0, hi = size, start;
+    long long ts;
+    while (hi - lo > EXCERPT_SCAN_WINDOW) {
+        unsigned long long mid = lo + (hi - lo) / 2;
+        if (!probe.Next(mid, start, ts) || start >= hi || ts >= when) {
+            hi = mid;
+        } else {
+            lo = start + 1;
+        }
+    }
+    unsigned long long pos = lo;
+    while (probe.Next(pos, start, ts)) {
+        if (ts >= when) {
+            return start;
+        }
+        pos = start + 1;
+    }
+    return size;
+}
+
+// Destination of an excerpt: a plain file, or a gzip file whose members
+// are either compressed here or copied from compressed segments
+class WTExcerptWriter : public WTLineSink {
+public:
+    WTExcerptWriter() : m_fd(-1), m_compress(false), m_member(false), m_ok(true),
+                        m_input(0), m_bytes(0), m_copied(0) {
+        memset(&m_zs, 0, sizeof(m_zs));
+    }
+    ~WTExcerptWriter() {
+        Close();
+    }
+
+    bool Open(const std::string& path, bool compress) {
+        m_compress = compress;
+        m_fd = open(path.c_str(), EXCERPT_OPEN_WRITE, 0644);
+        if (m_fd < 0) {
+            return false;
+        }
+        if (compress) {
+            m_out.resize(EXCERPT_BUFFER);
+            if (deflateInit2(&m_zs, EXCERPT_LEVEL, Z_DEFLATED, 15 + 16, 8,
+                             Z_DEFAULT_STRATEGY) != Z_OK) {
+                m_ok = false;
+            }
+        }
+        return m_ok;
+    }
+
+    // uncompressed data: written as it is, or compressed into a member
+    void Write(const char* data, size_t len) {
+        if (!m_ok || len == 0) {
+            return;
+        }
+        m_input += len;
+        if (!m_compress) {
+            m_ok = write_all(m_fd, data, len);
+            m_bytes += len;
+            return;
+        }
+        m_member = true;
+        Deflate(data, len, Z_NO_FLUSH);
+    }
+
+    // a range of an uncompressed file: copied by the kernel, unless it has
+    // to be compressed
+    void CopyPlain(int fd, unsigned long long offset, unsigned long long len) {
+        if (!m_ok) {
+            return;
+        }
+        if (!m_compress) {
+            m_ok = copy_range(fd, offset, m_fd, len, m_copied);
+            m_input += len;
+            m_bytes += len;
+            return;
+        }
+        std::vector<char> buf(EXCERPT_BUFFER);
+        while (m_ok && len > 0) {
+            long n = read_at(fd, offset, &buf[0], len < buf.size() ? (size_t)len : buf.size());
+            if (n <= 0) {
+                m_ok = false;
+                break;
+            }
+            Write(&buf[0], n);
+            offset += n;
+            len -= n;
+        }
+    }
+
+    // a whole gzip member of a compressed segment, after the member being
+    // compressed here, if any, is completed
+    void CopyMember(int fd, unsigned long long offset, unsigned long long len) {
+        FinishMember();
+        if (m_ok) {
+            m_ok = copy_range(fd, offset, m_fd, len, m_copied);
+            m_input += len;
+            m_bytes += len;
+        }
+    }
+
+    virtual void OnLine(WTOutputStream /* stream */, const char* line, size_t len) {
+        Write(line, len);
+        Write("\n", 1);
+    }
+
+    bool Close() {
+        if (m_fd < 0) {
+            return m_ok;
+        }
+        if (m_compress) {
+            FinishMember();
+            deflateEnd(&m_zs);
+        }
+        m_ok = close(m_fd) == 0 && m_ok;
+        m_fd = -1;
+        return m_ok;
+    }
+
+    // whether the output is a gzip file, to which members can be copied
+    bool Compressed() const {
+        return m_compress;
+    }
+
+    // data taken from the log, compressed or not, and data written
+    unsigned long long Input() const {
+        return m_input;
+    }
+    unsigned long long Bytes() const {
+        return m_bytes;
+    }
+    unsigned long long Copied() const {
+        return m_copied;
+    }
+
+private:
+    void Deflate(const char* data, size_t len, int flush) {
+        m_zs.next_in = (Bytef*)data;
+        m_zs.avail_in = (uInt)len;
+        int ret;
+        do {
+            m_zs.next_out = (Bytef*)&m_out[0];
+            m_zs.avail_out = (uInt)m_out.size();
+            ret = deflate(&m_zs, flush);
+            size_t produced = m_out.size() - m_zs.avail_out;
+            if (ret == Z_STREAM_ERROR || !write_all(m_fd, &m_out[0], produced)) {
+                m_ok = false;
+                return;
+            }
+            m_bytes += produced;
+        } while (m_zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    }
+
+    void FinishMember() {
+        if (m_ok && m_member) {
+            Deflate(NULL, 0, Z_FINISH);
+            deflateReset(&m_zs);
+        }
+        m_member = false;
+    }
+
+    int m_fd;
+    bool m_compress;
+    bool m_member;
+    bool m_ok;
+    unsigned long long m_input;
+    unsigned long long m_bytes;
+    unsigned long long m_copied;
+    z_stream m_zs;
+    std::vector<char> m_out;
+};
+
+// check whether a path ends with a suffix
+static bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// extract from a compressed segment: with a compressed output, the blocks
+// entirely within the range are copied, and the others are decompressed;
+// with a plain output all the blocks are decompressed
+static bool extract_compressed(const std::string& path, long long from, long long to,
+                               WTLogReader& reader, WTExcerptWriter& writer) {
+    std::vector<WTLogBlock> blocks, run;
+    if (!WTReadLogIndex(WTLogIndexPath(path), blocks)) {
+        return reader.ReadSegment(path, from, to, &writer);
+    }
+    int fd = open(path.c_str(), EXCERPT_OPEN_READ);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t b = 0; b < blocks.size(); b++) {
+        if (WTLogBlockOutside(blocks[b], from, to)) {
+            continue;
+        }
+        if (writer.Compressed() && WTLogBlockInside(blocks[b], from, to)) {
+            ok = reader.ReadBlocks(path, run, from, to, &writer) && ok;
+            run.clear();
+            writer.CopyMember(fd, blocks[b].coffset, blocks[b].csize);
+        } else {
+            run.push_back(blocks[b]);
+        }
+    }
+    ok = reader.ReadBlocks(path, run, from, to, &writer) && ok;
+    close(fd);
+    return ok;
+}
+
+// extract from an uncompressed segment or from the live log
+static bool extract_plain(const std::string& path, long long from, long long to,
+                          WTExcerptWriter& writer) {
+    int fd = open(path.c_str(), EXCERPT_OPEN_READ);
+    unsigned long long size;
+    if (fd < 0) {
+        return false;
+    }
+    if (!file_size(fd, size)) {
+        close(fd);
+        return false;
+    }
+    unsigned long long start = locate(fd, size, from);
+    unsigned long long end = to == LLONG_MAX ? size : locate(fd, size, to + 1);
+    if (end > start) {
+        writer.CopyPlain(fd, start, end - start);
+    }
+    close(fd);
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// excerpts
+// ----------------------------------------------------------------------------
+
+/// Extract a time range from the segments of a log, oldest first, and from
+/// the live log: a segment compressed while extracting is looked for again
+/// in its compressed form
+bool WTExtractLog(const std::string& log_path, long long from, long long to,
+                  const std::string& out_path, bool compress, WTExcerptStats& stats) {
+    long long started = WTMonotonicMillis();
+    memset(&stats, 0, sizeof(stats));
+    WTExcerptWriter writer;
+    if (!writer.Open(out_path, compress)) {
+        return false;
+    }
+    std::vector<std::string> segments;
+    WTListLogSegments(log_path, segments);
+    WTLogReader reader;
+    bool ok = true;
+    for (size_t i = 0; i <= segments.size(); i++) {
+        std::string path = i < segments.size() ? segments[i] : log_path;
+        unsigned long long before = writer.Input();
+        if (ends_with(path, WT_LOG_GZ_SUFFIX)) {
+            ok = extract_compressed(path, from, to, reader, writer) && ok;
+        } else if (!extract_plain(path, from, to, writer) && i < segments.size()) {
+            ok = extract_compressed(path + WT_LOG_GZ_SUFFIX, from, to, reader, writer) && ok;
+        }
+        if (writer.Input() > before) {
+            stats.segments++;
+        }
+    }
+    ok = writer.Close() && ok;
+    stats.bytes_out = writer.Bytes();
+    stats.bytes_copied = writer.Copied();
+    stats.seconds = (WTMonotonicMillis() - started) / 1000.0;
+    return ok;
+}
+
+/// Locate a time in an uncompressed log
+bool WTLocateLogTime(const std::string& path, long long when, unsigned long long& offset) {
+    int fd = open(path.c_str(), EXCERPT_OPEN_READ);
+    unsigned long long size;
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = file_size(fd, size);
+    if (ok) {
+        offset = locate(fd, size, when);
+    }
+    close(fd);
+    return ok;
+}
+
+
+// end.
@@ -0,0 +1,41 @@
+/// whenever_tray
+///
+/// Excerpts of the scheduler log by time range, for bug reports. In the
+/// live log and in uncompressed segments the range is located by bisection
+/// on the timestamps of the lines, reading only a few small chunks, and the
+/// bytes are copied from file to file in the kernel (with copy_file_range,
+/// or sendfile where it is not supported) without passing through user
+/// space. Compressed excerpts are gzip files: the blocks of compressed
+/// segments that lie entirely within the range are copied as they are,
+/// since a sequence of gzip members is itself a gzip file, while the other
+/// lines are compressed on the way.
+///
+/// This module does not depend on wxWidgets.
+
+#ifndef WT_EXCERPT_H
+#define WT_EXCERPT_H
+
+#include <string>
+
+// Figures about an excerpt: the bytes written, and those copied by the
+// kernel from the log or from its compressed segments
+struct WTExcerptStats {
+    unsigned long long bytes_out;
+    unsigned long long bytes_copied;
+    unsigned int segments;
+    double seconds;
+};
+
+// write the lines of a log and of its segments whose timestamp, in the
+// WTLogRecord convention, is within [from, to] to the output file
+bool WTExtractLog(const std::string& log_path, long long from, long long to,
+                  const std::string& out_path, bool compress, WTExcerptStats& stats);
+
+// locate the first line of an uncompressed log dated at or after a time,
+// returning the size of the file if there is none
+bool WTLocateLogTime(const std::string& path, long long when, unsigned long long& offset);
+
+
+#endif // WT_EXCERPT_H
+
+// end.
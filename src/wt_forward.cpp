@@ -0,0 +1,277 @@
+/// whenever_tray
+///
+/// Forwarding of the scheduler output to syslog or to the journal.
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "wt_forward.h"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define WT_FORWARD_UNIX
+#endif
+#if defined(__linux__)
+#define WT_FORWARD_SENDMMSG
+#endif
+
+// syslog facility of the records (user-level messages), and severity of
+// each log level, as in RFC 5424
+#define FORWARD_FACILITY 1
+static const int FORWARD_SEVERITY[WT_LEVEL_COUNT] = {
+    7,      // trace: debug
+    7,      // debug
+    6,      // info: informational
+    4,      // warn: warning
+    3,      // error
+    6,      // unknown: informational
+};
+
+// time the thread waits for a slow receiver before checking whether it
+// has to stop
+#define FORWARD_SEND_WAIT 100           // milliseconds
+
+
+// ============================================================================
+// WTLogForwarder: implementation
+// ============================================================================
+
+WTLogForwarder::WTLogForwarder() : m_sent(0), m_dropped(0), m_failed(0) {
+    m_path = WT_FORWARD_SYSLOG_SOCKET;
+    m_ident = "whenever";
+    m_format = WT_FORWARD_SYSLOG;
+    m_fd = -1;
+    m_stop = false;
+    m_slots = NULL;
+    m_head = m_tail = 0;
+}
+
+WTLogForwarder::~WTLogForwarder() {
+    Stop();
+}
+
+/// Format a record in a slot, truncating it if it does not fit
+size_t WTLogForwarder::Format(char* buf, size_t size, const char* line, size_t len,
+                              WTLogLevel level, long pid) {
+    int priority = FORWARD_FACILITY * 8 + FORWARD_SEVERITY[level];
+    int n;
+    if (m_format == WT_FORWARD_JOURNAL) {
+        n = snprintf(buf, size,
+                     "PRIORITY=%d\nSYSLOG_FACILITY=%d\nSYSLOG_IDENTIFIER=%s\n"
+                     "SYSLOG_PID=%ld\nMESSAGE=%.*s\n",
+                     FORWARD_SEVERITY[level], FORWARD_FACILITY, m_ident.c_str(),
+                     pid, (int)len, line);
+        if (n >= (int)size) {
+            // the record must still end with a newline
+            n = (int)size - 1;
+            buf[n - 1] = '\n';
+        }
+    } else {
+        time_t now = time(NULL);
+        struct tm t;
+#ifdef _WIN32
+        localtime_s(&t, &now);
+#else
+        localtime_r(&now, &t);
+#endif
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%b %e %H:%M:%S", &t);
+        n = snprintf(buf, size, "<%d>%s %s[%ld]: %.*s",
+                     priority, stamp, m_ident.c_str(), pid, (int)len, line);
+        if (n >= (int)size) {
+            n = (int)size - 1;
+        }
+    }
+    return n > 0 ? (size_t)n : 0;
+}
+
+/// Queue a line, or count it as dropped if the ring is full: the record is
+/// formatted outside the lock, in a slot the thread does not touch
+void WTLogForwarder::Forward(const char* line, size_t len, WTLogLevel level, long pid) {
+    if (!m_slots) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_tail - m_head >= WT_FORWARD_SLOTS) {
+            m_dropped++;
+            return;
+        }
+    }
+    Slot& slot = m_slots[m_tail % WT_FORWARD_SLOTS];
+    slot.len = Format(slot.data, sizeof(slot.data), line, len, level, pid);
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tail++;
+        wake = m_tail - m_head == 1;
+    }
+    if (wake) {
+        m_cond.notify_one();
+    }
+}
+
+/// Return the counters
+WTForwardStats WTLogForwarder::Stats() const {
+    WTForwardStats stats;
+    stats.sent = m_sent.load();
+    stats.dropped = m_dropped.load();
+    stats.failed = m_failed.load();
+    return stats;
+}
+
+#ifdef WT_FORWARD_UNIX
+
+/// Start the thread: the socket is connected by the thread, so that the
+/// receiver may also appear later
+bool WTLogForwarder::Start() {
+    if (m_thread.joinable()) {
+        return true;
+    }
+    if (m_path.empty() || m_path.size() >= sizeof(((struct sockaddr_un*)0)->sun_path)) {
+        return false;
+    }
+    m_slots = new Slot[WT_FORWARD_SLOTS];
+    m_head = m_tail = 0;
+    m_stop = false;
+    m_thread = std::thread(&WTLogForwarder::Run, this);
+    return true;
+}
+
+/// Stop the thread: the records still queued are discarded
+void WTLogForwarder::Stop() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    delete[] m_slots;
+    m_slots = NULL;
+}
+
+/// Connect a non-blocking datagram socket to the receiver
+bool WTLogForwarder::Connect() {
+    if (m_fd >= 0) {
+        return true;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, m_path.c_str(), sizeof(addr.sun_path) - 1);
+    m_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (m_fd < 0) {
+        return false;
+    }
+    fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    if (connect(m_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+/// Send count records starting from the slot at first, returning the number
+/// of records done with, either sent or failed: zero means the receiver is
+/// slow, and the records are left in the ring
+size_t WTLogForwarder::Send(size_t first, size_t count) {
+    if (!Connect()) {
+        m_failed += count;
+        return count;
+    }
+    int sent;
+#ifdef WT_FORWARD_SENDMMSG
+    struct mmsghdr msgs[WT_FORWARD_BATCH];
+    struct iovec iov[WT_FORWARD_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < count; i++) {
+        Slot& slot = m_slots[(first + i) % WT_FORWARD_SLOTS];
+        iov[i].iov_base = slot.data;
+        iov[i].iov_len = slot.len;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    sent = sendmmsg(m_fd, msgs, (unsigned int)count, MSG_NOSIGNAL);
+#else
+    sent = 0;
+    while ((size_t)sent < count) {
+        Slot& slot = m_slots[(first + sent) % WT_FORWARD_SLOTS];
+        if (send(m_fd, slot.data, slot.len, 0) < 0) {
+            if (sent == 0) {
+                sent = -1;
+            }
+            break;
+        }
+        sent++;
+    }
+#endif
+    if (sent > 0) {
+        m_sent += sent;
+        return (size_t)sent;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, FORWARD_SEND_WAIT);
+        return 0;
+    }
+    // the record is rejected, or the receiver has gone: in the latter
+    // case the socket is connected again at the next send
+    if (errno != EMSGSIZE) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_failed++;
+    return 1;
+}
+
+/// Send the queued records in batches, one batch per send call
+void WTLogForwarder::Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        while (!m_stop && m_head == m_tail) {
+            m_cond.wait(lock);
+        }
+        if (m_stop) {
+            break;
+        }
+        size_t first = m_head;
+        size_t count = m_tail - m_head;
+        if (count > WT_FORWARD_BATCH) {
+            count = WT_FORWARD_BATCH;
+        }
+        lock.unlock();
+        size_t done = Send(first, count);
+        lock.lock();
+        m_head += done;
+    }
+}
+
+#else
+
+bool WTLogForwarder::Start() {
+    return false;
+}
+
+void WTLogForwarder::Stop() {
+}
+
+#endif // WT_FORWARD_UNIX
+
+
+// end.
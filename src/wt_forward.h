@@ -0,0 +1,107 @@
+/// whenever_tray
+///
+/// Forwarding of the scheduler output to the local syslog daemon or to the
+/// journal, through their AF_UNIX datagram sockets. Each line becomes a
+/// record with the priority derived from its level and with the PID of the
+/// scheduler, formatted when the line is received in a fixed slot of a ring
+/// of WT_FORWARD_SLOTS records, so that no allocation takes place for each
+/// line. A thread sends the queued records in batches, with one sendmmsg
+/// call for up to WT_FORWARD_BATCH records on Linux. When the receiver does
+/// not keep up, the records that do not fit in the ring are dropped and
+/// counted, so that the scheduler output is never held up.
+///
+/// This module does not depend on wxWidgets, and is not available on
+/// Windows.
+
+#ifndef WT_FORWARD_H
+#define WT_FORWARD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "wt_output.h"
+
+// default sockets of the syslog daemon and of the journal
+#define WT_FORWARD_SYSLOG_SOCKET "/dev/log"
+#define WT_FORWARD_JOURNAL_SOCKET "/run/systemd/journal/socket"
+
+// size of the ring, maximum records per send, and size of a record
+#define WT_FORWARD_SLOTS 256
+#define WT_FORWARD_BATCH 32
+#define WT_FORWARD_RECORD (WT_LINE_MAX + 256)
+
+// Format of the records: traditional syslog lines, or the native protocol
+// of the journal, where the record is a list of fields
+enum WTForwardFormat {
+    WT_FORWARD_SYSLOG = 0,
+    WT_FORWARD_JOURNAL,
+};
+
+// Counters of the forwarded records
+struct WTForwardStats {
+    unsigned long long sent;
+    unsigned long long dropped;     // the ring was full
+    unsigned long long failed;      // the socket rejected the records
+};
+
+// Forwarder of output lines to a local datagram socket
+class WTLogForwarder {
+public:
+    WTLogForwarder();
+    ~WTLogForwarder();
+
+    void SetSocket(const std::string& path, WTForwardFormat format) {
+        m_path = path;
+        m_format = format;
+    }
+    void SetIdentifier(const std::string& ident) {
+        m_ident = ident;
+    }
+
+    bool Start();
+    void Stop();
+
+    // queue a line: called from a single thread, it never blocks
+    void Forward(const char* line, size_t len, WTLogLevel level, long pid);
+
+    WTForwardStats Stats() const;
+
+private:
+    struct Slot {
+        size_t len;
+        char data[WT_FORWARD_RECORD];
+    };
+
+    void Run();
+    size_t Format(char* buf, size_t size, const char* line, size_t len,
+                  WTLogLevel level, long pid);
+    bool Connect();
+    size_t Send(size_t first, size_t count);
+
+    std::string m_path;
+    std::string m_ident;
+    WTForwardFormat m_format;
+    int m_fd;
+    std::thread m_thread;
+    bool m_stop;
+
+    // ring of records: the producer owns the slots from m_tail on, the
+    // thread the ones between m_head and m_tail
+    Slot* m_slots;
+    size_t m_head;
+    size_t m_tail;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+
+    std::atomic<unsigned long long> m_sent;
+    std::atomic<unsigned long long> m_dropped;
+    std::atomic<unsigned long long> m_failed;
+};
+
+
+#endif // WT_FORWARD_H
+
+// end.
@@ -0,0 +1,205 @@
+/// whenever_tray
+///
+/// Persistent history of scheduler samples in a memory mapped ring file.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WT_HISTORY_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "wt_history.h"
+
+// identification of the file format
+static const char HISTORY_MAGIC[8] = { 'W', 'T', 'H', 'I', 'S', 'T', '0', '1' };
+
+// File header: the slot index is only a hint for the writer, as the
+// records themselves carry their sequence numbers
+struct WTHistoryFile::Header {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t capacity;
+    uint64_t next_slot;
+    uint8_t reserved[40];
+};
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+// FNV-1a checksum of the record fields that precede the checksum itself
+static uint32_t record_checksum(const WTHistoryRecord& rec) {
+    const unsigned char* p = (const unsigned char*)&rec;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(WTHistoryRecord, checksum); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static bool record_valid(const WTHistoryRecord& rec) {
+    return rec.seq != 0 && rec.checksum == record_checksum(rec);
+}
+
+static bool record_before(const WTHistoryRecord& a, const WTHistoryRecord& b) {
+    return a.seq < b.seq;
+}
+
+
+// ============================================================================
+// WTHistoryFile: implementation
+// ============================================================================
+
+WTHistoryFile::WTHistoryFile() {
+    m_header = NULL;
+    m_records = NULL;
+    m_mapSize = 0;
+    m_nextSeq = 1;
+    m_fd = -1;
+}
+
+WTHistoryFile::~WTHistoryFile() {
+    Close();
+}
+
+/// Open (creating it if needed) and map the ring file: an existing file
+/// with a different layout is reinitialized, otherwise writing continues
+/// after the most recent valid record
+bool WTHistoryFile::Open(const std::string& path, uint32_t capacity) {
+#ifdef WT_HISTORY_MMAP
+    Close();
+    if (capacity == 0) {
+        return false;
+    }
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        Close();
+        return false;
+    }
+
+    // check whether the existing header is compatible
+    Header h;
+    bool reset = true;
+    if ((size_t)st.st_size >= sizeof(h)
+        && pread(m_fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h)
+        && memcmp(h.magic, HISTORY_MAGIC, sizeof(h.magic)) == 0
+        && h.record_size == sizeof(WTHistoryRecord)
+        && h.capacity > 0
+        && (size_t)st.st_size == sizeof(h) + (size_t)h.capacity * sizeof(WTHistoryRecord)) {
+        capacity = h.capacity;
+        reset = false;
+    }
+    m_mapSize = sizeof(Header) + (size_t)capacity * sizeof(WTHistoryRecord);
+    if (reset && (ftruncate(m_fd, 0) != 0 || ftruncate(m_fd, m_mapSize) != 0)) {
+        Close();
+        return false;
+    }
+
+    void* p = mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (p == MAP_FAILED) {
+        m_mapSize = 0;
+        Close();
+        return false;
+    }
+    m_header = (Header*)p;
+    m_records = (WTHistoryRecord*)((char*)p + sizeof(Header));
+    if (reset) {
+        memset(m_header, 0, sizeof(Header));
+        memcpy(m_header->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+        m_header->record_size = sizeof(WTHistoryRecord);
+        m_header->capacity = capacity;
+        m_header->next_slot = 0;
+    }
+
+    // resume after the most recent valid record
+    uint64_t last_seq = 0, last_slot = 0;
+    for (uint32_t i = 0; i < m_header->capacity; i++) {
+        if (record_valid(m_records[i]) && m_records[i].seq > last_seq) {
+            last_seq = m_records[i].seq;
+            last_slot = i;
+        }
+    }
+    m_nextSeq = last_seq + 1;
+    m_header->next_slot = last_seq ? (last_slot + 1) % m_header->capacity : 0;
+    return true;
+#else
+    (void)path;
+    (void)capacity;
+    return false;
+#endif
+}
+
+/// Unmap and close the file: the kernel takes care of writing back the
+/// mapped pages, also in case the tray crashes
+void WTHistoryFile::Close() {
+#ifdef WT_HISTORY_MMAP
+    if (m_header) {
+        munmap(m_header, m_mapSize);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+    m_header = NULL;
+    m_records = NULL;
+    m_mapSize = 0;
+    m_fd = -1;
+}
+
+/// Write a record in the next slot: a record interrupted while being
+/// written is a mix of the old and the new one, which is rejected by the
+/// checksum when the file is read
+bool WTHistoryFile::Append(WTHistoryRecord& rec) {
+    if (!m_header) {
+        return false;
+    }
+    uint64_t slot = m_header->next_slot % m_header->capacity;
+    rec.seq = m_nextSeq++;
+    rec.checksum = record_checksum(rec);
+
+    WTHistoryRecord* dest = m_records + slot;
+    memcpy(dest, &rec, sizeof(rec));
+    m_header->next_slot = (slot + 1) % m_header->capacity;
+    return true;
+}
+
+/// Read the valid records of a ring file in chronological order
+bool WTHistoryFile::Read(const std::string& path, std::vector<WTHistoryRecord>& records) {
+    records.clear();
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    Header h;
+    if (fread(&h, sizeof(h), 1, f) != 1
+        || memcmp(h.magic, HISTORY_MAGIC, sizeof(h.magic)) != 0
+        || h.record_size != sizeof(WTHistoryRecord)) {
+        fclose(f);
+        return false;
+    }
+    records.reserve(h.capacity);
+    WTHistoryRecord rec;
+    for (uint32_t i = 0; i < h.capacity && fread(&rec, sizeof(rec), 1, f) == 1; i++) {
+        if (record_valid(rec)) {
+            records.push_back(rec);
+        }
+    }
+    fclose(f);
+    std::sort(records.begin(), records.end(), record_before);
+    return true;
+}
+
+
+// end.
@@ -0,0 +1,65 @@
+/// whenever_tray
+///
+/// Persistent history of scheduler samples, kept in a fixed-size binary
+/// ring file in the user data directory. The file is mapped in memory and
+/// records are written in place, so that appending a sample requires no
+/// allocation and no system call; each record carries a sequence number
+/// and a checksum, so that records torn by a crash are detected and
+/// skipped when the file is read back.
+///
+/// The file is only supported on POSIX systems: elsewhere Open() fails and
+/// the history is simply not recorded.
+
+#ifndef WT_HISTORY_H
+#define WT_HISTORY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// default number of records in a newly created history file
+#define WT_HISTORY_CAPACITY 10080
+
+// A sample, as stored in the file: all fields have a fixed width
+struct WTHistoryRecord {
+    uint64_t seq;               // sequence number, 0 for unused slots
+    int64_t timestamp;          // milliseconds since the epoch (UTC)
+    uint64_t rss_bytes;         // resident memory of the scheduler
+    uint32_t cpu_permille;      // CPU usage, in tenths of a percent
+    uint32_t restarts;          // restarts since the tray has started
+    uint32_t latency_ms;        // average command latency since last sample
+    uint32_t checksum;          // over all the previous fields
+};
+
+// Writer and reader of the ring file
+class WTHistoryFile {
+public:
+    WTHistoryFile();
+    ~WTHistoryFile();
+
+    bool Open(const std::string& path, uint32_t capacity = WT_HISTORY_CAPACITY);
+    void Close();
+    bool IsOpen() const {
+        return m_header != NULL;
+    }
+
+    // append a record, filling in the sequence number and the checksum
+    bool Append(WTHistoryRecord& rec);
+
+    // read all valid records of a file, in chronological order
+    static bool Read(const std::string& path, std::vector<WTHistoryRecord>& records);
+
+private:
+    struct Header;
+
+    Header* m_header;
+    WTHistoryRecord* m_records;
+    size_t m_mapSize;
+    uint64_t m_nextSeq;
+    int m_fd;
+};
+
+
+#endif // WT_HISTORY_H
+
+// end.
@@ -0,0 +1,205 @@
+/// whenever_tray
+///
+/// Activity of the user in the desktop session.
+
+#include <cstring>
+
+#include "wt_idle.h"
+
+#if defined(WT_HAVE_XSS)
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/scrnsaver.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <shellapi.h>
+#endif
+
+
+// ============================================================================
+// WTIdleMonitor: implementation
+// ============================================================================
+
+#if defined(WT_HAVE_XSS)
+
+WTIdleMonitor::WTIdleMonitor()
+    : m_display(NULL), m_info(NULL),
+      m_atomActive(0), m_atomState(0), m_atomFullscreen(0),
+      m_open(false) { }
+
+/// Connect to the display named in DISPLAY: false when there is no display
+/// or the server lacks the XScreenSaver extension (for instance when only
+/// Wayland is available)
+bool WTIdleMonitor::Open() {
+    if (m_open) {
+        return true;
+    }
+    Display* dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        return false;
+    }
+    int event_base, error_base;
+    XScreenSaverInfo* info = NULL;
+    if (XScreenSaverQueryExtension(dpy, &event_base, &error_base)) {
+        info = XScreenSaverAllocInfo();
+    }
+    if (!info) {
+        XCloseDisplay(dpy);
+        return false;
+    }
+    m_display = dpy;
+    m_info = info;
+    m_atomActive = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
+    m_atomState = XInternAtom(dpy, "_NET_WM_STATE", False);
+    m_atomFullscreen = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
+    m_open = true;
+    return true;
+}
+
+/// Release the connection to the display
+void WTIdleMonitor::Close() {
+    if (m_open) {
+        XFree(m_info);
+        XCloseDisplay((Display*)m_display);
+        m_info = m_display = NULL;
+        m_open = false;
+    }
+}
+
+/// Milliseconds since the last input event in the session
+bool WTIdleMonitor::IdleMillis(unsigned long& ms) {
+    if (!m_open) {
+        return false;
+    }
+    Display* dpy = (Display*)m_display;
+    XScreenSaverInfo* info = (XScreenSaverInfo*)m_info;
+    if (!XScreenSaverQueryInfo(dpy, DefaultRootWindow(dpy), info)) {
+        return false;
+    }
+    ms = info->idle;
+    return true;
+}
+
+// read a property made of 32 bit items: the result has to be freed
+static unsigned char* get_property(Display* dpy, Window w, Atom prop, Atom type,
+                                   unsigned long& count) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long remaining;
+    unsigned char* data = NULL;
+    count = 0;
+    if (XGetWindowProperty(dpy, w, prop, 0, 64, False, type, &actual_type,
+                           &actual_format, &count, &remaining, &data) != Success
+        || actual_format != 32) {
+        if (data) {
+            XFree(data);
+        }
+        count = 0;
+        return NULL;
+    }
+    return data;
+}
+
+/// Check whether the active window is in fullscreen mode, according to the
+/// hints set by EWMH compliant window managers
+bool WTIdleMonitor::Fullscreen() {
+    if (!m_open) {
+        return false;
+    }
+    Display* dpy = (Display*)m_display;
+    unsigned long count;
+    unsigned char* data = get_property(dpy, DefaultRootWindow(dpy), m_atomActive,
+                                       XA_WINDOW, count);
+    if (!data) {
+        return false;
+    }
+    Window active = count > 0 ? (Window)((unsigned long*)data)[0] : None;
+    XFree(data);
+    if (active == None) {
+        return false;
+    }
+    data = get_property(dpy, active, m_atomState, XA_ATOM, count);
+    if (!data) {
+        return false;
+    }
+    bool fullscreen = false;
+    for (unsigned long i = 0; i < count; i++) {
+        if (((unsigned long*)data)[i] == m_atomFullscreen) {
+            fullscreen = true;
+        }
+    }
+    XFree(data);
+    return fullscreen;
+}
+
+#elif defined(_WIN32)
+
+WTIdleMonitor::WTIdleMonitor() : m_open(false) { }
+
+/// Nothing has to be opened on Windows
+bool WTIdleMonitor::Open() {
+    m_open = true;
+    return true;
+}
+
+void WTIdleMonitor::Close() {
+    m_open = false;
+}
+
+/// Milliseconds since the last input event in the session: the tick count
+/// wraps around after 49 days, which the unsigned difference takes into
+/// account
+bool WTIdleMonitor::IdleMillis(unsigned long& ms) {
+    LASTINPUTINFO lii;
+    lii.cbSize = sizeof(lii);
+    if (!GetLastInputInfo(&lii)) {
+        return false;
+    }
+    ms = (unsigned long)(GetTickCount() - lii.dwTime);
+    return true;
+}
+
+/// Check whether a fullscreen application or a presentation is running
+bool WTIdleMonitor::Fullscreen() {
+    QUERY_USER_NOTIFICATION_STATE state;
+    if (SHQueryUserNotificationState(&state) != S_OK) {
+        return false;
+    }
+    return state == QUNS_BUSY || state == QUNS_RUNNING_D3D_FULL_SCREEN
+        || state == QUNS_PRESENTATION_MODE;
+}
+
+#else
+
+WTIdleMonitor::WTIdleMonitor() : m_open(false) { }
+
+/// Idle time is not available on this platform
+bool WTIdleMonitor::Open() {
+    return false;
+}
+
+void WTIdleMonitor::Close() { }
+
+bool WTIdleMonitor::IdleMillis(unsigned long& ms) {
+    (void)ms;
+    return false;
+}
+
+bool WTIdleMonitor::Fullscreen() {
+    return false;
+}
+
+#endif
+
+/// Destructor: the connection to the display, if any, is released
+WTIdleMonitor::~WTIdleMonitor() {
+    Close();
+}
+
+/// Tell whether idle times can be queried
+bool WTIdleMonitor::IsOpen() const {
+    return m_open;
+}
+
+
+// end.
@@ -0,0 +1,49 @@
+/// whenever_tray
+///
+/// Activity of the user in the desktop session: the time since the last
+/// input is read from the XScreenSaver extension on X11 (when built with
+/// it) and from GetLastInputInfo on Windows, and an application is in
+/// fullscreen mode when the active window has the EWMH fullscreen state or,
+/// on Windows, when the shell reports a fullscreen or presentation mode.
+/// This module does not depend on wxWidgets.
+
+#ifndef WT_IDLE_H
+#define WT_IDLE_H
+
+#if defined(WT_HAVE_XSS) || defined(_WIN32)
+#define WT_IDLE_SUPPORTED
+#endif
+
+// Query the idle time of the session: the connection to the display is
+// opened once and kept, since every query is a single round trip
+class WTIdleMonitor {
+public:
+    WTIdleMonitor();
+    ~WTIdleMonitor();
+
+    bool Open();
+    void Close();
+    bool IsOpen() const;
+
+    bool IdleMillis(unsigned long& ms);
+    bool Fullscreen();
+
+private:
+    // not copyable
+    WTIdleMonitor(const WTIdleMonitor&);
+    WTIdleMonitor& operator=(const WTIdleMonitor&);
+
+#ifdef WT_HAVE_XSS
+    // Xlib types are kept opaque, since its headers define macros (such as
+    // Bool, Status and None) that clash with wxWidgets
+    void* m_display;
+    void* m_info;
+    unsigned long m_atomActive, m_atomState, m_atomFullscreen;
+#endif
+    bool m_open;
+};
+
+
+#endif // WT_IDLE_H
+
+// end.
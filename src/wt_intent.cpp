@@ -0,0 +1,114 @@
+/// whenever_tray
+///
+/// Journal of the intended state of the scheduler.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "wt_intent.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// first line of the journal, identifying its format
+#define INTENT_HEADER "whenever_tray intent 1"
+#define INTENT_TMP_SUFFIX ".tmp"
+
+
+// ============================================================================
+// WTIntentJournal: implementation
+// ============================================================================
+
+/// Read the journal: every line holds a key and a value separated by a
+/// space, and the file is only accepted if it starts with the header and
+/// ends with the `end` marker
+bool WTIntentJournal::Load(WTIntent& intent) const {
+    intent = WTIntent();
+    if (m_path.empty()) {
+        return false;
+    }
+    FILE* f = fopen(m_path.c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    WTIntent read;
+    bool header = false, complete = false;
+    char line[WT_INTENT_REASON_MAX + 32];
+    while (!complete && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = 0;
+        char* value = strchr(line, ' ');
+        if (value) {
+            *value++ = 0;
+        }
+        if (!header) {
+            header = value && strcmp(line, "whenever_tray") == 0
+                && strcmp(value, INTENT_HEADER + strlen("whenever_tray ")) == 0;
+            if (!header) {
+                break;
+            }
+        } else if (strcmp(line, "end") == 0) {
+            complete = true;
+        } else if (value && strcmp(line, "state") == 0) {
+            read.paused = strcmp(value, "paused") == 0;
+        } else if (value && strcmp(line, "reason") == 0) {
+            read.reason = value;
+        } else if (value && strcmp(line, "set_at") == 0) {
+            read.set_at = strtoll(value, NULL, 10);
+        } else if (value && strcmp(line, "expires_at") == 0) {
+            read.expires_at = strtoll(value, NULL, 10);
+        }
+    }
+    fclose(f);
+    if (!complete) {
+        return false;
+    }
+    intent = read;
+    return true;
+}
+
+/// Write the journal to a temporary file, flushed to disk, which is then
+/// renamed over the previous one
+bool WTIntentJournal::Save(const WTIntent& intent) const {
+    if (m_path.empty()) {
+        return false;
+    }
+    std::string tmp = m_path + INTENT_TMP_SUFFIX;
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    // the reason is kept on a single line of limited length
+    std::string reason = intent.reason.substr(0, WT_INTENT_REASON_MAX);
+    for (size_t i = 0; i < reason.size(); i++) {
+        if (reason[i] == '\n' || reason[i] == '\r') {
+            reason[i] = ' ';
+        }
+    }
+    bool ok = fprintf(f, INTENT_HEADER "\n"
+                      "state %s\n"
+                      "reason %s\n"
+                      "set_at %lld\n"
+                      "expires_at %lld\n"
+                      "end\n",
+                      intent.paused ? "paused" : "running", reason.c_str(),
+                      intent.set_at, intent.expires_at) > 0;
+    ok = fflush(f) == 0 && ok;
+#ifndef _WIN32
+    ok = fsync(fileno(f)) == 0 && ok;
+#endif
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        remove(tmp.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    remove(m_path.c_str());
+#endif
+    return rename(tmp.c_str(), m_path.c_str()) == 0;
+}
+
+
+// end.
@@ -0,0 +1,53 @@
+/// whenever_tray
+///
+/// Journal of the state the user wants the scheduler to be in: a pause
+/// requested from the tray is recorded, together with its reason and an
+/// optional expiry, in a small text file that survives restarts of both
+/// the scheduler and the tray. The file is replaced atomically, so that a
+/// crash while writing leaves either the old or the new intent.
+
+#ifndef WT_INTENT_H
+#define WT_INTENT_H
+
+#include <string>
+
+// maximum length of the reason stored with an intent
+#define WT_INTENT_REASON_MAX 64
+
+// Intended state of the scheduler, with timestamps in milliseconds since
+// the epoch (UTC): an expiry of zero means that the intent never expires
+struct WTIntent {
+    WTIntent() : paused(false), set_at(0), expires_at(0) { }
+
+    bool paused;
+    std::string reason;
+    long long set_at;
+    long long expires_at;
+
+    bool Expired(long long now) const {
+        return expires_at != 0 && now >= expires_at;
+    }
+};
+
+// The journal file holding the intent
+class WTIntentJournal {
+public:
+    void SetPath(const std::string& path) {
+        m_path = path;
+    }
+
+    // load the intent: false if the file is missing or not valid, in
+    // which case the intent is left to its default (running)
+    bool Load(WTIntent& intent) const;
+
+    // replace the journal with the given intent
+    bool Save(const WTIntent& intent) const;
+
+private:
+    std::string m_path;
+};
+
+
+#endif // WT_INTENT_H
+
+// end.
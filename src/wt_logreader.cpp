@@ -0,0 +1,292 @@
+/// whenever_tray
+///
+/// Reading of the scheduler log across rotations and compressed segments.
+
+#include <cstdio>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "wt_logreader.h"
+
+#ifdef _WIN32
+#define LOGREADER_FSEEK _fseeki64
+#else
+#define LOGREADER_FSEEK fseeko
+#endif
+
+// size of the buffers used for reading files and streams
+#define LOGREADER_BUFFER (64 * 1024)
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+// Forwards the lines within a time range: lines without a timestamp, such
+// as the continuation of a multi-line message, follow the previous line
+class WTRangeSink : public WTLineSink {
+public:
+    WTRangeSink(long long from, long long to, WTLineSink* sink)
+        : m_from(from), m_to(to), m_sink(sink), m_inRange(false) { }
+
+    virtual void OnLine(WTOutputStream stream, const char* line, size_t len) {
+        const char* close = len > 1 && line[0] == '[' ?
+            (const char*)memchr(line, ']', len) : NULL;
+        long long ts;
+        if (close && WTParseTimestamp(line + 1, close - line - 1, ts)) {
+            m_inRange = ts >= m_from && ts <= m_to;
+        }
+        if (m_inRange) {
+            m_sink->OnLine(stream, line, len);
+        }
+    }
+    // a gap in the stream, such as a skipped block, breaks continuations
+    void Skip() {
+        m_inRange = false;
+    }
+
+private:
+    long long m_from;
+    long long m_to;
+    WTLineSink* m_sink;
+    bool m_inRange;
+};
+
+// check whether a path ends with a suffix
+static bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// decompress a whole gzip member held in memory
+static bool inflate_block(const std::vector<unsigned char>& in, std::string& out, size_t usize) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        return false;
+    }
+    out.resize(usize);
+    zs.next_in = (Bytef*)&in[0];
+    zs.avail_in = (uInt)in.size();
+    zs.next_out = (Bytef*)(usize > 0 ? &out[0] : NULL);
+    zs.avail_out = (uInt)usize;
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END && zs.avail_out == 0;
+}
+
+
+// ============================================================================
+// WTLogReader: implementation
+// ============================================================================
+
+WTLogReader::WTLogReader() {
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_cacheSize = 0;
+    m_cacheLimit = WT_LOG_CACHE_DEFAULT;
+}
+
+/// Set the size of the cache, discarding the blocks that do not fit
+void WTLogReader::SetCacheSize(size_t bytes) {
+    m_cacheLimit = bytes;
+    while (m_cacheSize > m_cacheLimit && !m_cache.empty()) {
+        m_cacheSize -= m_cache.back().second.size();
+        m_cacheIndex.erase(m_cache.back().first);
+        m_cache.pop_back();
+    }
+}
+
+/// Read the segments from the oldest one, then the live log: a segment
+/// that disappears while reading, because it was compressed or pruned in
+/// the meanwhile, is looked for again in its compressed form, while a
+/// compressed segment that cannot be read is a failure
+bool WTLogReader::Read(long long from, long long to, WTLineSink* sink) {
+    std::vector<std::string> segments;
+    WTListLogSegments(m_path, segments);
+    bool ok = true;
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (ReadSegment(segments[i], from, to, sink)) {
+            continue;
+        }
+        if (ends_with(segments[i], WT_LOG_GZ_SUFFIX)) {
+            ok = false;
+        } else {
+            ok = ReadSegment(segments[i] + WT_LOG_GZ_SUFFIX, from, to, sink) && ok;
+        }
+    }
+    ReadSegment(m_path, from, to, sink);
+    return ok;
+}
+
+/// Read a single segment, compressed or not, or the live log
+bool WTLogReader::ReadSegment(const std::string& path, long long from, long long to,
+                              WTLineSink* sink) {
+    WTRangeSink range(from, to, sink);
+    WTLineSplitter splitter(WT_STREAM_STDOUT, &range);
+    bool ok;
+    if (!ends_with(path, WT_LOG_GZ_SUFFIX)) {
+        ok = ReadPlain(path, splitter);
+    } else {
+        std::vector<WTLogBlock> blocks, selected;
+        if (WTReadLogIndex(WTLogIndexPath(path), blocks)) {
+            // blocks whose lines could not be dated are always read
+            for (size_t b = 0; b < blocks.size(); b++) {
+                if (WTLogBlockOutside(blocks[b], from, to)) {
+                    m_stats.blocks_skipped++;
+                } else {
+                    selected.push_back(blocks[b]);
+                }
+            }
+            ok = ReadIndexed(path, selected, splitter, range);
+        } else {
+            ok = ReadCompressed(path, splitter);
+        }
+    }
+    splitter.Flush();
+    return ok;
+}
+
+/// Read the given blocks of an indexed segment
+bool WTLogReader::ReadBlocks(const std::string& path, const std::vector<WTLogBlock>& blocks,
+                             long long from, long long to, WTLineSink* sink) {
+    WTRangeSink range(from, to, sink);
+    WTLineSplitter splitter(WT_STREAM_STDOUT, &range);
+    bool ok = ReadIndexed(path, blocks, splitter, range);
+    splitter.Flush();
+    return ok;
+}
+
+/// Deliver the selected blocks of an indexed segment, from the cache when
+/// possible: non adjacent blocks break the continuation of lines
+bool WTLogReader::ReadIndexed(const std::string& path, const std::vector<WTLogBlock>& blocks,
+                              WTLineSplitter& splitter, WTRangeSink& range) {
+    if (blocks.empty()) {
+        return true;
+    }
+    FILE* f = NULL;
+    std::vector<unsigned char> in;
+    bool ok = true;
+    unsigned long long next = 0;
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const WTLogBlock& block = blocks[b];
+        char offset[32];
+        snprintf(offset, sizeof(offset), "@%llu", block.coffset);
+        std::string key = path + offset;
+        const std::string* data = CachedBlock(key);
+        if (data) {
+            m_stats.blocks_cached++;
+        } else {
+            if (!f && !(f = fopen(path.c_str(), "rb"))) {
+                return false;
+            }
+            std::string out;
+            in.resize(block.csize);
+            if (block.csize == 0
+                || LOGREADER_FSEEK(f, block.coffset, SEEK_SET) != 0
+                || fread(&in[0], 1, in.size(), f) != in.size()
+                || !inflate_block(in, out, block.usize)) {
+                ok = false;
+                continue;
+            }
+            m_stats.blocks_read++;
+            data = StoreBlock(key, out);
+        }
+        if (b > 0 && block.uoffset != next) {
+            splitter.Flush();
+            range.Skip();
+        }
+        splitter.Feed(data->data(), data->size());
+        next = block.uoffset + block.usize;
+    }
+    if (f) {
+        fclose(f);
+    }
+    return ok;
+}
+
+/// Decompress a segment without index as a stream of gzip members
+bool WTLogReader::ReadCompressed(const std::string& path, WTLineSplitter& splitter) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        fclose(f);
+        return false;
+    }
+    std::vector<unsigned char> ibuf(LOGREADER_BUFFER), obuf(LOGREADER_BUFFER);
+    int ret = Z_OK;
+    bool ended = false;
+    size_t n;
+    while (ret != Z_DATA_ERROR && (n = fread(&ibuf[0], 1, ibuf.size(), f)) > 0) {
+        zs.next_in = &ibuf[0];
+        zs.avail_in = (uInt)n;
+        do {
+            zs.next_out = &obuf[0];
+            zs.avail_out = (uInt)obuf.size();
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                ret = Z_DATA_ERROR;
+                break;
+            }
+            splitter.Feed((const char*)&obuf[0], obuf.size() - zs.avail_out);
+            if (ret == Z_STREAM_END) {
+                inflateReset(&zs);
+                ended = true;
+            } else if (ret == Z_OK) {
+                ended = false;
+            }
+        } while (zs.avail_in > 0 || zs.avail_out == 0);
+    }
+    inflateEnd(&zs);
+    fclose(f);
+    return ended && ret != Z_DATA_ERROR;
+}
+
+/// Read an uncompressed segment, or the live log
+bool WTLogReader::ReadPlain(const std::string& path, WTLineSplitter& splitter) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    std::vector<char> buf(LOGREADER_BUFFER);
+    size_t n;
+    while ((n = fread(&buf[0], 1, buf.size(), f)) > 0) {
+        splitter.Feed(&buf[0], n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+/// Look for a block in the cache, moving it to the front
+const std::string* WTLogReader::CachedBlock(const std::string& key) {
+    std::map<std::string, std::list<CacheEntry>::iterator>::iterator it = m_cacheIndex.find(key);
+    if (it == m_cacheIndex.end()) {
+        return NULL;
+    }
+    m_cache.splice(m_cache.begin(), m_cache, it->second);
+    return &it->second->second;
+}
+
+/// Store a block in the cache, taking its data and evicting the least
+/// recently used blocks: a block larger than the cache is still returned,
+/// and is the first to go
+const std::string* WTLogReader::StoreBlock(const std::string& key, std::string& data) {
+    m_cache.push_front(CacheEntry(key, std::string()));
+    m_cache.front().second.swap(data);
+    m_cacheIndex[key] = m_cache.begin();
+    m_cacheSize += m_cache.front().second.size();
+    while (m_cacheSize > m_cacheLimit && m_cache.size() > 1) {
+        m_cacheSize -= m_cache.back().second.size();
+        m_cacheIndex.erase(m_cache.back().first);
+        m_cache.pop_back();
+    }
+    return &m_cache.front().second;
+}
+
+
+// end.
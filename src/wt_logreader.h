@@ -0,0 +1,86 @@
+/// whenever_tray
+///
+/// Reading of the scheduler log across rotations: the rotated segments and
+/// the live log are presented as a single stream of lines, oldest first.
+/// Compressed segments are decompressed on demand: when their index is
+/// available only the blocks whose time range overlaps the requested one
+/// are decompressed, and recently used blocks are kept in a cache bounded
+/// by size, so that queries about close times do not decompress the same
+/// blocks again; compressed segments without an index are decompressed as
+/// a stream, with fixed buffers.
+///
+/// Lines are delivered through a WTLineSink, as the output of the scheduler,
+/// and lines without a timestamp are kept with the line they follow. This
+/// module does not depend on wxWidgets.
+
+#ifndef WT_LOGREADER_H
+#define WT_LOGREADER_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "wt_output.h"
+#include "wt_logrotate.h"
+
+// default size of the cache of decompressed blocks
+#define WT_LOG_CACHE_DEFAULT (8 * 1024 * 1024)
+
+// Figures about the work done by a reader
+struct WTLogReaderStats {
+    unsigned long long blocks_read;         // blocks decompressed
+    unsigned long long blocks_cached;       // blocks found in the cache
+    unsigned long long blocks_skipped;      // blocks outside the range
+};
+
+// forward declarations
+class WTRangeSink;
+
+// Reader of a log and of its rotated segments
+class WTLogReader {
+public:
+    WTLogReader();
+
+    void SetPath(const std::string& log_path) {
+        m_path = log_path;
+    }
+    void SetCacheSize(size_t bytes);
+
+    // deliver the lines whose timestamp, in the WTLogRecord convention, is
+    // within [from, to]: return false if a segment could not be read
+    bool Read(long long from, long long to, WTLineSink* sink);
+
+    // the same, for a single segment or for some blocks of an indexed one
+    bool ReadSegment(const std::string& path, long long from, long long to, WTLineSink* sink);
+    bool ReadBlocks(const std::string& path, const std::vector<WTLogBlock>& blocks,
+                    long long from, long long to, WTLineSink* sink);
+
+    const WTLogReaderStats& Stats() const {
+        return m_stats;
+    }
+
+private:
+    bool ReadIndexed(const std::string& path, const std::vector<WTLogBlock>& blocks,
+                     WTLineSplitter& splitter, WTRangeSink& range);
+    bool ReadCompressed(const std::string& path, WTLineSplitter& splitter);
+    bool ReadPlain(const std::string& path, WTLineSplitter& splitter);
+    const std::string* CachedBlock(const std::string& key);
+    const std::string* StoreBlock(const std::string& key, std::string& data);
+
+    std::string m_path;
+    WTLogReaderStats m_stats;
+
+    // bounded cache of decompressed blocks: the most recently used block is
+    // at the front of the list, and the map points into the list
+    typedef std::pair<std::string, std::string> CacheEntry;
+    std::list<CacheEntry> m_cache;
+    std::map<std::string, std::list<CacheEntry>::iterator> m_cacheIndex;
+    size_t m_cacheSize;
+    size_t m_cacheLimit;
+};
+
+
+#endif // WT_LOGREADER_H
+
+// end.
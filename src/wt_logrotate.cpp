@@ -0,0 +1,504 @@
+/// whenever_tray
+///
+/// Rotation and background compression of the scheduler log.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "wt_logrotate.h"
+#include "wt_output.h"
+#include "wt_sysinfo.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+// size of the buffers used for reading the log and writing the segment
+#define LOGROTATE_BUFFER (64 * 1024)
+
+// zlib memory level: 8 is the zlib default, and needs about 256 KiB of
+// compressor state besides the window
+#define LOGROTATE_MEMLEVEL 8
+
+// length of the timestamp appended to segment names: YYYYMMDD-HHMMSS
+#define LOGROTATE_STAMP_LEN 15
+
+// header and trailer of index files
+#define LOGROTATE_INDEX_HEADER "whenever_tray index 1"
+#define LOGROTATE_INDEX_END "end"
+
+// ioprio_set arguments, not exposed by the C library
+#define LOGROTATE_IOPRIO_WHO_PROCESS 1
+#define LOGROTATE_IOPRIO_CLASS_IDLE 3
+#define LOGROTATE_IOPRIO_CLASS_SHIFT 13
+
+
+// ----------------------------------------------------------------------------
+// compression
+// ----------------------------------------------------------------------------
+
+// Collects the beginning of each line, so that the timestamps of the first
+// and the last line of a block are known also when lines span buffers
+class WTLineHeads {
+public:
+    WTLineHeads() : m_len(0), m_atStart(true) { }
+
+    void Feed(const unsigned char* data, size_t len, WTLogBlock& block) {
+        const unsigned char* end = data + len;
+        while (data < end) {
+            if (m_atStart && m_len < sizeof(m_head)) {
+                size_t n = std::min((size_t)(end - data), sizeof(m_head) - m_len);
+                const unsigned char* nl = (const unsigned char*)memchr(data, '\n', n);
+                if (nl) {
+                    n = nl - data;
+                }
+                memcpy(m_head + m_len, data, n);
+                m_len += n;
+                if (m_len == sizeof(m_head) || nl) {
+                    Parse(block);
+                }
+            }
+            const unsigned char* nl = (const unsigned char*)memchr(data, '\n', end - data);
+            if (!nl) {
+                break;
+            }
+            data = nl + 1;
+            m_len = 0;
+            m_atStart = true;
+        }
+    }
+
+private:
+    void Parse(WTLogBlock& block) {
+        m_atStart = false;
+        const char* close = (const char*)memchr(m_head, ']', m_len);
+        long long ts;
+        if (m_len > 1 && m_head[0] == '[' && close
+            && WTParseTimestamp(m_head + 1, close - m_head - 1, ts)) {
+            if (block.first_ts == 0) {
+                block.first_ts = ts;
+            }
+            block.last_ts = ts;
+        }
+    }
+
+    char m_head[48];
+    size_t m_len;
+    bool m_atStart;
+};
+
+// deflate data, writing the output: with Z_FINISH the gzip member is
+// completed, and the compressor is ready for the next one
+static bool deflate_to(z_stream& zs, const unsigned char* data, size_t len, int flush,
+                       unsigned char* obuf, FILE* out, unsigned long long& written) {
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = (uInt)len;
+    int ret;
+    do {
+        zs.next_out = obuf;
+        zs.avail_out = LOGROTATE_BUFFER;
+        ret = deflate(&zs, flush);
+        if (ret == Z_STREAM_ERROR) {
+            return false;
+        }
+        size_t produced = LOGROTATE_BUFFER - zs.avail_out;
+        if (produced > 0 && fwrite(obuf, 1, produced, out) != produced) {
+            return false;
+        }
+        written += produced;
+    } while (zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    if (flush == Z_FINISH) {
+        deflateReset(&zs);
+    }
+    return true;
+}
+
+/// Compress a segment into a multi-member gzip file and write its index:
+/// both are written to temporary files and renamed, and the segment is only
+/// removed once the compressed copy is complete
+bool WTCompressLogSegment(const std::string& path, int level, WTCompressStats& stats) {
+    long long started = WTMonotonicMillis();
+    std::string gz = path + WT_LOG_GZ_SUFFIX;
+    std::string gz_tmp = gz + ".tmp";
+    stats.bytes_in = stats.bytes_out = 0;
+    stats.seconds = 0;
+
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    FILE* out = fopen(gz_tmp.c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, LOGROTATE_MEMLEVEL,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        fclose(in);
+        fclose(out);
+        remove(gz_tmp.c_str());
+        return false;
+    }
+
+    std::vector<unsigned char> ibuf(LOGROTATE_BUFFER), obuf(LOGROTATE_BUFFER);
+    std::vector<WTLogBlock> blocks;
+    WTLogBlock cur;
+    memset(&cur, 0, sizeof(cur));
+    WTLineHeads heads;
+    bool ok = true;
+    size_t n;
+    while (ok && (n = fread(&ibuf[0], 1, ibuf.size(), in)) > 0) {
+        size_t pos = 0;
+        while (ok && pos < n) {
+            // a block ends at the first newline past WT_LOG_BLOCK bytes
+            size_t take = n - pos;
+            bool finish = false;
+            if (cur.usize + take >= WT_LOG_BLOCK) {
+                size_t from = cur.usize >= WT_LOG_BLOCK ? 0 : WT_LOG_BLOCK - cur.usize;
+                const unsigned char* nl =
+                    (const unsigned char*)memchr(&ibuf[pos + from], '\n', take - from);
+                if (nl) {
+                    take = nl - &ibuf[pos] + 1;
+                    finish = true;
+                }
+            }
+            heads.Feed(&ibuf[pos], take, cur);
+            ok = deflate_to(zs, &ibuf[pos], take, finish ? Z_FINISH : Z_NO_FLUSH,
+                            &obuf[0], out, cur.csize);
+            cur.usize += take;
+            pos += take;
+            if (finish) {
+                blocks.push_back(cur);
+                WTLogBlock next;
+                memset(&next, 0, sizeof(next));
+                next.coffset = cur.coffset + cur.csize;
+                next.uoffset = cur.uoffset + cur.usize;
+                cur = next;
+            }
+        }
+    }
+    ok = ok && !ferror(in);
+    if (ok && (cur.usize > 0 || blocks.empty())) {
+        ok = deflate_to(zs, NULL, 0, Z_FINISH, &obuf[0], out, cur.csize);
+        blocks.push_back(cur);
+    }
+    deflateEnd(&zs);
+    fclose(in);
+    ok = fflush(out) == 0 && ok;
+#if !defined(_WIN32)
+    ok = ok && fsync(fileno(out)) == 0;
+#endif
+    ok = fclose(out) == 0 && ok;
+
+    if (ok && WTWriteLogIndex(WTLogIndexPath(path), blocks)
+        && rename(gz_tmp.c_str(), gz.c_str()) == 0) {
+        const WTLogBlock& last = blocks.back();
+        stats.bytes_in = last.uoffset + last.usize;
+        stats.bytes_out = last.coffset + last.csize;
+        stats.seconds = (WTMonotonicMillis() - started) / 1000.0;
+        remove(path.c_str());
+        return true;
+    }
+    remove(gz_tmp.c_str());
+    return false;
+}
+
+/// Write the index of a compressed segment, through a temporary file
+bool WTWriteLogIndex(const std::string& path, const std::vector<WTLogBlock>& blocks) {
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    bool ok = fprintf(f, "%s\n", LOGROTATE_INDEX_HEADER) > 0;
+    for (size_t i = 0; ok && i < blocks.size(); i++) {
+        const WTLogBlock& b = blocks[i];
+        ok = fprintf(f, "block %llu %llu %llu %llu %lld %lld\n",
+                     b.coffset, b.csize, b.uoffset, b.usize, b.first_ts, b.last_ts) > 0;
+    }
+    ok = ok && fprintf(f, "%s\n", LOGROTATE_INDEX_END) > 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Read the index of a compressed segment: an index without its trailer is
+/// incomplete, and is rejected
+bool WTReadLogIndex(const std::string& path, std::vector<WTLogBlock>& blocks) {
+    blocks.clear();
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    char line[256];
+    bool complete = false;
+    if (fgets(line, sizeof(line), f) && strncmp(line, LOGROTATE_INDEX_HEADER,
+                                                 strlen(LOGROTATE_INDEX_HEADER)) == 0) {
+        while (fgets(line, sizeof(line), f)) {
+            WTLogBlock b;
+            if (sscanf(line, "block %llu %llu %llu %llu %lld %lld", &b.coffset, &b.csize,
+                       &b.uoffset, &b.usize, &b.first_ts, &b.last_ts) == 6) {
+                blocks.push_back(b);
+            } else if (strncmp(line, LOGROTATE_INDEX_END, strlen(LOGROTATE_INDEX_END)) == 0) {
+                complete = true;
+                break;
+            }
+        }
+    }
+    fclose(f);
+    if (!complete) {
+        blocks.clear();
+    }
+    return complete;
+}
+
+
+/// Path of the index of a segment, compressed or not
+std::string WTLogIndexPath(const std::string& segment) {
+    std::string index = segment;
+    size_t gz = strlen(WT_LOG_GZ_SUFFIX);
+    if (index.size() > gz && index.compare(index.size() - gz, gz, WT_LOG_GZ_SUFFIX) == 0) {
+        index.erase(index.size() - gz);
+    }
+    return index + WT_LOG_INDEX_SUFFIX;
+}
+
+// check whether the lines of a block could be dated, in order
+static bool block_dated(const WTLogBlock& block) {
+    return block.first_ts != 0 && block.last_ts != 0 && block.first_ts <= block.last_ts;
+}
+
+/// Check whether all the lines of a block are within a time range
+bool WTLogBlockInside(const WTLogBlock& block, long long from, long long to) {
+    return block_dated(block) && block.first_ts >= from && block.last_ts <= to;
+}
+
+/// Check whether no line of a block is within a time range
+bool WTLogBlockOutside(const WTLogBlock& block, long long from, long long to) {
+    return block_dated(block) && (block.last_ts < from || block.first_ts > to);
+}
+
+
+// ----------------------------------------------------------------------------
+// segments
+// ----------------------------------------------------------------------------
+
+/// Name of the segment a log is renamed to when rotated at the given time
+std::string WTLogSegmentName(const std::string& log_path, time_t when) {
+    struct tm t;
+#ifdef _WIN32
+    localtime_s(&t, &when);
+#else
+    localtime_r(&when, &t);
+#endif
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &t);
+    return log_path + "." + stamp;
+}
+
+/// Time of the rotation that produced a segment, from its name
+bool WTLogSegmentTime(const std::string& segment, time_t& when) {
+    std::string name = segment;
+    size_t gz = strlen(WT_LOG_GZ_SUFFIX);
+    if (name.size() > gz && name.compare(name.size() - gz, gz, WT_LOG_GZ_SUFFIX) == 0) {
+        name.erase(name.size() - gz);
+    }
+    if (name.size() < LOGROTATE_STAMP_LEN) {
+        return false;
+    }
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    const char* stamp = name.c_str() + name.size() - LOGROTATE_STAMP_LEN;
+    if (sscanf(stamp, "%4d%2d%2d-%2d%2d%2d", &t.tm_year, &t.tm_mon, &t.tm_mday,
+               &t.tm_hour, &t.tm_min, &t.tm_sec) != 6) {
+        return false;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    t.tm_isdst = -1;
+    when = mktime(&t);
+    return when != (time_t)-1;
+}
+
+// check whether a file name is the one of a segment of the log
+static bool is_segment_name(const std::string& name, const std::string& base) {
+    if (name.size() < base.size() + 1 + LOGROTATE_STAMP_LEN
+        || name.compare(0, base.size() + 1, base + ".") != 0) {
+        return false;
+    }
+    std::string rest = name.substr(base.size() + 1);
+    if (rest.size() != LOGROTATE_STAMP_LEN && rest.substr(LOGROTATE_STAMP_LEN) != WT_LOG_GZ_SUFFIX) {
+        return false;
+    }
+    for (int i = 0; i < LOGROTATE_STAMP_LEN; i++) {
+        if (i == 8 ? rest[i] != '-' : (rest[i] < '0' || rest[i] > '9')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// List the segments of a log, compressed or not, oldest first: since names
+/// carry the time of the rotation, the order of names is the order in time.
+/// A segment is briefly present along with its compressed copy, which sorts
+/// right after it: only the compressed copy, which is complete, is listed
+void WTListLogSegments(const std::string& log_path, std::vector<std::string>& segments) {
+    segments.clear();
+    size_t sep = log_path.find_last_of("/\\");
+    std::string dir = sep == std::string::npos ? "." : log_path.substr(0, sep);
+    std::string base = sep == std::string::npos ? log_path : log_path.substr(sep + 1);
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA((log_path + ".*").c_str(), &fd);
+    if (h == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (is_segment_name(fd.cFileName, base)) {
+            segments.push_back(dir + "\\" + fd.cFileName);
+        }
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (is_segment_name(e->d_name, base)) {
+            segments.push_back(dir + "/" + e->d_name);
+        }
+    }
+    closedir(d);
+#endif
+    std::sort(segments.begin(), segments.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (i + 1 < segments.size() && segments[i + 1] == segments[i] + WT_LOG_GZ_SUFFIX) {
+            continue;
+        }
+        segments[kept++] = segments[i];
+    }
+    segments.resize(kept);
+}
+
+/// Remove the oldest segments so that at most keep of them are left, with
+/// their indexes: return the number of segments removed
+int WTPruneLogSegments(const std::string& log_path, int keep) {
+    std::vector<std::string> segments;
+    WTListLogSegments(log_path, segments);
+    int removed = 0;
+    for (size_t i = 0; keep >= 0 && i + keep < segments.size(); i++) {
+        if (remove(segments[i].c_str()) == 0) {
+            remove(WTLogIndexPath(segments[i]).c_str());
+            removed++;
+        }
+    }
+    return removed;
+}
+
+
+// ============================================================================
+// WTLogCompressor: implementation
+// ============================================================================
+
+WTLogCompressor::WTLogCompressor() {
+    m_level = Z_DEFAULT_COMPRESSION;
+    m_keep = 0;
+    m_listener = NULL;
+    m_stop = false;
+}
+
+WTLogCompressor::~WTLogCompressor() {
+    Stop();
+}
+
+/// Start the compressor thread
+bool WTLogCompressor::Start(int level, WTCompressListener* listener) {
+    if (m_thread.joinable()) {
+        return true;
+    }
+    m_level = level;
+    m_listener = listener;
+    m_stop = false;
+    m_thread = std::thread(&WTLogCompressor::Run, this);
+    return true;
+}
+
+/// Stop the thread: a compression in progress is completed first, while
+/// the queued segments are left uncompressed, to be queued again later
+void WTLogCompressor::Stop() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+}
+
+/// Queue a segment for compression
+void WTLogCompressor::Enqueue(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(path);
+    }
+    m_cond.notify_all();
+}
+
+/// Compress the queued segments: the thread runs at the lowest CPU priority
+/// and, on Linux, in the idle I/O class, so that it only uses the disk when
+/// nothing else does. Pruning waits for an empty queue, since segments are
+/// queued oldest first and the oldest are the ones removed
+void WTLogCompressor::Run() {
+#if defined(__linux__)
+    long tid = syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, (id_t)tid, 19);
+    syscall(SYS_ioprio_set, LOGROTATE_IOPRIO_WHO_PROCESS, tid,
+            LOGROTATE_IOPRIO_CLASS_IDLE << LOGROTATE_IOPRIO_CLASS_SHIFT);
+#elif defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        while (!m_stop && m_queue.empty()) {
+            m_cond.wait(lock);
+        }
+        if (m_stop) {
+            break;
+        }
+        std::string path = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+        WTCompressStats stats;
+        bool ok = WTCompressLogSegment(path, m_level, stats);
+        m_listener->OnSegmentCompressed(path, ok, stats);
+        lock.lock();
+        if (m_queue.empty() && !m_logPath.empty()) {
+            lock.unlock();
+            WTPruneLogSegments(m_logPath, m_keep);
+            lock.lock();
+        }
+    }
+}
+
+
+// end.
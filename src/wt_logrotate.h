@@ -0,0 +1,119 @@
+/// whenever_tray
+///
+/// Rotation of the scheduler log: the log is renamed to a segment whose
+/// name carries the time of the rotation, as in whenever.log.20240131-123456,
+/// and the segment is compressed in a background thread. Compressed segments
+/// are gzip files made of independent members, one for each block of about
+/// WT_LOG_BLOCK bytes of log ending at a line boundary, so that any gzip
+/// tool can read them while a reader can also decompress a single block.
+/// The blocks are listed in an index file next to the segment, with their
+/// offsets and the timestamps of their first and last lines:
+///
+///     whenever_tray index 1
+///     block <coffset> <csize> <uoffset> <usize> <first_ts> <last_ts>
+///     ...
+///     end
+///
+/// Compression uses zlib with fixed buffers, so that its memory use does not
+/// depend on the size of the log. This module does not depend on wxWidgets.
+
+#ifndef WT_LOGROTATE_H
+#define WT_LOGROTATE_H
+
+#include <ctime>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// uncompressed size after which a block ends, at the next line boundary
+#define WT_LOG_BLOCK (1024 * 1024)
+
+// suffixes of compressed segments and of their indexes
+#define WT_LOG_GZ_SUFFIX ".gz"
+#define WT_LOG_INDEX_SUFFIX ".gz.idx"
+
+// A block of a compressed segment: timestamps are in milliseconds, as
+// returned by WTParseTimestamp, and are zero if no line could be parsed
+struct WTLogBlock {
+    unsigned long long coffset;
+    unsigned long long csize;
+    unsigned long long uoffset;
+    unsigned long long usize;
+    long long first_ts;
+    long long last_ts;
+};
+
+// Figures about a compression
+struct WTCompressStats {
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    double seconds;
+};
+
+// compress a segment into a gzip file with its index, removing the segment
+bool WTCompressLogSegment(const std::string& path, int level, WTCompressStats& stats);
+bool WTWriteLogIndex(const std::string& path, const std::vector<WTLogBlock>& blocks);
+bool WTReadLogIndex(const std::string& path, std::vector<WTLogBlock>& blocks);
+std::string WTLogIndexPath(const std::string& segment);
+
+// position of a block with respect to a time range: blocks whose lines
+// could not be dated are neither inside nor outside any range
+bool WTLogBlockInside(const WTLogBlock& block, long long from, long long to);
+bool WTLogBlockOutside(const WTLogBlock& block, long long from, long long to);
+
+// naming and listing of the segments of a log, oldest first: the names of
+// compressed segments include the WT_LOG_GZ_SUFFIX, and a segment whose
+// compressed copy is complete is only listed once, compressed
+std::string WTLogSegmentName(const std::string& log_path, time_t when);
+bool WTLogSegmentTime(const std::string& segment, time_t& when);
+void WTListLogSegments(const std::string& log_path, std::vector<std::string>& segments);
+int WTPruneLogSegments(const std::string& log_path, int keep);
+
+// Receiver of the completion of a compression: called from the compressor
+// thread, with the path of the uncompressed segment
+class WTCompressListener {
+public:
+    virtual ~WTCompressListener() { }
+    virtual void OnSegmentCompressed(const std::string& path, bool ok,
+                                     const WTCompressStats& stats) = 0;
+};
+
+// Background compressor: segments are compressed one at a time, in the
+// order they are queued, by a thread with low CPU and I/O priority; when
+// a log is given, its oldest segments are pruned each time the queue has
+// been emptied, so that no queued segment is ever removed
+class WTLogCompressor {
+public:
+    WTLogCompressor();
+    ~WTLogCompressor();
+
+    void SetPrune(const std::string& log_path, int keep) {
+        m_logPath = log_path;
+        m_keep = keep;
+    }
+
+    bool Start(int level, WTCompressListener* listener);
+    void Stop();
+    void Enqueue(const std::string& path);
+
+private:
+    void Run();
+
+    int m_level;
+    std::string m_logPath;
+    int m_keep;
+    WTCompressListener* m_listener;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::string> m_queue;
+    bool m_stop;
+};
+
+
+#endif // WT_LOGROTATE_H
+
+// end.
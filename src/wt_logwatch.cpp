@@ -0,0 +1,209 @@
+/// whenever_tray
+///
+/// Growth rate of the scheduler log, measured through inotify on Linux.
+
+#include <cstring>
+
+#include "wt_logwatch.h"
+#include "wt_sysinfo.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define WT_LOGWATCH_INOTIFY
+#endif
+
+// default window over which the rate is measured
+#define LOGWATCH_DEFAULT_WINDOW 10000   // milliseconds
+
+// minimum interval between measures, however often the log is written,
+// and interval between measures during a flood, to notice its end, or
+// while the rate decays after the log has stopped growing
+#define LOGWATCH_MIN_INTERVAL 250       // milliseconds
+#define LOGWATCH_FLOOD_INTERVAL 1000    // milliseconds
+
+
+// ============================================================================
+// WTLogWatcher: implementation
+// ============================================================================
+
+WTLogWatcher::WTLogWatcher() : m_rate(0) {
+    m_threshold = 0;
+    m_window = LOGWATCH_DEFAULT_WINDOW;
+    m_fd = -1;
+    m_listener = NULL;
+    m_written = 0;
+    m_size = -1;
+    m_flooding = false;
+    m_calmSince = 0;
+}
+
+WTLogWatcher::~WTLogWatcher() {
+    Stop();
+}
+
+/// Account for the bytes written since the previous measure and compute
+/// the rate over the window: a log that shrinks has been truncated or
+/// replaced, and all its contents count as written
+void WTLogWatcher::Measure(long long now, bool modified) {
+#ifdef WT_LOGWATCH_INOTIFY
+    if (modified) {
+        struct stat st;
+        long long size = stat(m_path.c_str(), &st) == 0 ? (long long)st.st_size : 0;
+        if (m_size >= 0) {
+            m_written += size >= m_size ? size - m_size : size;
+        }
+        m_size = size;
+    }
+#else
+    (void)modified;
+#endif
+
+    // the oldest sample kept is the last one preceding the window
+    m_samples.push_back(std::make_pair(now, m_written));
+    while (m_samples.size() > 2 && m_samples[1].first <= now - m_window) {
+        m_samples.pop_front();
+    }
+    long long span = now - m_samples.front().first;
+    if (span < m_window) {
+        span = m_window;
+    }
+    double rate = (double)(m_written - m_samples.front().second) * 1000.0 / (double)span;
+    m_rate.store(rate);
+
+    if (!m_flooding) {
+        if (rate > m_threshold) {
+            m_flooding = true;
+            m_calmSince = 0;
+            m_listener->OnLogFlood(true, rate);
+        }
+    } else if (rate >= m_threshold / 2) {
+        m_calmSince = 0;
+    } else if (m_calmSince == 0) {
+        m_calmSince = now;
+    } else if (now - m_calmSince >= m_window) {
+        m_flooding = false;
+        m_listener->OnLogFlood(false, rate);
+    }
+}
+
+#ifdef WT_LOGWATCH_INOTIFY
+
+/// Watch the directory of the log, so that the log is also followed when
+/// it does not exist yet, or when it is replaced
+bool WTLogWatcher::Start(WTLogRateListener* listener) {
+    if (m_poller.Running()) {
+        return true;
+    }
+    if (m_threshold <= 0 || m_path.empty()) {
+        return false;
+    }
+    size_t slash = m_path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : m_path.substr(0, slash);
+    m_name = slash == std::string::npos ? m_path : m_path.substr(slash + 1);
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0
+        || inotify_add_watch(m_fd, dir.c_str(),
+                             IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+        Stop();
+        return false;
+    }
+    struct stat st;
+    m_size = stat(m_path.c_str(), &st) == 0 ? (long long)st.st_size : 0;
+    m_written = 0;
+    m_samples.clear();
+    m_flooding = false;
+    m_listener = listener;
+    if (!m_poller.Start([this]() { Run(); })) {
+        Stop();
+        return false;
+    }
+    return true;
+}
+
+/// Stop the thread and release the watch
+void WTLogWatcher::Stop() {
+    m_poller.Stop();
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+/// Wait for changes in the directory: all the pending events are read at
+/// once, and after a measure the thread waits LOGWATCH_MIN_INTERVAL before
+/// reading events again, so that the events of a fast writer are coalesced
+/// in the kernel queue. Without events the rate is measured again every
+/// LOGWATCH_FLOOD_INTERVAL until it is zero, so that it does not keep the
+/// value of the last write while the log is idle
+void WTLogWatcher::Run() {
+    struct pollfd fds[2];
+    fds[0].fd = m_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_poller.WakeFd();
+    fds[1].events = POLLIN;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    long long last = 0;
+    for (;;) {
+        long long now = WTMonotonicMillis();
+        bool decaying = m_flooding || m_rate.load() > 0;
+        int timeout = decaying ? LOGWATCH_FLOOD_INTERVAL : -1;
+        if (last != 0 && now - last < LOGWATCH_MIN_INTERVAL) {
+            timeout = (int)(LOGWATCH_MIN_INTERVAL - (now - last));
+            fds[0].events = 0;
+        } else {
+            fds[0].events = POLLIN;
+        }
+        int r = poll(fds, 2, timeout);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].events == 0) {
+            last = 0;
+            continue;
+        }
+        bool modified = false;
+        ssize_t len;
+        while ((len = read(m_fd, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + len; ) {
+                struct inotify_event* e = (struct inotify_event*)p;
+                if (e->len > 0 && m_name == e->name) {
+                    modified = true;
+                }
+                p += sizeof(struct inotify_event) + e->len;
+            }
+        }
+        if (modified || decaying) {
+            last = WTMonotonicMillis();
+            Measure(last, modified);
+        }
+    }
+}
+
+#else
+
+bool WTLogWatcher::Start(WTLogRateListener* /* listener */) {
+    return false;
+}
+
+void WTLogWatcher::Stop() {
+}
+
+void WTLogWatcher::Run() {
+}
+
+#endif // WT_LOGWATCH_INOTIFY
+
+
+// end.
@@ -0,0 +1,80 @@
+/// whenever_tray
+///
+/// Growth rate of the scheduler log: the directory of the log is watched
+/// with inotify, and the size of the log is read only when the log has been
+/// modified, created or replaced, at most every few hundred milliseconds
+/// however fast the scheduler writes. The rate is the growth over a sliding
+/// window: a flood begins when the rate exceeds the threshold, and ends when
+/// it stays below half of the threshold for a whole window.
+///
+/// The listener is notified from the watcher thread. This module does not
+/// depend on wxWidgets.
+
+#ifndef WT_LOGWATCH_H
+#define WT_LOGWATCH_H
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <utility>
+
+#include "wt_pollthread.h"
+
+// Receiver of the beginning and the end of a log flood, with the rate in
+// bytes per second that caused the change
+class WTLogRateListener {
+public:
+    virtual ~WTLogRateListener() { }
+    virtual void OnLogFlood(bool flooding, double rate) = 0;
+};
+
+// Watcher of the growth of a log file
+class WTLogWatcher {
+public:
+    WTLogWatcher();
+    ~WTLogWatcher();
+
+    // the threshold is in bytes per second, times are in milliseconds
+    void SetPath(const std::string& path) {
+        m_path = path;
+    }
+    void SetThreshold(double rate) {
+        m_threshold = rate;
+    }
+    void SetWindow(long ms) {
+        m_window = ms;
+    }
+
+    bool Start(WTLogRateListener* listener);
+    void Stop();
+
+    // last measured rate, in bytes per second
+    double Rate() const {
+        return m_rate.load();
+    }
+
+private:
+    void Run();
+    void Measure(long long now, bool modified);
+
+    std::string m_path;
+    std::string m_name;
+    double m_threshold;
+    long m_window;
+    int m_fd;
+    WTLogRateListener* m_listener;
+    WTPollThread m_poller;
+
+    // owned by the watcher thread
+    std::deque<std::pair<long long, unsigned long long> > m_samples;
+    unsigned long long m_written;
+    long long m_size;
+    bool m_flooding;
+    long long m_calmSince;
+    std::atomic<double> m_rate;
+};
+
+
+#endif // WT_LOGWATCH_H
+
+// end.
@@ -0,0 +1,306 @@
+/// whenever_tray
+///
+/// Metrics about the scheduler and the tray itself, and their export in the
+/// Prometheus text format.
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include "wt_metrics.h"
+
+// name of the exported file: the textfile collector only reads `*.prom`
+#define METRICS_FILE "whenever_tray.prom"
+#define METRICS_TMP_SUFFIX ".tmp"
+
+#ifdef _WIN32
+#define PATH_SEPARATOR "\\"
+#else
+#define PATH_SEPARATOR "/"
+#endif
+
+static const double HISTOGRAM_BOUNDS[WT_HISTOGRAM_BUCKETS] = {
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000,
+};
+
+
+// ============================================================================
+// WTHistogram and WTMetrics: implementation
+// ============================================================================
+
+const double* WTHistogram::Bounds() {
+    return HISTOGRAM_BOUNDS;
+}
+
+/// Record an observation: only the bucket it falls in is incremented, the
+/// cumulative counts are computed when exporting
+void WTHistogram::Observe(double ms) {
+    int i = 0;
+    while (i < WT_HISTOGRAM_BUCKETS && ms > HISTOGRAM_BOUNDS[i]) {
+        i++;
+    }
+    counts[i]++;
+    count++;
+    sum_ms += ms;
+}
+
+WTMetrics::WTMetrics() {
+    memset(this, 0, sizeof(*this));
+    battery_percent = -1;
+}
+
+
+// ============================================================================
+// WTMetricsExporter: implementation
+// ============================================================================
+
+/// Set the directory where the metrics file is written: an empty string
+/// disables the export
+void WTMetricsExporter::SetDirectory(const std::string& dir) {
+    if (dir.empty()) {
+        m_path.clear();
+        m_tmpPath.clear();
+    } else {
+        m_path = dir + PATH_SEPARATOR + METRICS_FILE;
+        m_tmpPath = m_path + METRICS_TMP_SUFFIX;
+    }
+}
+
+/// Append formatted text to the buffer, failing if it does not fit
+bool WTMetricsExporter::Append(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(m_buf + m_len, sizeof(m_buf) - m_len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= sizeof(m_buf) - m_len) {
+        return false;
+    }
+    m_len += n;
+    return true;
+}
+
+/// Render all metrics in the Prometheus text exposition format
+bool WTMetricsExporter::Render(const WTMetrics& m) {
+    bool ok = true;
+    m_len = 0;
+
+    ok = ok && Append(
+        "# HELP whenever_up Whether the scheduler process is running.\n"
+        "# TYPE whenever_up gauge\n"
+        "whenever_up %d\n"
+        "# HELP whenever_paused Whether the scheduler is paused.\n"
+        "# TYPE whenever_paused gauge\n"
+        "whenever_paused %d\n"
+        "# HELP whenever_starts_total Scheduler starts since the tray started.\n"
+        "# TYPE whenever_starts_total counter\n"
+        "whenever_starts_total %llu\n"
+        "# HELP whenever_restarts_total Scheduler restarts since the tray started.\n"
+        "# TYPE whenever_restarts_total counter\n"
+        "whenever_restarts_total %llu\n",
+        m.up ? 1 : 0, m.paused ? 1 : 0, m.starts, m.restarts);
+    ok = ok && Append(
+        "# HELP whenever_hangs_total Hangs detected by the watchdog.\n"
+        "# TYPE whenever_hangs_total counter\n"
+        "whenever_hangs_total %llu\n",
+        m.hangs);
+    ok = ok && Append(
+        "# HELP whenever_handovers_total Restarts handed over to a standby scheduler.\n"
+        "# TYPE whenever_handovers_total counter\n"
+        "whenever_handovers_total %llu\n"
+        "# HELP whenever_handover_failures_total Standby schedulers that did not become ready.\n"
+        "# TYPE whenever_handover_failures_total counter\n"
+        "whenever_handover_failures_total %llu\n",
+        m.handovers, m.handover_failures);
+    {
+        const WTHistogram& h = m.handover_gap;
+        unsigned long long cumulative = 0;
+        ok = ok && Append(
+            "# HELP whenever_handover_gap_seconds Time between the exit of the old scheduler and the resumption of the new one.\n"
+            "# TYPE whenever_handover_gap_seconds histogram\n");
+        for (int i = 0; i < WT_HISTOGRAM_BUCKETS; i++) {
+            cumulative += h.counts[i];
+            ok = ok && Append("whenever_handover_gap_seconds_bucket{le=\"%g\"} %llu\n",
+                              HISTOGRAM_BOUNDS[i] / 1000.0, cumulative);
+        }
+        ok = ok && Append(
+            "whenever_handover_gap_seconds_bucket{le=\"+Inf\"} %llu\n"
+            "whenever_handover_gap_seconds_sum %g\n"
+            "whenever_handover_gap_seconds_count %llu\n",
+            h.count, h.sum_ms / 1000.0, h.count);
+    }
+    if (m.exited) {
+        ok = ok && Append(
+            "# HELP whenever_last_exit_status Exit status of the last scheduler process.\n"
+            "# TYPE whenever_last_exit_status gauge\n"
+            "whenever_last_exit_status %d\n",
+            m.last_exit_status);
+    }
+
+    ok = ok && Append(
+        "# HELP whenever_throttled Whether the scheduler is throttled because of system pressure.\n"
+        "# TYPE whenever_throttled gauge\n"
+        "whenever_throttled %d\n"
+        "# HELP whenever_throttle_releases_total Throttles released after the pressure fell.\n"
+        "# TYPE whenever_throttle_releases_total counter\n"
+        "whenever_throttle_releases_total %llu\n"
+        "# HELP whenever_throttles_total Throttles caused by system pressure, by resource.\n"
+        "# TYPE whenever_throttles_total counter\n",
+        m.throttled ? 1 : 0, m.throttle_releases);
+    for (int r = 0; r < WT_PRESSURE_COUNT; r++) {
+        ok = ok && Append("whenever_throttles_total{resource=\"%s\"} %llu\n",
+                          WTPressureResourceName((WTPressureResource)r), m.throttles[r]);
+    }
+
+    ok = ok && Append(
+        "# HELP whenever_tray_on_battery Whether the system runs on battery.\n"
+        "# TYPE whenever_tray_on_battery gauge\n"
+        "whenever_tray_on_battery %d\n"
+        "# HELP whenever_power_transitions_total Power policy changes applied to the scheduler.\n"
+        "# TYPE whenever_power_transitions_total counter\n"
+        "whenever_power_transitions_total %llu\n",
+        m.on_battery ? 1 : 0, m.power_transitions);
+    if (m.battery_percent >= 0) {
+        ok = ok && Append(
+            "# HELP whenever_tray_battery_percent Remaining battery capacity.\n"
+            "# TYPE whenever_tray_battery_percent gauge\n"
+            "whenever_tray_battery_percent %d\n",
+            m.battery_percent);
+    }
+
+    ok = ok && Append(
+        "# HELP whenever_tray_user_away Whether the user has been idle long enough.\n"
+        "# TYPE whenever_tray_user_away gauge\n"
+        "whenever_tray_user_away %d\n"
+        "# HELP whenever_tray_quiet_hours Whether the scheduler is held by the quiet hours.\n"
+        "# TYPE whenever_tray_quiet_hours gauge\n"
+        "whenever_tray_quiet_hours %d\n",
+        m.user_away ? 1 : 0, m.quiet ? 1 : 0);
+
+    ok = ok && Append(
+        "# HELP whenever_log_growth_bytes_per_second Growth rate of the scheduler log.\n"
+        "# TYPE whenever_log_growth_bytes_per_second gauge\n"
+        "whenever_log_growth_bytes_per_second %.1f\n"
+        "# HELP whenever_log_floods_total Times the scheduler log grew faster than allowed.\n"
+        "# TYPE whenever_log_floods_total counter\n"
+        "whenever_log_floods_total %llu\n"
+        "# HELP whenever_log_level_reduced Whether the scheduler runs at a quieter log level.\n"
+        "# TYPE whenever_log_level_reduced gauge\n"
+        "whenever_log_level_reduced %d\n",
+        m.log_rate, m.log_floods, m.log_level_reduced ? 1 : 0);
+
+    ok = ok && Append(
+        "# HELP whenever_log_rotations_total Rotations of the scheduler log.\n"
+        "# TYPE whenever_log_rotations_total counter\n"
+        "whenever_log_rotations_total %llu\n"
+        "# HELP whenever_log_compressed_bytes_total Bytes of rotated log compressed.\n"
+        "# TYPE whenever_log_compressed_bytes_total counter\n"
+        "whenever_log_compressed_bytes_total %llu\n"
+        "# HELP whenever_log_compressed_saved_bytes_total Bytes saved by compressing rotated logs.\n"
+        "# TYPE whenever_log_compressed_saved_bytes_total counter\n"
+        "whenever_log_compressed_saved_bytes_total %llu\n"
+        "# HELP whenever_log_compress_seconds_total Time spent compressing rotated logs.\n"
+        "# TYPE whenever_log_compress_seconds_total counter\n"
+        "whenever_log_compress_seconds_total %.3f\n",
+        m.log_rotations, m.log_compressed_in,
+        m.log_compressed_in - m.log_compressed_out, m.log_compress_seconds);
+
+    ok = ok && Append(
+        "# HELP whenever_forward_records_total Output lines forwarded to syslog or to the journal.\n"
+        "# TYPE whenever_forward_records_total counter\n"
+        "whenever_forward_records_total{result=\"sent\"} %llu\n"
+        "whenever_forward_records_total{result=\"dropped\"} %llu\n"
+        "whenever_forward_records_total{result=\"failed\"} %llu\n",
+        m.forward_sent, m.forward_dropped, m.forward_failed);
+
+    ok = ok && Append(
+        "# HELP whenever_tray_startup_delay_seconds Time the first start of the scheduler was delayed.\n"
+        "# TYPE whenever_tray_startup_delay_seconds gauge\n"
+        "whenever_tray_startup_delay_seconds %.3f\n",
+        m.startup_delay);
+
+    ok = ok && Append(
+        "# HELP whenever_commands_total Commands sent to the scheduler.\n"
+        "# TYPE whenever_commands_total counter\n");
+    for (int c = 0; c < WT_CMD_COUNT; c++) {
+        ok = ok && Append("whenever_commands_total{command=\"%s\"} %llu\n",
+                          WTCommandName((WTCommand)c), m.commands[c]);
+    }
+    ok = ok && Append(
+        "# HELP whenever_commands_unacknowledged_total Commands not acknowledged in time.\n"
+        "# TYPE whenever_commands_unacknowledged_total counter\n");
+    for (int c = 0; c < WT_CMD_COUNT; c++) {
+        ok = ok && Append("whenever_commands_unacknowledged_total{command=\"%s\"} %llu\n",
+                          WTCommandName((WTCommand)c), m.unacknowledged[c]);
+    }
+    ok = ok && Append(
+        "# HELP whenever_command_latency_seconds Command acknowledgement latency.\n"
+        "# TYPE whenever_command_latency_seconds histogram\n");
+    for (int c = 0; c < WT_CMD_COUNT; c++) {
+        const char* name = WTCommandName((WTCommand)c);
+        const WTHistogram& h = m.latency[c];
+        unsigned long long cumulative = 0;
+        for (int i = 0; i < WT_HISTOGRAM_BUCKETS; i++) {
+            cumulative += h.counts[i];
+            ok = ok && Append(
+                "whenever_command_latency_seconds_bucket{command=\"%s\",le=\"%g\"} %llu\n",
+                name, HISTOGRAM_BOUNDS[i] / 1000.0, cumulative);
+        }
+        ok = ok && Append(
+            "whenever_command_latency_seconds_bucket{command=\"%s\",le=\"+Inf\"} %llu\n"
+            "whenever_command_latency_seconds_sum{command=\"%s\"} %g\n"
+            "whenever_command_latency_seconds_count{command=\"%s\"} %llu\n",
+            name, h.count, name, h.sum_ms / 1000.0, name, h.count);
+    }
+
+    ok = ok && Append(
+        "# HELP whenever_cpu_seconds_total CPU time used by the scheduler process.\n"
+        "# TYPE whenever_cpu_seconds_total counter\n"
+        "whenever_cpu_seconds_total %.3f\n"
+        "# HELP whenever_resident_memory_bytes Resident memory of the scheduler process.\n"
+        "# TYPE whenever_resident_memory_bytes gauge\n"
+        "whenever_resident_memory_bytes %lld\n",
+        m.cpu_seconds, m.rss_bytes);
+
+    ok = ok && Append(
+        "# HELP whenever_log_lines_total Lines of scheduler output, by level.\n"
+        "# TYPE whenever_log_lines_total counter\n");
+    for (int l = 0; l < WT_LEVEL_COUNT; l++) {
+        ok = ok && Append("whenever_log_lines_total{level=\"%s\"} %llu\n",
+                          WTLogLevelName((WTLogLevel)l), m.log_lines[l]);
+    }
+    ok = ok && Append(
+        "# HELP whenever_log_bytes_total Bytes of scheduler output, by level.\n"
+        "# TYPE whenever_log_bytes_total counter\n");
+    for (int l = 0; l < WT_LEVEL_COUNT; l++) {
+        ok = ok && Append("whenever_log_bytes_total{level=\"%s\"} %llu\n",
+                          WTLogLevelName((WTLogLevel)l), m.log_bytes[l]);
+    }
+    return ok;
+}
+
+/// Write the metrics file atomically: the rendered text is written with a
+/// single call to a temporary file in the same directory, then renamed
+bool WTMetricsExporter::Write(const WTMetrics& metrics) {
+    if (!Enabled() || !Render(metrics)) {
+        return false;
+    }
+    FILE* f = fopen(m_tmpPath.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    setvbuf(f, NULL, _IONBF, 0);
+    bool ok = fwrite(m_buf, 1, m_len, f) == m_len;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        remove(m_tmpPath.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    remove(m_path.c_str());
+#endif
+    return rename(m_tmpPath.c_str(), m_path.c_str()) == 0;
+}
+
+
+// end.
@@ -0,0 +1,125 @@
+/// whenever_tray
+///
+/// Metrics about the scheduler and the tray itself. All counters live in a
+/// preallocated structure, updated in place by the tray, and are exported
+/// periodically in the Prometheus text format to a file suitable for the
+/// *textfile collector* of node_exporter: the file is written in a single
+/// buffered write to a temporary file, which is then renamed to the final
+/// name so that a partially written file is never scraped.
+
+#ifndef WT_METRICS_H
+#define WT_METRICS_H
+
+#include <string>
+
+#include "wt_output.h"
+#include "wt_pressure.h"
+
+// upper bounds of the latency histogram buckets, in milliseconds
+#define WT_HISTOGRAM_BUCKETS 11
+
+// size of the buffer used to render the exported metrics
+#define WT_METRICS_BUFSIZE 16384
+
+// Cumulative histogram with fixed buckets, as expected by Prometheus
+struct WTHistogram {
+    unsigned long long counts[WT_HISTOGRAM_BUCKETS + 1];    // last is +Inf
+    unsigned long long count;
+    double sum_ms;
+
+    void Observe(double ms);
+    static const double* Bounds();
+};
+
+// All the metrics that are exported
+struct WTMetrics {
+    WTMetrics();
+
+    // scheduler state
+    bool up;
+    bool paused;
+    unsigned long long starts;
+    unsigned long long restarts;
+    bool exited;
+    int last_exit_status;
+    unsigned long long hangs;
+
+    // restarts with a warm standby, and time without a running scheduler
+    unsigned long long handovers;
+    unsigned long long handover_failures;
+    WTHistogram handover_gap;
+
+    // throttling of the scheduler under system pressure
+    bool throttled;
+    unsigned long long throttles[WT_PRESSURE_COUNT];
+    unsigned long long throttle_releases;
+
+    // power source and the policy applied for it
+    bool on_battery;
+    int battery_percent;
+    unsigned long long power_transitions;
+
+    // whether the user is away, thus the scheduler may run
+    bool user_away;
+
+    // whether the scheduler is held by the quiet hours
+    bool quiet;
+
+    // growth of the scheduler log, and reactions to floods
+    double log_rate;
+    unsigned long long log_floods;
+    bool log_level_reduced;
+
+    // rotation of the log, and compression of the rotated segments
+    unsigned long long log_rotations;
+    unsigned long long log_compressed_in;
+    unsigned long long log_compressed_out;
+    double log_compress_seconds;
+
+    // records forwarded to syslog or to the journal, and records lost
+    unsigned long long forward_sent;
+    unsigned long long forward_dropped;
+    unsigned long long forward_failed;
+
+    // time the first start of the scheduler has been delayed
+    double startup_delay;
+
+    // commands sent to the scheduler and their acknowledgement latency
+    unsigned long long commands[WT_CMD_COUNT];
+    unsigned long long unacknowledged[WT_CMD_COUNT];
+    WTHistogram latency[WT_CMD_COUNT];
+
+    // resources used by the scheduler process
+    double cpu_seconds;
+    long long rss_bytes;
+
+    // output received from the scheduler, by log level
+    unsigned long long log_lines[WT_LEVEL_COUNT];
+    unsigned long long log_bytes[WT_LEVEL_COUNT];
+};
+
+// Writer for the textfile collector
+class WTMetricsExporter {
+public:
+    WTMetricsExporter() : m_len(0) { }
+
+    void SetDirectory(const std::string& dir);
+    bool Enabled() const {
+        return !m_path.empty();
+    }
+    bool Write(const WTMetrics& metrics);
+
+private:
+    bool Render(const WTMetrics& metrics);
+    bool Append(const char* fmt, ...);
+
+    std::string m_path;
+    std::string m_tmpPath;
+    char m_buf[WT_METRICS_BUFSIZE];
+    size_t m_len;
+};
+
+
+#endif // WT_METRICS_H
+
+// end.
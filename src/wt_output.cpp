@@ -0,0 +1,251 @@
+/// whenever_tray
+///
+/// Handling of the output produced by the *whenever* scheduler.
+
+#include <cctype>
+#include <cstring>
+
+#include "wt_output.h"
+
+
+// ============================================================================
+// WTLineSplitter: implementation
+// ============================================================================
+
+/// Append data to the internal buffer, passing complete lines to the sink:
+/// lines that do not fit in the buffer are delivered in chunks
+void WTLineSplitter::Feed(const char* data, size_t len) {
+    while (len > 0) {
+        const char* nl = (const char*)memchr(data, '\n', len);
+        size_t chunk = nl ? (size_t)(nl - data) : len;
+        size_t room = WT_LINE_MAX - m_len;
+        if (chunk >= room) {
+            memcpy(m_buf + m_len, data, room);
+            m_len += room;
+            Flush();
+            data += room;
+            len -= room;
+            continue;
+        }
+        memcpy(m_buf + m_len, data, chunk);
+        m_len += chunk;
+        if (!nl) {
+            break;
+        }
+        Flush();
+        data += chunk + 1;
+        len -= chunk + 1;
+    }
+}
+
+/// Deliver the pending partial line, if any, removing a trailing CR
+void WTLineSplitter::Flush() {
+    if (m_len > 0 && m_buf[m_len - 1] == '\r') {
+        m_len--;
+    }
+    if (m_len > 0 && m_sink) {
+        m_sink->OnLine(m_stream, m_buf, m_len);
+    }
+    m_len = 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+/// Return true if fragment occurs in line, regardless of letter case
+bool WTLineContains(const char* line, size_t len, const char* fragment) {
+    size_t flen = strlen(fragment);
+    if (flen == 0) {
+        return true;
+    }
+    for (size_t i = 0; i + flen <= len; i++) {
+        size_t j = 0;
+        while (j < flen
+               && tolower((unsigned char)line[i + j]) == tolower((unsigned char)fragment[j])) {
+            j++;
+        }
+        if (j == flen) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// ----------------------------------------------------------------------------
+// log line parser
+// ----------------------------------------------------------------------------
+
+static const char* LOG_LEVEL_NAMES[WT_LEVEL_COUNT] = {
+    "trace", "debug", "info", "warn", "error", "unknown",
+};
+
+/// Name of a level as used in the configuration and on the command line
+const char* WTLogLevelName(WTLogLevel level) {
+    if (level < 0 || level >= WT_LEVEL_COUNT) {
+        level = WT_LEVEL_UNKNOWN;
+    }
+    return LOG_LEVEL_NAMES[level];
+}
+
+static const char* COMMAND_NAMES[WT_CMD_COUNT] = {
+    "pause", "resume", "reset_conditions", "exit",
+};
+
+/// Name of a command, as written to the scheduler stdin
+const char* WTCommandName(WTCommand cmd) {
+    if (cmd < 0 || cmd >= WT_CMD_COUNT) {
+        return "";
+    }
+    return COMMAND_NAMES[cmd];
+}
+
+/// Compare a field with a NUL-terminated string, regardless of letter case
+bool WTLogField::Is(const char* s) const {
+    size_t slen = strlen(s);
+    return slen == len && WTLineContains(ptr, len, s);
+}
+
+// days since the epoch of a date in the proleptic gregorian calendar
+static long long days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// parse exactly n decimal digits
+static bool parse_digits(const char* s, size_t n, int& value) {
+    value = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!isdigit((unsigned char)s[i])) {
+            return false;
+        }
+        value = value * 10 + (s[i] - '0');
+    }
+    return true;
+}
+
+/// Parse a timestamp in the form YYYY-MM-DDTHH:MM:SS[.fff] (a space is also
+/// accepted as separator between date and time, and seconds are optional)
+bool WTParseTimestamp(const char* s, size_t len, long long& timestamp) {
+    int y, mo, d, h, mi, sec = 0, ms = 0;
+    if (len < 16
+        || !parse_digits(s, 4, y) || s[4] != '-'
+        || !parse_digits(s + 5, 2, mo) || s[7] != '-'
+        || !parse_digits(s + 8, 2, d) || (s[10] != 'T' && s[10] != ' ')
+        || !parse_digits(s + 11, 2, h) || s[13] != ':'
+        || !parse_digits(s + 14, 2, mi)) {
+        return false;
+    }
+    if (len >= 19 && s[16] == ':' && !parse_digits(s + 17, 2, sec)) {
+        return false;
+    }
+    if (len >= 20 && s[19] == '.') {
+        int scale = 100;
+        for (size_t i = 20; i < len && i < 23 && isdigit((unsigned char)s[i]); i++) {
+            ms += (s[i] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60) {
+        return false;
+    }
+    timestamp = ((days_from_civil(y, mo, d) * 24 + h) * 60 + mi) * 60000LL
+                + sec * 1000LL + ms;
+    return true;
+}
+
+// skip spaces, returning the new position
+static size_t skip_spaces(const char* line, size_t len, size_t pos) {
+    while (pos < len && line[pos] == ' ') {
+        pos++;
+    }
+    return pos;
+}
+
+// read a word delimited by a space, returning the position after it
+static size_t read_word(const char* line, size_t len, size_t pos, WTLogField& field) {
+    field.ptr = line + pos;
+    while (pos < len && line[pos] != ' ') {
+        pos++;
+    }
+    field.len = line + pos - field.ptr;
+    return pos;
+}
+
+/// Parse a line in the *whenever* log format: the line is recognized if at
+/// least the timestamp can be parsed; the fields point into the line
+bool WTParseLogLine(const char* line, size_t len, WTLogRecord& rec) {
+    WTLogField empty = { line + len, 0 };
+    rec.timestamp = 0;
+    rec.level = WT_LEVEL_UNKNOWN;
+    rec.context = rec.name = rec.when = rec.status = rec.message = empty;
+
+    if (len < 2 || line[0] != '[') {
+        return false;
+    }
+    const char* close = (const char*)memchr(line, ']', len);
+    if (!close || !WTParseTimestamp(line + 1, close - line - 1, rec.timestamp)) {
+        return false;
+    }
+    size_t pos = skip_spaces(line, len, close - line + 1);
+
+    // application name, in parentheses
+    if (pos < len && line[pos] == '(') {
+        const char* rpar = (const char*)memchr(line + pos, ')', len - pos);
+        if (rpar) {
+            pos = skip_spaces(line, len, rpar - line + 1);
+        }
+    }
+
+    // level
+    WTLogField level;
+    pos = read_word(line, len, pos, level);
+    for (int i = 0; i < WT_LEVEL_UNKNOWN; i++) {
+        if (level.Is(LOG_LEVEL_NAMES[i])) {
+            rec.level = (WTLogLevel)i;
+            break;
+        }
+    }
+    pos = skip_spaces(line, len, pos);
+
+    // structured part: CONTEXT Name/[WHEN/STATUS]
+    size_t mark = pos;
+    WTLogField context, item;
+    pos = skip_spaces(line, len, read_word(line, len, pos, context));
+    pos = read_word(line, len, pos, item);
+    const char* sep = NULL;
+    for (size_t i = 0; i + 1 < item.len; i++) {
+        if (item.ptr[i] == '/' && item.ptr[i + 1] == '[') {
+            sep = item.ptr + i;
+        }
+    }
+    if (context.len > 0 && sep && item.ptr[item.len - 1] == ']') {
+        rec.context = context;
+        rec.name.ptr = item.ptr;
+        rec.name.len = sep - item.ptr;
+        const char* tag = sep + 2;
+        const char* tag_end = item.ptr + item.len - 1;
+        const char* slash = (const char*)memchr(tag, '/', tag_end - tag);
+        rec.when.ptr = tag;
+        rec.when.len = (slash ? slash : tag_end) - tag;
+        if (slash) {
+            rec.status.ptr = slash + 1;
+            rec.status.len = tag_end - slash - 1;
+        }
+        pos = skip_spaces(line, len, pos);
+    } else {
+        pos = mark;
+    }
+    rec.message.ptr = line + pos;
+    rec.message.len = len - pos;
+    return true;
+}
+
+
+// end.
@@ -0,0 +1,108 @@
+/// whenever_tray
+///
+/// Handling of the output produced by the *whenever* scheduler: the data
+/// read from the pipes connected to the scheduler stdout/stderr is split
+/// into lines using a fixed buffer, so that no allocation takes place for
+/// each received line. Lines in the *whenever* log format can be parsed
+/// in place, the format being
+///
+///     [2024-01-31T12:34:56.789] (whenever) INFO  TASK Name/[START/OK] text
+///
+/// where the part after the level is only present for structured records.
+
+#ifndef WT_OUTPUT_H
+#define WT_OUTPUT_H
+
+#include <cstddef>
+
+// maximum length of a line: longer lines are split
+#define WT_LINE_MAX 4096
+
+// commands that can be sent to the scheduler
+enum WTCommand {
+    WT_CMD_PAUSE = 0,
+    WT_CMD_RESUME,
+    WT_CMD_RESETCONDS,
+    WT_CMD_EXIT,
+    WT_CMD_COUNT,
+};
+
+// identifiers of the streams the scheduler writes to
+enum WTOutputStream {
+    WT_STREAM_STDOUT = 0,
+    WT_STREAM_STDERR,
+};
+
+// Interface for the consumers of scheduler output lines: the line passed
+// to OnLine is not NUL-terminated, and is valid only during the call
+class WTLineSink {
+public:
+    virtual ~WTLineSink() { }
+    virtual void OnLine(WTOutputStream stream, const char* line, size_t len) = 0;
+};
+
+// Split a stream of bytes into lines, without the trailing newline
+class WTLineSplitter {
+public:
+    WTLineSplitter(WTOutputStream stream, WTLineSink* sink)
+        : m_stream(stream), m_sink(sink), m_len(0) { }
+
+    void Feed(const char* data, size_t len);
+    void Flush();
+    void SetSink(WTLineSink* sink) {
+        m_sink = sink;
+    }
+
+private:
+    WTOutputStream m_stream;
+    WTLineSink* m_sink;
+    char m_buf[WT_LINE_MAX];
+    size_t m_len;
+};
+
+// case insensitive search of a NUL-terminated fragment in a line
+bool WTLineContains(const char* line, size_t len, const char* fragment);
+
+
+// log levels of the scheduler
+enum WTLogLevel {
+    WT_LEVEL_TRACE = 0,
+    WT_LEVEL_DEBUG,
+    WT_LEVEL_INFO,
+    WT_LEVEL_WARN,
+    WT_LEVEL_ERROR,
+    WT_LEVEL_UNKNOWN,
+    WT_LEVEL_COUNT,
+};
+
+// a field of a parsed line: it points into the line itself
+struct WTLogField {
+    const char* ptr;
+    size_t len;
+
+    bool Is(const char* s) const;
+};
+
+// Result of parsing a log line: the timestamp is expressed in milliseconds
+// since the epoch, taking the local time written in the log as if it were
+// UTC (which is enough to compare times found in the same log); fields not
+// found in the line are left empty
+struct WTLogRecord {
+    long long timestamp;
+    WTLogLevel level;
+    WTLogField context;
+    WTLogField name;
+    WTLogField when;
+    WTLogField status;
+    WTLogField message;
+};
+
+bool WTParseLogLine(const char* line, size_t len, WTLogRecord& rec);
+bool WTParseTimestamp(const char* s, size_t len, long long& timestamp);
+const char* WTLogLevelName(WTLogLevel level);
+const char* WTCommandName(WTCommand cmd);
+
+
+#endif // WT_OUTPUT_H
+
+// end.
@@ -0,0 +1,77 @@
+/// whenever_tray
+///
+/// Worker threads waiting on descriptors with poll.
+
+#include <cerrno>
+
+#include "wt_pollthread.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define WT_POLLTHREAD_PIPE
+#endif
+
+
+// ============================================================================
+// WTPollThread: implementation
+// ============================================================================
+
+WTPollThread::WTPollThread() {
+    m_wake[0] = m_wake[1] = -1;
+}
+
+WTPollThread::~WTPollThread() {
+    Stop();
+}
+
+#ifdef WT_POLLTHREAD_PIPE
+
+/// The write end does not block, so that stopping never waits for a pipe
+/// that is already full of wake-ups
+bool WTPollThread::Start(std::function<void()> run) {
+    if (m_thread.joinable()) {
+        return true;
+    }
+    if (pipe(m_wake) != 0) {
+        m_wake[0] = m_wake[1] = -1;
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(m_wake[i], F_SETFD, FD_CLOEXEC);
+    }
+    fcntl(m_wake[1], F_SETFL, fcntl(m_wake[1], F_GETFL) | O_NONBLOCK);
+    m_thread = std::thread(run);
+    return true;
+}
+
+/// A write that fails because the pipe is full still leaves the thread
+/// with something to read, thus the thread is always joined
+void WTPollThread::Stop() {
+    if (m_thread.joinable()) {
+        char c = 0;
+        while (write(m_wake[1], &c, 1) < 0 && errno == EINTR) { }
+        m_thread.join();
+    }
+    for (int i = 0; i < 2; i++) {
+        if (m_wake[i] >= 0) {
+            close(m_wake[i]);
+            m_wake[i] = -1;
+        }
+    }
+}
+
+#else
+
+bool WTPollThread::Start(std::function<void()> run) {
+    (void)run;
+    return false;
+}
+
+void WTPollThread::Stop() {
+}
+
+#endif
+
+
+// end.
@@ -0,0 +1,46 @@
+/// whenever_tray
+///
+/// A worker thread that waits on descriptors with poll, together with the
+/// pipe through which it is told to stop: the thread polls the read end of
+/// the pipe along with its own descriptors, and leaves as soon as it
+/// becomes readable. Stopping always waits for the thread to leave, so
+/// that the descriptors it polls can be closed afterwards.
+///
+/// This module does not depend on wxWidgets.
+
+#ifndef WT_POLLTHREAD_H
+#define WT_POLLTHREAD_H
+
+#include <functional>
+#include <thread>
+
+class WTPollThread {
+public:
+    WTPollThread();
+    ~WTPollThread();
+
+    // create the pipe and run the function in a new thread: false if the
+    // pipe cannot be created, or where poll is not available
+    bool Start(std::function<void()> run);
+
+    // tell the thread to leave, wait for it and close the pipe
+    void Stop();
+
+    bool Running() const {
+        return m_thread.joinable();
+    }
+
+    // descriptor to poll for POLLIN: the thread must leave once it is ready
+    int WakeFd() const {
+        return m_wake[0];
+    }
+
+private:
+    std::thread m_thread;
+    int m_wake[2];
+};
+
+
+#endif // WT_POLLTHREAD_H
+
+// end.
@@ -0,0 +1,153 @@
+/// whenever_tray
+///
+/// Post-mortem information about the scheduler.
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#endif
+
+#include "wt_postmortem.h"
+
+#ifdef _WIN32
+#define PATH_SEPARATOR "\\"
+#else
+#define PATH_SEPARATOR "/"
+#endif
+
+// prefixes marking the stream each line of output comes from
+static const char* STREAM_PREFIX[2] = { "out| ", "err| " };
+
+
+// ============================================================================
+// WTOutputRing: implementation
+// ============================================================================
+
+WTOutputRing::WTOutputRing(size_t capacity) : m_buf(capacity > 0 ? capacity : 1) {
+    m_head = 0;
+    m_wrapped = false;
+}
+
+/// Append data, overwriting the oldest one: no allocation takes place
+void WTOutputRing::Append(const char* data, size_t len) {
+    size_t cap = m_buf.size();
+    if (len >= cap) {
+        data += len - cap;
+        len = cap;
+    }
+    size_t first = cap - m_head < len ? cap - m_head : len;
+    memcpy(&m_buf[m_head], data, first);
+    memcpy(&m_buf[0], data + first, len - first);
+    if (m_head + len >= cap) {
+        m_wrapped = true;
+    }
+    m_head = (m_head + len) % cap;
+}
+
+void WTOutputRing::Clear() {
+    m_head = 0;
+    m_wrapped = false;
+}
+
+/// Return the contents in chronological order
+std::string WTOutputRing::Contents() const {
+    if (!m_wrapped) {
+        return std::string(&m_buf[0], m_head);
+    }
+    std::string s(&m_buf[m_head], m_buf.size() - m_head);
+    s.append(&m_buf[0], m_head);
+    return s;
+}
+
+
+// ============================================================================
+// WTPostMortem: implementation
+// ============================================================================
+
+/// Reset the recorder for a newly started scheduler: the buffer is not
+/// cleared, since the notes on how the instance has been started, and its
+/// first lines of output, precede this call, thus the start is marked by a
+/// note instead
+void WTPostMortem::Start(long pid, const std::string& cmdline) {
+    m_pid = pid;
+    m_cmdline = cmdline;
+    m_startedAt = WTMonotonicMillis();
+    m_hasSample = false;
+    char note[48];
+    snprintf(note, sizeof(note), "start: scheduler running as PID %ld", pid);
+    AddNote(note);
+}
+
+/// Keep a line of output, marked with the stream it comes from
+void WTPostMortem::AddLine(WTOutputStream stream, const char* line, size_t len) {
+    m_output.Append(STREAM_PREFIX[stream == WT_STREAM_STDERR ? 1 : 0], 5);
+    m_output.Append(line, len);
+    m_output.Append("\n", 1);
+}
+
+/// Keep a note about the tray activity, interleaved with the output
+void WTPostMortem::AddNote(const char* text) {
+    m_output.Append("tray| ", 6);
+    m_output.Append(text, strlen(text));
+    m_output.Append("\n", 1);
+}
+
+void WTPostMortem::SetSample(const WTProcessSample& sample, double cpu_percent) {
+    m_sample = sample;
+    m_cpuPercent = cpu_percent;
+    m_hasSample = true;
+}
+
+/// Write a timestamped report in the configured directory
+std::string WTPostMortem::WriteReport(int status, const char* reason) {
+    if (m_dir.empty()) {
+        return std::string();
+    }
+    time_t now = time(NULL);
+    struct tm tm_now = *localtime(&now);
+    char stamp[32], name[64];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm_now);
+    strftime(name, sizeof(name), "whenever-postmortem-%Y%m%d-%H%M%S.txt", &tm_now);
+    std::string path = m_dir + PATH_SEPARATOR + name;
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        return std::string();
+    }
+    long long uptime = m_startedAt ? (WTMonotonicMillis() - m_startedAt) / 1000 : 0;
+    fprintf(f, "whenever post-mortem report\n\n");
+    fprintf(f, "time:         %s\n", stamp);
+    fprintf(f, "pid:          %ld\n", m_pid);
+    fprintf(f, "command line: %s\n", m_cmdline.c_str());
+    if (reason) {
+        fprintf(f, "reason:       %s\n", reason);
+    } else if (status < 0) {
+#if defined(__unix__) || defined(__APPLE__)
+        fprintf(f, "terminated:   by signal %d (%s)\n", -status, strsignal(-status));
+#else
+        fprintf(f, "terminated:   by signal %d\n", -status);
+#endif
+    } else {
+        fprintf(f, "exit code:    %d\n", status);
+    }
+    fprintf(f, "uptime:       %lldd %02lld:%02lld:%02lld\n",
+            uptime / 86400, (uptime / 3600) % 24, (uptime / 60) % 60, uptime % 60);
+    if (m_hasSample) {
+        fprintf(f, "last sample:  CPU %.1f%%, RSS %.1f MB (%lld seconds before exit)\n",
+                m_cpuPercent, m_sample.rss_bytes / (1024.0 * 1024.0),
+                (WTMonotonicMillis() - m_sample.timestamp) / 1000);
+    } else {
+        fprintf(f, "last sample:  not available\n");
+    }
+    std::string output = m_output.Contents();
+    fprintf(f, "\nlast output (%u bytes):\n\n", (unsigned)output.size());
+    fwrite(output.data(), 1, output.size(), f);
+    fclose(f);
+    return path;
+}
+
+
+// end.
@@ -0,0 +1,82 @@
+/// whenever_tray
+///
+/// Post-mortem information about the scheduler: the last lines of output
+/// are always kept in a ring buffer, allocated once, so that when the
+/// scheduler dies unexpectedly a report can be written with the last
+/// output, the exit status, the last resource sample and the uptime.
+
+#ifndef WT_POSTMORTEM_H
+#define WT_POSTMORTEM_H
+
+#include <string>
+#include <vector>
+
+#include "wt_output.h"
+#include "wt_sysinfo.h"
+
+// default size of the buffer holding the last output of the scheduler
+#define WT_POSTMORTEM_BUFSIZE (64 * 1024)
+
+// Byte ring buffer holding the most recent data appended to it
+class WTOutputRing {
+public:
+    WTOutputRing(size_t capacity = WT_POSTMORTEM_BUFSIZE);
+
+    void Append(const char* data, size_t len);
+    void Clear();
+    size_t Capacity() const {
+        return m_buf.size();
+    }
+    std::string Contents() const;
+
+private:
+    std::vector<char> m_buf;
+    size_t m_head;
+    bool m_wrapped;
+};
+
+// Recorder of the information needed for the post-mortem report
+class WTPostMortem {
+public:
+    WTPostMortem(size_t capacity = WT_POSTMORTEM_BUFSIZE) : m_output(capacity) {
+        m_pid = 0;
+        m_startedAt = 0;
+        m_hasSample = false;
+        m_cpuPercent = 0;
+    }
+
+    void SetDirectory(const std::string& dir) {
+        m_dir = dir;
+    }
+    void SetCapacity(size_t capacity) {
+        if (capacity != m_output.Capacity()) {
+            m_output = WTOutputRing(capacity);
+        }
+    }
+
+    // information collected while the scheduler runs
+    void Start(long pid, const std::string& cmdline);
+    void AddLine(WTOutputStream stream, const char* line, size_t len);
+    void AddNote(const char* text);
+    void SetSample(const WTProcessSample& sample, double cpu_percent);
+
+    // write the report for an exit status as reported by wxProcess, that
+    // is the exit code or the negated signal number, or for the reason
+    // given if the scheduler is still alive: return the file path
+    std::string WriteReport(int status, const char* reason = NULL);
+
+private:
+    WTOutputRing m_output;
+    std::string m_dir;
+    std::string m_cmdline;
+    long m_pid;
+    long long m_startedAt;
+    WTProcessSample m_sample;
+    bool m_hasSample;
+    double m_cpuPercent;
+};
+
+
+#endif // WT_POSTMORTEM_H
+
+// end.
@@ -0,0 +1,111 @@
+/// whenever_tray
+///
+/// State of the power supply, from the Linux power_supply class in sysfs.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "wt_power.h"
+
+#if defined(__linux__)
+#include <dirent.h>
+#define WT_POWER_SYSFS
+#endif
+
+static const char* SOURCE_NAMES[WT_POWER_COUNT] = {
+    "ac", "battery",
+};
+
+/// Name of a power source, as used in the configuration
+const char* WTPowerSourceName(WTPowerSource source) {
+    if (source < 0 || source >= WT_POWER_COUNT) {
+        return "";
+    }
+    return SOURCE_NAMES[source];
+}
+
+#ifdef WT_POWER_SYSFS
+
+// read the first line of an attribute of a supply, without the newline
+static bool read_attribute(const std::string& dir, const char* name, char* buf, size_t size) {
+    std::string path = dir + "/" + name;
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    if (ok) {
+        buf[strcspn(buf, "\r\n")] = 0;
+    }
+    return ok;
+}
+
+/// Scan the supplies: batteries that do not power the system (such as the
+/// ones of wireless peripherals) are ignored, and the capacity of several
+/// batteries is averaged
+bool WTReadPowerStatus(const std::string& root, WTPowerStatus& status) {
+    status.source = WT_POWER_AC;
+    status.has_battery = false;
+    status.battery_percent = -1;
+
+    DIR* d = opendir(root.c_str());
+    if (!d) {
+        return false;
+    }
+    bool external_online = false, discharging = false;
+    int capacity_sum = 0, capacity_count = 0;
+    char value[64];
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        std::string dir = root + "/" + e->d_name;
+        if (!read_attribute(dir, "type", value, sizeof(value))) {
+            continue;
+        }
+        if (strcmp(value, "Battery") == 0) {
+            if (read_attribute(dir, "scope", value, sizeof(value))
+                && strcmp(value, "Device") == 0) {
+                continue;
+            }
+            status.has_battery = true;
+            if (read_attribute(dir, "capacity", value, sizeof(value))) {
+                capacity_sum += atoi(value);
+                capacity_count++;
+            }
+            if (read_attribute(dir, "status", value, sizeof(value))
+                && strcmp(value, "Discharging") == 0) {
+                discharging = true;
+            }
+        } else if (read_attribute(dir, "online", value, sizeof(value))
+                   && atoi(value) != 0) {
+            external_online = true;
+        }
+    }
+    closedir(d);
+
+    if (capacity_count > 0) {
+        status.battery_percent = capacity_sum / capacity_count;
+    }
+    if (status.has_battery && (discharging || !external_online)) {
+        status.source = WT_POWER_BATTERY;
+    }
+    return true;
+}
+
+#else
+
+bool WTReadPowerStatus(const std::string& /* root */, WTPowerStatus& status) {
+    status.source = WT_POWER_AC;
+    status.has_battery = false;
+    status.battery_percent = -1;
+    return false;
+}
+
+#endif // WT_POWER_SYSFS
+
+
+// end.
@@ -0,0 +1,36 @@
+/// whenever_tray
+///
+/// State of the power supply, as reported by the Linux power_supply class
+/// in sysfs: the root of the class directory can be changed, so that a
+/// fake tree can be used for testing. This module does not depend on
+/// wxWidgets.
+
+#ifndef WT_POWER_H
+#define WT_POWER_H
+
+#include <string>
+
+// power sources, each of which can have its own policy
+enum WTPowerSource {
+    WT_POWER_AC = 0,
+    WT_POWER_BATTERY,
+    WT_POWER_COUNT,
+};
+
+// State of the power supply: the system is considered on battery when it
+// has a battery and no online external supply
+struct WTPowerStatus {
+    WTPowerSource source;
+    bool has_battery;
+    int battery_percent;        // -1 when unknown
+};
+
+// read the power supply state from the given power_supply class directory
+bool WTReadPowerStatus(const std::string& root, WTPowerStatus& status);
+
+const char* WTPowerSourceName(WTPowerSource source);
+
+
+#endif // WT_POWER_H
+
+// end.
@@ -0,0 +1,219 @@
+/// whenever_tray
+///
+/// Monitoring of the system pressure through the Linux PSI interface.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "wt_pressure.h"
+#include "wt_sysinfo.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#define WT_PRESSURE_PSI
+#endif
+
+// default location of the pressure files
+#define PRESSURE_ROOT "/proc/pressure"
+
+// default trigger window, and time the pressure must stay low to release,
+// both in milliseconds
+#define PRESSURE_DEFAULT_WINDOW_MS 2000
+#define PRESSURE_DEFAULT_RELEASE_MS 30000
+
+// interval between checks of the averages while under pressure
+#define PRESSURE_CHECK_INTERVAL 1000    // milliseconds
+
+static const char* RESOURCE_NAMES[WT_PRESSURE_COUNT] = {
+    "cpu", "memory", "io",
+};
+
+/// Name of a resource, which is also the name of its pressure file
+const char* WTPressureResourceName(WTPressureResource resource) {
+    if (resource < 0 || resource >= WT_PRESSURE_COUNT) {
+        return "";
+    }
+    return RESOURCE_NAMES[resource];
+}
+
+
+// ============================================================================
+// WTPressureMonitor: implementation
+// ============================================================================
+
+WTPressureMonitor::WTPressureMonitor() {
+    m_root = PRESSURE_ROOT;
+    m_window = PRESSURE_DEFAULT_WINDOW_MS;
+    m_release = PRESSURE_DEFAULT_RELEASE_MS;
+    m_listener = NULL;
+    for (int i = 0; i < WT_PRESSURE_COUNT; i++) {
+        m_threshold[i] = 0;
+        m_fd[i] = -1;
+    }
+}
+
+WTPressureMonitor::~WTPressureMonitor() {
+    Stop();
+}
+
+/// Read the 10 seconds average of the "some" line of a pressure file
+bool WTPressureMonitor::ReadAverage(WTPressureResource resource, double& avg10) const {
+    std::string path = m_root + "/" + RESOURCE_NAMES[resource];
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    char line[256];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        const char* p = strstr(line, "avg10=");
+        if (strncmp(line, "some ", 5) == 0 && p) {
+            avg10 = strtod(p + 6, NULL);
+            found = true;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+#ifdef WT_PRESSURE_PSI
+
+/// Register a trigger for each resource with a threshold: the trigger
+/// fires when the time in which some tasks are stalled exceeds the
+/// threshold within the window
+bool WTPressureMonitor::Start(WTPressureListener* listener) {
+    if (m_poller.Running()) {
+        return true;
+    }
+    bool any = false;
+    for (int i = 0; i < WT_PRESSURE_COUNT; i++) {
+        if (m_threshold[i] <= 0) {
+            continue;
+        }
+        std::string path = m_root + "/" + RESOURCE_NAMES[i];
+        int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        long window_us = m_window * 1000;
+        long stall_us = (long)(window_us * m_threshold[i] / 100.0);
+        char trigger[64];
+        int len = snprintf(trigger, sizeof(trigger), "some %ld %ld", stall_us, window_us);
+        if (write(fd, trigger, len + 1) < 0) {
+            close(fd);
+            continue;
+        }
+        m_fd[i] = fd;
+        any = true;
+    }
+    m_listener = listener;
+    if (!any || !m_poller.Start([this]() { Run(); })) {
+        Stop();
+        return false;
+    }
+    return true;
+}
+
+/// Stop the thread and release the triggers
+void WTPressureMonitor::Stop() {
+    m_poller.Stop();
+    for (int i = 0; i < WT_PRESSURE_COUNT; i++) {
+        if (m_fd[i] >= 0) {
+            close(m_fd[i]);
+            m_fd[i] = -1;
+        }
+    }
+}
+
+/// Wait for triggers: while the pressure is high, the averages are also
+/// checked every PRESSURE_CHECK_INTERVAL, and the pressure is considered
+/// low again once all of them stay below half of their thresholds for the
+/// release time
+void WTPressureMonitor::Run() {
+    struct pollfd fds[WT_PRESSURE_COUNT + 1];
+    WTPressureResource resources[WT_PRESSURE_COUNT];
+    int n = 0;
+    for (int i = 0; i < WT_PRESSURE_COUNT; i++) {
+        if (m_fd[i] >= 0) {
+            fds[n].fd = m_fd[i];
+            fds[n].events = POLLPRI;
+            resources[n] = (WTPressureResource)i;
+            n++;
+        }
+    }
+    fds[n].fd = m_poller.WakeFd();
+    fds[n].events = POLLIN;
+
+    bool high = false;
+    WTPressureResource cause = WT_PRESSURE_CPU;
+    long long calm_since = 0;
+    for (;;) {
+        int r = poll(fds, n + 1, high ? PRESSURE_CHECK_INTERVAL : -1);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[n].revents) {
+            break;
+        }
+        long long now = WTMonotonicMillis();
+        for (int i = 0; i < n; i++) {
+            if (fds[i].revents & POLLPRI) {
+                calm_since = 0;
+                if (!high) {
+                    double avg10 = 0;
+                    ReadAverage(resources[i], avg10);
+                    high = true;
+                    cause = resources[i];
+                    m_listener->OnPressureChange(true, cause, avg10);
+                }
+            }
+        }
+        if (!high) {
+            continue;
+        }
+        bool calm = true;
+        double cause_avg10 = 0;
+        for (int i = 0; i < n; i++) {
+            double avg10 = 0;
+            if (ReadAverage(resources[i], avg10) && avg10 >= m_threshold[resources[i]] / 2) {
+                calm = false;
+            }
+            if (resources[i] == cause) {
+                cause_avg10 = avg10;
+            }
+        }
+        if (!calm) {
+            calm_since = 0;
+        } else if (calm_since == 0) {
+            calm_since = now;
+        } else if (now - calm_since >= m_release) {
+            high = false;
+            calm_since = 0;
+            m_listener->OnPressureChange(false, cause, cause_avg10);
+        }
+    }
+}
+
+#else
+
+bool WTPressureMonitor::Start(WTPressureListener* /* listener */) {
+    return false;
+}
+
+void WTPressureMonitor::Stop() {
+}
+
+void WTPressureMonitor::Run() {
+}
+
+#endif // WT_PRESSURE_PSI
+
+
+// end.
@@ -0,0 +1,81 @@
+/// whenever_tray
+///
+/// Monitoring of the system pressure through the Linux PSI interface: a
+/// trigger is registered on /proc/pressure/{cpu,memory,io} for each watched
+/// resource, and a thread waits on the trigger descriptors with poll, so
+/// that nothing is read periodically while the system is not under
+/// pressure. Once a trigger fires, the averages are checked at short
+/// intervals until all of them stay below half of their thresholds for the
+/// release time, which provides the hysteresis.
+///
+/// The listener is notified from the monitor thread. This module does not
+/// depend on wxWidgets.
+
+#ifndef WT_PRESSURE_H
+#define WT_PRESSURE_H
+
+#include <string>
+
+#include "wt_pollthread.h"
+
+// resources whose pressure can be watched
+enum WTPressureResource {
+    WT_PRESSURE_CPU = 0,
+    WT_PRESSURE_MEMORY,
+    WT_PRESSURE_IO,
+    WT_PRESSURE_COUNT,
+};
+
+// Receiver of pressure changes: called from the monitor thread, with the
+// resource that caused the change and its 10 seconds average
+class WTPressureListener {
+public:
+    virtual ~WTPressureListener() { }
+    virtual void OnPressureChange(bool high, WTPressureResource resource, double avg10) = 0;
+};
+
+// Monitor of the pressure of the watched resources
+class WTPressureMonitor {
+public:
+    WTPressureMonitor();
+    ~WTPressureMonitor();
+
+    // thresholds are percentages of the window spent stalled, and a zero
+    // threshold disables the resource; times are in milliseconds
+    void SetRoot(const std::string& root) {
+        m_root = root;
+    }
+    void SetThreshold(WTPressureResource resource, double percent) {
+        m_threshold[resource] = percent;
+    }
+    void SetWindow(long ms) {
+        m_window = ms;
+    }
+    void SetRelease(long ms) {
+        m_release = ms;
+    }
+
+    // register the triggers and start the thread: false if no resource
+    // could be watched
+    bool Start(WTPressureListener* listener);
+    void Stop();
+
+private:
+    void Run();
+    bool ReadAverage(WTPressureResource resource, double& avg10) const;
+
+    std::string m_root;
+    double m_threshold[WT_PRESSURE_COUNT];
+    long m_window;
+    long m_release;
+    int m_fd[WT_PRESSURE_COUNT];
+    WTPressureListener* m_listener;
+    WTPollThread m_poller;
+};
+
+const char* WTPressureResourceName(WTPressureResource resource);
+
+
+#endif // WT_PRESSURE_H
+
+// end.
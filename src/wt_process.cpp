@@ -0,0 +1,475 @@
+/// whenever_tray
+///
+/// Native handling of the scheduler process on POSIX systems.
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "wt_process.h"
+
+#ifdef WT_NATIVE_PROCESS
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+extern char** environ;
+
+// pidfds are used where the C library knows the system calls, even if the
+// running kernel does not: waitid accepts them since Linux 5.4, and the
+// idtype is given by value since older headers do not define it
+#if defined(__linux__) && defined(SYS_pidfd_open)
+#define WT_PIDFD
+#define WT_P_PIDFD ((idtype_t)3)
+#endif
+#endif
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+/// Copy the environment of the current process
+std::vector<std::string> WTCurrentEnvironment() {
+    std::vector<std::string> env;
+#ifdef WT_NATIVE_PROCESS
+    for (char** e = environ; e && *e; e++) {
+        env.push_back(*e);
+    }
+#endif
+    return env;
+}
+
+/// Set a variable in an environment: entries without a name are ignored
+void WTSetEnvironment(std::vector<std::string>& env, const std::string& entry) {
+    size_t eq = entry.find('=');
+    if (eq == std::string::npos || eq == 0) {
+        return;
+    }
+    for (size_t i = 0; i < env.size(); i++) {
+        if (env[i].compare(0, eq + 1, entry, 0, eq + 1) == 0) {
+            env[i] = entry;
+            return;
+        }
+    }
+    env.push_back(entry);
+}
+
+/// Map the [0, 100] priority range of wxWidgets, where 50 is the default,
+/// to niceness: lower priorities give positive values up to 19
+int WTPriorityToNice(unsigned int priority) {
+    if (priority >= 50) {
+        return 0;
+    }
+    return (int)((50 - priority) * 19 / 50);
+}
+
+/// Change the niceness of a process group, which on Linux also applies to
+/// all the threads of its processes
+bool WTSetGroupPriority(long pgid, unsigned int priority) {
+#ifdef WT_NATIVE_PROCESS
+    return pgid > 0 && setpriority(PRIO_PGRP, (id_t)pgid, WTPriorityToNice(priority)) == 0;
+#else
+    (void)pgid;
+    (void)priority;
+    return false;
+#endif
+}
+
+/// Change the affinity of every thread of a running process: the threads
+/// are listed in /proc, since affinity is a per-thread attribute on Linux
+bool WTSetProcessAffinity(long pid, const std::vector<int>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    if (cpus.empty()) {
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            CPU_SET(i, &set);
+        }
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%ld/task", pid);
+    DIR* d = opendir(path);
+    if (!d) {
+        return false;
+    }
+    bool ok = true;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] != '.') {
+            ok = sched_setaffinity((pid_t)atol(e->d_name), sizeof(set), &set) == 0 && ok;
+        }
+    }
+    closedir(d);
+    return ok;
+#else
+    (void)pid;
+    (void)cpus;
+    return false;
+#endif
+}
+
+/// Join the arguments, quoting the ones that contain spaces or quotes
+std::string WTJoinArgv(const std::vector<std::string>& argv) {
+    std::string s;
+    for (size_t i = 0; i < argv.size(); i++) {
+        if (i > 0) {
+            s += ' ';
+        }
+        if (!argv[i].empty() && argv[i].find_first_of(" \t\"'\\") == std::string::npos) {
+            s += argv[i];
+        } else {
+            s += '"';
+            for (size_t j = 0; j < argv[i].size(); j++) {
+                if (argv[i][j] == '"' || argv[i][j] == '\\') {
+                    s += '\\';
+                }
+                s += argv[i][j];
+            }
+            s += '"';
+        }
+    }
+    return s;
+}
+
+
+#ifdef WT_NATIVE_PROCESS
+
+// build a NULL-terminated vector of pointers to the given strings
+static std::vector<char*> c_strings(const std::vector<std::string>& v) {
+    std::vector<char*> p;
+    p.reserve(v.size() + 1);
+    for (size_t i = 0; i < v.size(); i++) {
+        p.push_back(const_cast<char*>(v[i].c_str()));
+    }
+    p.push_back(NULL);
+    return p;
+}
+
+// Spawn the child with the given file actions and attributes, applying
+// niceness and affinity to the calling thread first so that the child
+// inherits them from its very first instruction: on Linux both are per
+// thread attributes, thus this is done in a short-lived thread, which can
+// raise its niceness without having to lower it back afterwards
+static int spawn_child(pid_t* pid, const WTSpawnOptions& options,
+                       const posix_spawn_file_actions_t* actions,
+                       const posix_spawnattr_t* attr) {
+    std::vector<char*> argv = c_strings(options.argv);
+    std::vector<char*> envp = c_strings(options.env);
+    int niceness = WTPriorityToNice(options.priority);
+    int result = 0;
+
+#if defined(__linux__)
+    std::thread spawner([&]() {
+        if (niceness != 0) {
+            pid_t tid = (pid_t)syscall(SYS_gettid);
+            setpriority(PRIO_PROCESS, tid, niceness);
+        }
+        if (!options.cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (size_t i = 0; i < options.cpus.size(); i++) {
+                if (options.cpus[i] >= 0 && options.cpus[i] < CPU_SETSIZE) {
+                    CPU_SET(options.cpus[i], &set);
+                }
+            }
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        result = posix_spawnp(pid, argv[0], actions, attr, &argv[0], &envp[0]);
+    });
+    spawner.join();
+#else
+    // niceness is per process here, and affinity is not supported
+    result = posix_spawnp(pid, argv[0], actions, attr, &argv[0], &envp[0]);
+    if (result == 0 && niceness != 0) {
+        setpriority(PRIO_PROCESS, *pid, niceness);
+    }
+#endif
+    return result;
+}
+
+
+// ============================================================================
+// WTChildProcess: implementation
+// ============================================================================
+
+WTChildProcess::WTChildProcess() {
+    m_pid = 0;
+    m_fd[0] = m_fd[1] = m_fd[2] = -1;
+    m_pidfd = -1;
+    m_exited = false;
+    m_status = 0;
+}
+
+/// Destructor: the pipes are closed, but the child is neither killed nor
+/// waited for, which is up to the owner
+WTChildProcess::~WTChildProcess() {
+    ClosePipes();
+    if (m_pidfd >= 0) {
+        close(m_pidfd);
+        m_pidfd = -1;
+    }
+}
+
+void WTChildProcess::ClosePipes() {
+    for (int i = 0; i < 3; i++) {
+        if (m_fd[i] >= 0) {
+            close(m_fd[i]);
+            m_fd[i] = -1;
+        }
+    }
+}
+
+/// Create the pipes and spawn the process: the ends of the pipes used by
+/// the parent are close-on-exec, and the output ends are non blocking
+bool WTChildProcess::Spawn(const WTSpawnOptions& options) {
+    if (m_pid || options.argv.empty()) {
+        errno = EINVAL;
+        return false;
+    }
+    // a command written to a child that has just exited must not kill the
+    // parent: write errors are reported by Write instead
+    signal(SIGPIPE, SIG_IGN);
+
+    int pipes[3][2] = { { -1, -1 }, { -1, -1 }, { -1, -1 } };
+    for (int i = 0; i < 3; i++) {
+        if (pipe(pipes[i]) != 0) {
+            int err = errno;
+            for (int j = 0; j < i; j++) {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            errno = err;
+            return false;
+        }
+    }
+    // parent ends: write end of stdin, read ends of stdout and stderr
+    m_fd[0] = pipes[0][1];
+    m_fd[1] = pipes[1][0];
+    m_fd[2] = pipes[2][0];
+    for (int i = 0; i < 3; i++) {
+        fcntl(m_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+    fcntl(m_fd[1], F_SETFL, fcntl(m_fd[1], F_GETFL) | O_NONBLOCK);
+    fcntl(m_fd[2], F_SETFL, fcntl(m_fd[2], F_GETFL) | O_NONBLOCK);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipes[0][0], 0);
+    posix_spawn_file_actions_adddup2(&actions, pipes[1][1], 1);
+    posix_spawn_file_actions_adddup2(&actions, pipes[2][1], 2);
+    for (int i = 0; i < 3; i++) {
+        posix_spawn_file_actions_addclose(&actions, pipes[i][i == 0 ? 0 : 1]);
+        posix_spawn_file_actions_addclose(&actions, m_fd[i]);
+    }
+
+    // the child starts with default signal handlers and an empty mask
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    sigset_t sigs;
+    sigfillset(&sigs);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    if (options.new_group) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, 0);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    pid_t pid = 0;
+    int result = spawn_child(&pid, options, &actions, &attr);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    // the child ends are not needed by the parent
+    close(pipes[0][0]);
+    close(pipes[1][1]);
+    close(pipes[2][1]);
+    if (result != 0) {
+        ClosePipes();
+        errno = result;
+        return false;
+    }
+    m_pid = pid;
+    m_exited = false;
+#ifdef WT_PIDFD
+    // the child cannot have been reaped yet, thus the pidfd refers to it
+    // even if it has already exited; it is close-on-exec by default
+    m_pidfd = (int)syscall(SYS_pidfd_open, (pid_t)pid, 0);
+#endif
+    return true;
+}
+
+/// Write all data to the child stdin, retrying on interruptions
+bool WTChildProcess::Write(const char* data, size_t len) {
+    if (m_fd[0] < 0) {
+        return false;
+    }
+    while (len > 0) {
+        ssize_t n = write(m_fd[0], data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+void WTChildProcess::CloseInput() {
+    if (m_fd[0] >= 0) {
+        close(m_fd[0]);
+        m_fd[0] = -1;
+    }
+}
+
+/// Read available output: the pipe is closed on end of file
+long WTChildProcess::Read(WTOutputStream stream, char* buf, size_t len) {
+    int i = stream == WT_STREAM_STDERR ? 2 : 1;
+    if (m_fd[i] < 0) {
+        return 0;
+    }
+    ssize_t n;
+    do {
+        n = read(m_fd[i], buf, len);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        close(m_fd[i]);
+        m_fd[i] = -1;
+        return 0;
+    }
+    return n < 0 ? -1 : (long)n;
+}
+
+/// Send a signal: the process group is identified by the PID of the child,
+/// which cannot be reused until the child has been reaped
+bool WTChildProcess::Signal(int sig, bool group) {
+    if (!m_pid || m_exited) {
+        return false;
+    }
+#if defined(WT_PIDFD) && defined(SYS_pidfd_send_signal)
+    if (!group && m_pidfd >= 0) {
+        return syscall(SYS_pidfd_send_signal, m_pidfd, sig, NULL, 0) == 0;
+    }
+#endif
+    return kill(group ? -(pid_t)m_pid : (pid_t)m_pid, sig) == 0;
+}
+
+/// Collect the exit status of the child, if it has exited
+bool WTChildProcess::Reap(int& status, bool wait) {
+    if (!m_pid || m_exited) {
+        return false;
+    }
+#ifdef WT_PIDFD
+    // through the pidfd where the kernel supports it, and by PID otherwise
+    if (m_pidfd >= 0) {
+        siginfo_t info;
+        int r;
+        memset(&info, 0, sizeof(info));
+        do {
+            r = waitid(WT_P_PIDFD, (id_t)m_pidfd, &info, WEXITED | (wait ? 0 : WNOHANG));
+        } while (r < 0 && errno == EINTR);
+        if (r == 0) {
+            if (info.si_pid == 0) {
+                return false;
+            }
+            m_exited = true;
+            m_status = info.si_code == CLD_EXITED ? info.si_status : -info.si_status;
+            status = m_status;
+            return true;
+        }
+    }
+#endif
+    int st = 0;
+    pid_t r;
+    do {
+        r = waitpid((pid_t)m_pid, &st, wait ? 0 : WNOHANG);
+    } while (r < 0 && errno == EINTR);
+    if (r != (pid_t)m_pid) {
+        return false;
+    }
+    m_exited = true;
+    if (WIFSIGNALED(st)) {
+        m_status = -WTERMSIG(st);
+    } else {
+        m_status = WEXITSTATUS(st);
+    }
+    status = m_status;
+    return true;
+}
+
+
+/// Run a short command and take the first line of its output, waiting at
+/// most the given time: a command that does not answer in time is killed
+/// with its process group, so that the caller is never held by it
+bool WTProbeCommand(const WTSpawnOptions& options, long timeout_ms, std::string& line) {
+    typedef std::chrono::steady_clock clock;
+    line.clear();
+    WTChildProcess child;
+    if (!child.Spawn(options)) {
+        return false;
+    }
+    child.CloseInput();
+    clock::time_point deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+    std::string output;
+    bool done = false;
+    while (!done) {
+        long left = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - clock::now()).count();
+        if (left <= 0) {
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = child.OutputFd(WT_STREAM_STDOUT);
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, (int)left) <= 0) {
+            continue;
+        }
+        char buf[512];
+        long n = child.Read(WT_STREAM_STDOUT, buf, sizeof(buf));
+        if (n == 0) {
+            done = true;
+        } else if (n > 0) {
+            output.append(buf, n);
+            done = output.find('\n') != std::string::npos;
+        }
+    }
+    int status;
+    if (!child.Reap(status)) {
+        child.Signal(SIGKILL, options.new_group);
+        child.Reap(status, true);
+    }
+    size_t end = output.find_first_of("\r\n");
+    line = output.substr(0, end);
+    return !line.empty();
+}
+
+#endif // WT_NATIVE_PROCESS
+
+
+// end.
@@ -0,0 +1,124 @@
+/// whenever_tray
+///
+/// Native handling of the scheduler process on POSIX systems: the process
+/// is described by an argument vector and an explicit environment, so that
+/// no command line has to be quoted and parsed again, and it is spawned
+/// with `posix_spawn` with its standard streams connected to pipes, in a
+/// new process group, and with the requested priority and CPU affinity
+/// already applied when the program starts. On Linux the child is also
+/// referred to by a pidfd, which becomes readable when it exits and through
+/// which it is waited for and signalled, so that its PID is never reused
+/// behind the back of the owner; on kernels without pidfds (before 5.3) the
+/// child can only be waited for by polling.
+///
+/// This module does not depend on wxWidgets, so that it can also be used
+/// outside of the GUI.
+
+#ifndef WT_PROCESS_H
+#define WT_PROCESS_H
+
+#include <string>
+#include <vector>
+
+#include "wt_output.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WT_NATIVE_PROCESS
+#endif
+
+// Description of the process to spawn
+struct WTSpawnOptions {
+    WTSpawnOptions() : new_group(true), priority(50) { }
+
+    std::vector<std::string> argv;      // argv[0] is looked up in the PATH
+    std::vector<std::string> env;       // "NAME=value" entries
+    bool new_group;                     // make the child a group leader
+    unsigned int priority;              // 0 to 100, 50 being normal
+    std::vector<int> cpus;              // CPU affinity, empty for any CPU
+};
+
+// the environment of the current process, as "NAME=value" entries
+std::vector<std::string> WTCurrentEnvironment();
+
+// set a "NAME=value" entry in an environment, replacing the same variable
+void WTSetEnvironment(std::vector<std::string>& env, const std::string& entry);
+
+// map a wxWidgets priority (0 to 100, 50 being normal) to a niceness
+int WTPriorityToNice(unsigned int priority);
+
+// set the priority of all processes in a process group: false on failure,
+// for instance when raising the priority is not permitted
+bool WTSetGroupPriority(long pgid, unsigned int priority);
+
+// set the CPU affinity of all threads of a process, or allow all CPUs if
+// the list is empty: false if not supported or not permitted
+bool WTSetProcessAffinity(long pid, const std::vector<int>& cpus);
+
+// build a readable command line from an argument vector, for reports
+std::string WTJoinArgv(const std::vector<std::string>& argv);
+
+#ifdef WT_NATIVE_PROCESS
+
+// A child process with its standard streams connected to pipes
+class WTChildProcess {
+public:
+    WTChildProcess();
+    ~WTChildProcess();
+
+    // spawn the process: return false (setting errno) on failure
+    bool Spawn(const WTSpawnOptions& options);
+
+    long Pid() const {
+        return m_pid;
+    }
+    int OutputFd(WTOutputStream stream) const {
+        return m_fd[stream == WT_STREAM_STDERR ? 2 : 1];
+    }
+
+    // a descriptor that becomes readable when the child exits, -1 if not
+    // available: it stays readable until the child is destroyed
+    int ExitFd() const {
+        return m_pidfd;
+    }
+
+    // write the whole buffer to the standard input of the child
+    bool Write(const char* data, size_t len);
+    void CloseInput();
+
+    // read from stdout or stderr without blocking: return the number of
+    // bytes read, 0 on end of file, -1 if no data is available
+    long Read(WTOutputStream stream, char* buf, size_t len);
+
+    // send a signal to the child, or to its whole process group
+    bool Signal(int sig, bool group = false);
+
+    // collect the exit status, possibly waiting for the child to exit: the
+    // status is the exit code, or the negated signal number
+    bool Reap(int& status, bool wait = false);
+    bool Exited() const {
+        return m_exited;
+    }
+    int ExitStatus() const {
+        return m_status;
+    }
+
+private:
+    void ClosePipes();
+
+    long m_pid;
+    int m_fd[3];
+    int m_pidfd;
+    bool m_exited;
+    int m_status;
+};
+
+// run a command and return the first line of its output, killing it if
+// it does not answer within the timeout: false if there is no output
+bool WTProbeCommand(const WTSpawnOptions& options, long timeout_ms, std::string& line);
+
+#endif // WT_NATIVE_PROCESS
+
+
+#endif // WT_PROCESS_H
+
+// end.
@@ -0,0 +1,320 @@
+/// whenever_tray
+///
+/// Quiet hours, and a timer bound to the wall clock.
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include "wt_quiet.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#define WT_QUIET_TIMERFD
+#endif
+
+// interval between checks of the wall clock when no timerfd is available
+#define QUIET_FALLBACK_CHECK 30         // seconds
+
+// how far ahead of the current day windows are considered: a window may
+// start on the previous day and end today, and the next change of state
+// is at most a week ahead
+#define QUIET_DAYS_BEFORE 1
+#define QUIET_DAYS_AFTER 8
+
+static const char* DAY_NAMES[7] = {
+    "sun", "mon", "tue", "wed", "thu", "fri", "sat",
+};
+
+
+// ----------------------------------------------------------------------------
+// parsing
+// ----------------------------------------------------------------------------
+
+// index of a day name, or -1
+static int day_index(const std::string& name) {
+    for (int i = 0; i < 7; i++) {
+        if (name == DAY_NAMES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// Parse a specification of days: a comma separated list of day names
+/// (mon, tue, ...), ranges of days (mon-fri, also wrapping as in fri-mon)
+/// and the words weekdays, weekend and daily
+bool WTParseQuietDays(const std::string& s, unsigned int& days) {
+    std::string spec;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (!isspace((unsigned char)s[i])) {
+            spec += (char)tolower((unsigned char)s[i]);
+        }
+    }
+    days = 0;
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = spec.size();
+        }
+        std::string item = spec.substr(pos, comma - pos);
+        size_t dash = item.find('-');
+        if (item == "daily") {
+            days |= 0x7f;
+        } else if (item == "weekdays") {
+            days |= 0x3e;
+        } else if (item == "weekend") {
+            days |= 0x41;
+        } else if (dash != std::string::npos) {
+            int first = day_index(item.substr(0, dash));
+            int last = day_index(item.substr(dash + 1));
+            if (first < 0 || last < 0) {
+                return false;
+            }
+            for (int d = first;; d = (d + 1) % 7) {
+                days |= 1u << d;
+                if (d == last) {
+                    break;
+                }
+            }
+        } else {
+            int d = day_index(item);
+            if (d < 0) {
+                return false;
+            }
+            days |= 1u << d;
+        }
+        pos = comma + 1;
+    }
+    return days != 0;
+}
+
+/// Parse a time of the day in the form H:MM or HH:MM: 24:00 is accepted to
+/// end a window at midnight
+bool WTParseClockTime(const std::string& s, int& minutes) {
+    int h = 0, m = 0;
+    size_t colon = s.find(':');
+    if (colon == std::string::npos || colon == 0 || colon > 2 || s.size() != colon + 3) {
+        return false;
+    }
+    for (size_t i = 0; i < s.size(); i++) {
+        if (i != colon && !isdigit((unsigned char)s[i])) {
+            return false;
+        }
+    }
+    h = atoi(s.substr(0, colon).c_str());
+    m = atoi(s.substr(colon + 1).c_str());
+    if (m > 59 || h > 24 || (h == 24 && m > 0)) {
+        return false;
+    }
+    minutes = h * 60 + m;
+    return true;
+}
+
+
+// ============================================================================
+// WTQuietSchedule: implementation
+// ============================================================================
+
+// the instant of a time of the day, some days after a given date: mktime
+// normalizes the fields and finds out whether daylight saving time applies
+static time_t local_instant(const struct tm& date, int day_offset, int minutes, int& wday) {
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    t.tm_year = date.tm_year;
+    t.tm_mon = date.tm_mon;
+    t.tm_mday = date.tm_mday + day_offset;
+    t.tm_hour = minutes / 60;
+    t.tm_min = minutes % 60;
+    t.tm_isdst = -1;
+    time_t instant = mktime(&t);
+    wday = t.tm_wday;
+    return instant;
+}
+
+/// Check every window starting in the days around the given instant: the
+/// next change is the nearest start or end of a window after that instant,
+/// which is computed anew for each day so that each day has its own offset
+/// from UTC
+bool WTQuietSchedule::Quiet(time_t now, time_t& next) const {
+    struct tm today;
+#ifdef _WIN32
+    localtime_s(&today, &now);
+#else
+    localtime_r(&now, &today);
+#endif
+    bool quiet = false;
+    next = 0;
+    for (int off = -QUIET_DAYS_BEFORE; off <= QUIET_DAYS_AFTER; off++) {
+        for (size_t i = 0; i < m_windows.size(); i++) {
+            const WTQuietWindow& w = m_windows[i];
+            int wday, unused;
+            time_t start = local_instant(today, off, w.start, wday);
+            if (!(w.days & (1u << wday))) {
+                continue;
+            }
+            time_t end = local_instant(today, off + (w.end <= w.start ? 1 : 0), w.end, unused);
+            if (start <= now && now < end) {
+                quiet = true;
+            }
+            if (start > now && (next == 0 || start < next)) {
+                next = start;
+            }
+            if (end > now && (next == 0 || end < next)) {
+                next = end;
+            }
+        }
+    }
+    return quiet;
+}
+
+
+// ============================================================================
+// WTWallClockTimer: implementation
+// ============================================================================
+
+WTWallClockTimer::WTWallClockTimer() {
+    m_listener = NULL;
+    m_deadline = 0;
+    m_stop = false;
+    m_fd = -1;
+}
+
+WTWallClockTimer::~WTWallClockTimer() {
+    Stop();
+}
+
+#ifdef WT_QUIET_TIMERFD
+
+/// Create the timer and start the thread that waits for it
+bool WTWallClockTimer::Start(WTDeadlineListener* listener) {
+    if (m_poller.Running()) {
+        return true;
+    }
+    m_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    m_listener = listener;
+    if (m_fd < 0 || !m_poller.Start([this]() { Run(); })) {
+        Stop();
+        return false;
+    }
+    return true;
+}
+
+/// Stop the thread and release the timer
+void WTWallClockTimer::Stop() {
+    m_poller.Stop();
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+/// Set the deadline, as an absolute time on the realtime clock, so that it
+/// expires after a suspend as soon as the system resumes: a timer without
+/// deadline is armed far in the future, because only an armed timer
+/// reports changes of the clock
+void WTWallClockTimer::Arm(time_t deadline) {
+    if (m_fd < 0) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline ? deadline : time(NULL) + 366 * 86400L;
+    timerfd_settime(m_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+/// Wait for the timer: a read that fails with ECANCELED means that the
+/// clock has been set, and the deadline has to be computed again
+void WTWallClockTimer::Run() {
+    struct pollfd fds[2];
+    fds[0].fd = m_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_poller.WakeFd();
+    fds[1].events = POLLIN;
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t expirations;
+            ssize_t r = read(m_fd, &expirations, sizeof(expirations));
+            if (r == (ssize_t)sizeof(expirations)) {
+                m_listener->OnDeadline(false);
+            } else if (r < 0 && errno == ECANCELED) {
+                m_listener->OnDeadline(true);
+            }
+        }
+    }
+}
+
+#else
+
+/// Start the thread that checks the wall clock
+bool WTWallClockTimer::Start(WTDeadlineListener* listener) {
+    if (m_thread.joinable()) {
+        return true;
+    }
+    m_listener = listener;
+    m_stop = false;
+    m_thread = std::thread(&WTWallClockTimer::Run, this);
+    return true;
+}
+
+/// Stop the thread
+void WTWallClockTimer::Stop() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+}
+
+/// Set the deadline, as an absolute time
+void WTWallClockTimer::Arm(time_t deadline) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_deadline = deadline;
+    }
+    m_cond.notify_all();
+}
+
+/// Check the wall clock at most every QUIET_FALLBACK_CHECK seconds, which
+/// also bounds the delay after a suspend or a change of the clock
+void WTWallClockTimer::Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        time_t now = time(NULL);
+        if (m_deadline != 0 && now >= m_deadline) {
+            m_deadline = 0;
+            lock.unlock();
+            m_listener->OnDeadline(false);
+            lock.lock();
+            continue;
+        }
+        long wait = QUIET_FALLBACK_CHECK;
+        if (m_deadline != 0 && m_deadline - now < wait) {
+            wait = (long)(m_deadline - now);
+        }
+        m_cond.wait_for(lock, std::chrono::seconds(wait));
+    }
+}
+
+#endif // WT_QUIET_TIMERFD
+
+
+// end.
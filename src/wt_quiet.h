@@ -0,0 +1,90 @@
+/// whenever_tray
+///
+/// Quiet hours: recurring windows of local time, on given days of the week,
+/// in which the scheduler is kept paused. The schedule only computes the
+/// next instant at which the state may change, and a single timer bound to
+/// the wall clock waits for that instant: on Linux a timerfd armed on the
+/// realtime clock both fires after a suspend and reports discontinuous
+/// changes of the clock, elsewhere the wall clock is checked at relaxed
+/// intervals. Instants are computed with mktime, so that changes between
+/// standard and daylight saving time are taken into account.
+///
+/// The listener is notified from the timer thread. This module does not
+/// depend on wxWidgets.
+
+#ifndef WT_QUIET_H
+#define WT_QUIET_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "wt_pollthread.h"
+
+// A window of local time: the end is excluded, and a window whose end does
+// not follow its start crosses midnight; the days refer to the start
+struct WTQuietWindow {
+    unsigned int days;          // bit 0 is Sunday, as in struct tm
+    int start;                  // minutes since midnight
+    int end;                    // minutes since midnight
+};
+
+bool WTParseQuietDays(const std::string& s, unsigned int& days);
+bool WTParseClockTime(const std::string& s, int& minutes);
+
+// Set of quiet windows
+class WTQuietSchedule {
+public:
+    void Add(const WTQuietWindow& window) {
+        m_windows.push_back(window);
+    }
+    bool Empty() const {
+        return m_windows.empty();
+    }
+
+    // tell whether the given instant is quiet, and the next instant at which
+    // this may change
+    bool Quiet(time_t now, time_t& next) const;
+
+private:
+    std::vector<WTQuietWindow> m_windows;
+};
+
+// Receiver of the timer expiration: called from the timer thread, also
+// when the wall clock has been changed, so that the deadline is recomputed
+class WTDeadlineListener {
+public:
+    virtual ~WTDeadlineListener() { }
+    virtual void OnDeadline(bool clock_changed) = 0;
+};
+
+// Timer bound to the wall clock, with a single deadline
+class WTWallClockTimer {
+public:
+    WTWallClockTimer();
+    ~WTWallClockTimer();
+
+    bool Start(WTDeadlineListener* listener);
+    void Stop();
+    void Arm(time_t deadline);
+
+private:
+    void Run();
+
+    WTDeadlineListener* m_listener;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    time_t m_deadline;
+    bool m_stop;
+    int m_fd;
+    WTPollThread m_poller;
+};
+
+
+#endif // WT_QUIET_H
+
+// end.
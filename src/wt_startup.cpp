@@ -0,0 +1,188 @@
+/// whenever_tray
+///
+/// Startup gate, based on the load figures found in /proc on Linux.
+
+#include <cstdio>
+#include <cstring>
+
+#include "wt_startup.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#define WT_STARTUP_PROCFS
+#endif
+
+
+// ============================================================================
+// WTStartupGate: implementation
+// ============================================================================
+
+/// Constructor: the gate is open unless delays or thresholds are given
+WTStartupGate::WTStartupGate()
+    : m_minDelay(0), m_maxDelay(0),
+      m_load(0), m_pressure(0), m_disk(0),
+      m_root("/proc"),
+      m_beganAt(0), m_sampledAt(0), m_calm(0),
+      m_blocker("") {
+    m_sample.load_per_cpu = -1;
+    m_sample.cpu_pressure = -1;
+    m_sample.io_pressure = -1;
+    m_sample.disk_busy = -1;
+}
+
+/// Set the minimum and maximum delays: the maximum is at least the minimum
+void WTStartupGate::SetDelays(long min_ms, long max_ms) {
+    m_minDelay = min_ms > 0 ? min_ms : 0;
+    m_maxDelay = max_ms > m_minDelay ? max_ms : m_minDelay;
+}
+
+/// Set the load average per CPU below which the system is calm (0 ignores it)
+void WTStartupGate::SetLoad(double load_per_cpu) {
+    m_load = load_per_cpu;
+}
+
+/// Set the CPU and I/O pressure below which the system is calm (0 ignores it)
+void WTStartupGate::SetPressure(double percent) {
+    m_pressure = percent;
+}
+
+/// Set the utilization of the busiest disk below which the system is calm
+/// (0 ignores it)
+void WTStartupGate::SetDisk(double percent) {
+    m_disk = percent;
+}
+
+/// Set the root of the proc filesystem, to use a fake tree for testing
+void WTStartupGate::SetRoot(const std::string& root) {
+    m_root = root;
+}
+
+/// Tell whether there is any reason to delay the start of the scheduler
+bool WTStartupGate::Enabled() const {
+    return m_minDelay > 0 || m_load > 0 || m_pressure > 0 || m_disk > 0;
+}
+
+/// Start waiting: time is given in milliseconds, on a monotonic clock
+void WTStartupGate::Begin(long long now) {
+    m_beganAt = now;
+    m_sampledAt = 0;
+    m_calm = 0;
+    m_diskTicks.clear();
+    m_blocker = "";
+    Sample(now);
+}
+
+/// Check whether the scheduler can be started: the figures are sampled at
+/// every check, also during the minimum delay, so that the scheduler can be
+/// started as soon as the delay expires if the system is already calm; the
+/// maximum delay only applies while the system is busy
+WTStartupDecision WTStartupGate::Check(long long now) {
+    long long elapsed = now - m_beganAt;
+    Sample(now);
+
+    // the first figure above its threshold is reported as the blocker,
+    // while figures that are not available never block
+    const WTLoadSample& s = m_sample;
+    if (m_load > 0 && s.load_per_cpu >= m_load) {
+        m_blocker = "load";
+    } else if (m_pressure > 0 && s.cpu_pressure >= m_pressure) {
+        m_blocker = "cpu pressure";
+    } else if (m_pressure > 0 && s.io_pressure >= m_pressure) {
+        m_blocker = "io pressure";
+    } else if (m_disk > 0 && s.disk_busy >= m_disk) {
+        m_blocker = "disk";
+    } else {
+        m_blocker = "";
+    }
+    m_calm = m_blocker[0] ? 0 : m_calm + 1;
+
+    if (elapsed < m_minDelay) {
+        m_blocker = "delay";
+        return WT_STARTUP_WAIT;
+    }
+    if (m_calm >= WT_STARTUP_CALM_CHECKS) {
+        return WT_STARTUP_SETTLED;
+    }
+    return elapsed >= m_maxDelay ? WT_STARTUP_TIMEOUT : WT_STARTUP_WAIT;
+}
+
+#ifdef WT_STARTUP_PROCFS
+
+// read the "some" average over 10 seconds from a pressure file
+static double read_pressure(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return -1;
+    }
+    double avg10 = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "some avg10=%lf", &avg10) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return avg10;
+}
+
+/// Read the figures: the disk utilization is the share of time in which the
+/// busiest device had requests in flight since the previous sample, so that
+/// partitions (never busier than their disk) do not need to be told apart
+bool WTStartupGate::Sample(long long now) {
+    FILE* f = fopen((m_root + "/loadavg").c_str(), "r");
+    double load;
+    if (f && fscanf(f, "%lf", &load) == 1) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        m_sample.load_per_cpu = load / (cpus > 0 ? cpus : 1);
+    } else {
+        m_sample.load_per_cpu = -1;
+    }
+    if (f) {
+        fclose(f);
+    }
+    m_sample.cpu_pressure = read_pressure(m_root + "/pressure/cpu");
+    m_sample.io_pressure = read_pressure(m_root + "/pressure/io");
+
+    f = fopen((m_root + "/diskstats").c_str(), "r");
+    if (!f) {
+        m_sample.disk_busy = -1;
+        return false;
+    }
+    long long interval = now - m_sampledAt;
+    double busiest = -1;
+    char line[512], name[64];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long st[10];
+        if (sscanf(line, "%*u %*u %63s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+                   name, &st[0], &st[1], &st[2], &st[3], &st[4],
+                   &st[5], &st[6], &st[7], &st[8], &st[9]) != 11
+            || strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0) {
+            continue;
+        }
+        // the tenth field is the time spent with requests in flight
+        std::map<std::string, unsigned long long>::iterator it = m_diskTicks.find(name);
+        if (it != m_diskTicks.end() && interval > 0 && st[9] >= it->second) {
+            double busy = 100.0 * (double)(st[9] - it->second) / (double)interval;
+            if (busy > busiest) {
+                busiest = busy > 100.0 ? 100.0 : busy;
+            }
+        }
+        m_diskTicks[name] = st[9];
+    }
+    fclose(f);
+    m_sample.disk_busy = busiest;
+    m_sampledAt = now;
+    return true;
+}
+
+#else
+
+bool WTStartupGate::Sample(long long now) {
+    (void)now;
+    return false;
+}
+
+#endif
+
+
+// end.
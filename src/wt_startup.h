@@ -0,0 +1,78 @@
+/// whenever_tray
+///
+/// Startup gate: the scheduler is started after a minimum delay, and then
+/// as soon as the system has settled after the login, that is when the
+/// load average per CPU, the CPU and I/O pressure and the disk utilization
+/// are all below the configured thresholds, or anyway after a maximum delay.
+/// The figures are read from /proc on Linux; elsewhere only the delays are
+/// honored. This module does not depend on wxWidgets.
+
+#ifndef WT_STARTUP_H
+#define WT_STARTUP_H
+
+#include <map>
+#include <string>
+
+// Figures describing how busy the system is: a negative value means that
+// the figure is not available on this system
+struct WTLoadSample {
+    double load_per_cpu;        // one minute load average, divided by CPUs
+    double cpu_pressure;        // percentage, "some" average over 10 s
+    double io_pressure;         // percentage, "some" average over 10 s
+    double disk_busy;           // percentage for the busiest disk
+};
+
+// consecutive calm checks required to consider the system settled
+#define WT_STARTUP_CALM_CHECKS 2
+
+// outcome of a check of the gate
+enum WTStartupDecision {
+    WT_STARTUP_WAIT = 0,
+    WT_STARTUP_SETTLED,
+    WT_STARTUP_TIMEOUT,
+};
+
+// Decide when the scheduler can be started: the gate is checked at regular
+// intervals, and the system is considered settled when all the figures are
+// below the thresholds in WT_STARTUP_CALM_CHECKS consecutive checks
+class WTStartupGate {
+public:
+    WTStartupGate();
+
+    void SetDelays(long min_ms, long max_ms);
+    void SetLoad(double load_per_cpu);
+    void SetPressure(double percent);
+    void SetDisk(double percent);
+    void SetRoot(const std::string& root);
+    bool Enabled() const;
+
+    void Begin(long long now);
+    WTStartupDecision Check(long long now);
+    const WTLoadSample& LastSample() const {
+        return m_sample;
+    }
+    const char* Blocker() const {
+        return m_blocker;
+    }
+    long long Waited(long long now) const {
+        return now - m_beganAt;
+    }
+
+private:
+    bool Sample(long long now);
+
+    long m_minDelay, m_maxDelay;
+    double m_load, m_pressure, m_disk;
+    std::string m_root;
+    long long m_beganAt;
+    long long m_sampledAt;
+    std::map<std::string, unsigned long long> m_diskTicks;
+    int m_calm;
+    WTLoadSample m_sample;
+    const char* m_blocker;
+};
+
+
+#endif // WT_STARTUP_H
+
+// end.
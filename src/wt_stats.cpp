@@ -0,0 +1,239 @@
+/// whenever_tray
+///
+/// Windows showing statistics about the scheduler.
+
+// For compilers that support precompilation, includes "wx.h".
+#include "wx/wxprec.h"
+
+#ifndef WX_PRECOMP
+#include "wx/wx.h"
+#endif
+
+#include <algorithm>
+
+#include <wx/dcbuffer.h>
+#include <wx/datetime.h>
+#include <wx/listctrl.h>
+#include <wx/sizer.h>
+
+#include "wt_stats.h"
+
+// layout of the charts
+#define CHART_MARGIN 8
+#define CHART_TITLE_HEIGHT 18
+#define CHART_MIN_WIDTH 480
+#define CHART_MIN_HEIGHT 360
+
+// minimum height of the table of tasks and conditions
+#define TASKS_MIN_HEIGHT 160
+
+
+// ============================================================================
+// WTHistoryChart: implementation
+// ============================================================================
+
+wxBEGIN_EVENT_TABLE(WTHistoryChart, wxPanel)
+    EVT_PAINT(WTHistoryChart::OnPaint)
+wxEND_EVENT_TABLE()
+
+WTHistoryChart::WTHistoryChart(wxWindow* parent) : wxPanel(parent, wxID_ANY) {
+    SetBackgroundStyle(wxBG_STYLE_PAINT);
+    SetMinSize(wxSize(CHART_MIN_WIDTH, CHART_MIN_HEIGHT));
+}
+
+void WTHistoryChart::SetRecords(const std::vector<WTHistoryRecord>& records) {
+    m_records = records;
+    Refresh();
+}
+
+/// Draw a series as a polyline over the area, scaled to its maximum: when
+/// there are more values than pixels, only one value per pixel is drawn
+void WTHistoryChart::DrawSeries(wxDC& dc, const wxRect& area, const wxString& title,
+                                const wxString& unit, const std::vector<double>& values) {
+    double top = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i] > top) {
+            top = values[i];
+        }
+    }
+    dc.SetTextForeground(*wxBLACK);
+    dc.DrawText(wxString::Format("%s (max %.1f %s)", title, top, unit),
+                area.x, area.y);
+
+    int x0 = area.x, y0 = area.y + CHART_TITLE_HEIGHT;
+    int w = area.width, h = area.height - CHART_TITLE_HEIGHT;
+    if (w < 2 || h < 2) {
+        return;
+    }
+    dc.SetPen(wxPen(*wxLIGHT_GREY));
+    dc.SetBrush(*wxTRANSPARENT_BRUSH);
+    dc.DrawRectangle(x0, y0, w, h);
+    if (values.size() < 2) {
+        return;
+    }
+    if (top <= 0) {
+        top = 1;
+    }
+
+    std::vector<wxPoint> points;
+    points.reserve(w);
+    size_t n = values.size();
+    int last_x = -1;
+    for (size_t i = 0; i < n; i++) {
+        int x = x0 + (int)((double)i * (w - 1) / (double)(n - 1));
+        if (x == last_x) {
+            continue;
+        }
+        last_x = x;
+        int y = y0 + h - 1 - (int)(values[i] * (h - 1) / top);
+        points.push_back(wxPoint(x, y));
+    }
+    dc.SetPen(wxPen(wxColour(0, 96, 192)));
+    dc.DrawLines((int)points.size(), &points[0]);
+}
+
+/// Draw CPU, memory and command latency one above the other, marking the
+/// scheduler restarts with vertical lines
+void WTHistoryChart::OnPaint(wxPaintEvent& WXUNUSED(event)) {
+    wxAutoBufferedPaintDC dc(this);
+    dc.SetBackground(*wxWHITE_BRUSH);
+    dc.Clear();
+
+    wxSize size = GetClientSize();
+    if (m_records.empty()) {
+        dc.DrawText("No history recorded yet.", CHART_MARGIN, CHART_MARGIN);
+        return;
+    }
+
+    std::vector<double> cpu, rss, latency;
+    cpu.reserve(m_records.size());
+    rss.reserve(m_records.size());
+    latency.reserve(m_records.size());
+    for (size_t i = 0; i < m_records.size(); i++) {
+        cpu.push_back(m_records[i].cpu_permille / 10.0);
+        rss.push_back(m_records[i].rss_bytes / (1024.0 * 1024.0));
+        latency.push_back(m_records[i].latency_ms);
+    }
+
+    // time span, shown at the bottom
+    wxDateTime first(wxLongLong(m_records.front().timestamp));
+    wxDateTime last(wxLongLong(m_records.back().timestamp));
+    wxString span = wxString::Format("%s - %s (%u samples)",
+        first.FormatISOCombined(' '), last.FormatISOCombined(' '),
+        (unsigned)m_records.size());
+
+    int w = size.GetWidth() - 2 * CHART_MARGIN;
+    int h = (size.GetHeight() - 2 * CHART_MARGIN - CHART_TITLE_HEIGHT) / 3;
+    wxRect area;
+    area.x = CHART_MARGIN;
+    area.width = w;
+    area.height = h - CHART_MARGIN;
+
+    area.y = CHART_MARGIN;
+    DrawSeries(dc, area, "CPU", "%", cpu);
+    area.y += h;
+    DrawSeries(dc, area, "Resident memory", "MB", rss);
+    area.y += h;
+    DrawSeries(dc, area, "Command latency", "ms", latency);
+
+    dc.SetPen(wxPen(wxColour(192, 0, 0)));
+    size_t n = m_records.size();
+    for (size_t i = 1; i < n; i++) {
+        if (m_records[i].restarts != m_records[i - 1].restarts) {
+            int x = CHART_MARGIN + (int)((double)i * (w - 1) / (double)(n - 1));
+            dc.DrawLine(x, CHART_MARGIN + CHART_TITLE_HEIGHT, x, area.y + area.height);
+        }
+    }
+    dc.DrawText(span, CHART_MARGIN, size.GetHeight() - CHART_MARGIN - CHART_TITLE_HEIGHT);
+}
+
+
+// ============================================================================
+// WTStatsFrame: implementation
+// ============================================================================
+
+WTStatsFrame::WTStatsFrame(wxWindow* parent, const wxString& history_path,
+                           const WTTaskStats* task_stats)
+    : wxFrame(parent, wxID_ANY, "Scheduler Statistics") {
+    m_historyPath = history_path;
+    m_taskStats = task_stats;
+    m_chart = new WTHistoryChart(this);
+    m_tasks = new wxListCtrl(this, wxID_ANY, wxDefaultPosition,
+                             wxSize(CHART_MIN_WIDTH, TASKS_MIN_HEIGHT),
+                             wxLC_REPORT | wxLC_SINGLE_SEL);
+    const char* columns[] = {
+        "Name", "Kind", "Runs", "Succeeded", "Failed",
+        "Median", "95th pct.", "Longest", "Total", NULL,
+    };
+    for (int i = 0; columns[i]; i++) {
+        m_tasks->InsertColumn(i, columns[i], i < 2 ? wxLIST_FORMAT_LEFT : wxLIST_FORMAT_RIGHT);
+    }
+
+    wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    sizer->Add(m_chart, 2, wxEXPAND);
+    sizer->Add(m_tasks, 1, wxEXPAND);
+    SetSizerAndFit(sizer);
+    Reload();
+}
+
+/// Read the history file again and redraw the charts
+void WTStatsFrame::Reload() {
+    std::vector<WTHistoryRecord> records;
+    WTHistoryFile::Read(m_historyPath.ToStdString(), records);
+    m_chart->SetRecords(records);
+    ReloadTasks();
+}
+
+// format a duration in milliseconds with a suitable unit
+static wxString FormatDuration(unsigned long long ms) {
+    if (ms < 1000) {
+        return wxString::Format("%llu ms", ms);
+    } else if (ms < 60 * 1000) {
+        return wxString::Format("%.1f s", ms / 1000.0);
+    } else if (ms < 60 * 60 * 1000) {
+        return wxString::Format("%.1f min", ms / 60000.0);
+    }
+    return wxString::Format("%.1f h", ms / 3600000.0);
+}
+
+// order of the table: the items that took longer overall come first
+static bool ByTotalTime(const WTItemStats* a, const WTItemStats* b) {
+    if (a->durations.Sum() != b->durations.Sum()) {
+        return a->durations.Sum() > b->durations.Sum();
+    }
+    return a->started > b->started;
+}
+
+/// Fill the table from the aggregates, which are already up to date: the
+/// cost depends on the number of tasks and conditions, not on the log
+void WTStatsFrame::ReloadTasks() {
+    if (!m_taskStats) {
+        return;
+    }
+    std::vector<const WTItemStats*> items = m_taskStats->Items();
+    std::stable_sort(items.begin(), items.end(), ByTotalTime);
+    m_tasks->Freeze();
+    m_tasks->DeleteAllItems();
+    for (size_t i = 0; i < items.size(); i++) {
+        const WTItemStats& item = *items[i];
+        const WTDurationHistogram& d = item.durations;
+        long row = m_tasks->InsertItem((long)i, wxString(item.name));
+        m_tasks->SetItem(row, 1, item.kind == WT_STATS_TASK ? "task" : "condition");
+        m_tasks->SetItem(row, 2, wxString::Format("%llu", item.started));
+        m_tasks->SetItem(row, 3, wxString::Format("%llu", item.succeeded));
+        m_tasks->SetItem(row, 4, wxString::Format("%llu", item.failed));
+        if (d.Count() > 0) {
+            m_tasks->SetItem(row, 5, FormatDuration(d.Percentile(0.5)));
+            m_tasks->SetItem(row, 6, FormatDuration(d.Percentile(0.95)));
+            m_tasks->SetItem(row, 7, FormatDuration(d.Max()));
+            m_tasks->SetItem(row, 8, FormatDuration(d.Sum()));
+        }
+    }
+    for (int i = 0; i < m_tasks->GetColumnCount(); i++) {
+        m_tasks->SetColumnWidth(i, wxLIST_AUTOSIZE_USEHEADER);
+    }
+    m_tasks->Thaw();
+}
+
+
+// end.
@@ -0,0 +1,55 @@
+/// whenever_tray
+///
+/// Windows showing statistics about the scheduler: they are created only
+/// upon request and destroyed when closed, so that they take no resources
+/// while the tray is just waiting in the background.
+
+#ifndef WT_STATS_H
+#define WT_STATS_H
+
+#include <vector>
+
+#include "wt_history.h"
+#include "wt_taskstats.h"
+
+class wxListCtrl;
+
+// Panel drawing the charts of the samples found in the history file
+class WTHistoryChart : public wxPanel {
+public:
+    WTHistoryChart(wxWindow* parent);
+
+    void SetRecords(const std::vector<WTHistoryRecord>& records);
+
+protected:
+    void OnPaint(wxPaintEvent& event);
+
+private:
+    void DrawSeries(wxDC& dc, const wxRect& area, const wxString& title,
+                    const wxString& unit, const std::vector<double>& values);
+
+    std::vector<WTHistoryRecord> m_records;
+
+    wxDECLARE_EVENT_TABLE();
+};
+
+// Top level window for the statistics
+class WTStatsFrame : public wxFrame {
+public:
+    WTStatsFrame(wxWindow* parent, const wxString& history_path,
+                 const WTTaskStats* task_stats);
+
+    void Reload();
+    void ReloadTasks();
+
+private:
+    wxString m_historyPath;
+    WTHistoryChart* m_chart;
+    const WTTaskStats* m_taskStats;
+    wxListCtrl* m_tasks;
+};
+
+
+#endif // WT_STATS_H
+
+// end.
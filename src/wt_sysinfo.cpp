@@ -0,0 +1,110 @@
+/// whenever_tray
+///
+/// Access to information provided by the operating system about processes
+/// and about the system itself.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "wt_sysinfo.h"
+
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+long long WTMonotonicMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if defined(__linux__)
+// read a small file in a caller provided buffer, NUL-terminating it
+static bool read_small_file(const char* path, char* buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    buf[n] = 0;
+    return true;
+}
+#endif
+
+
+// ----------------------------------------------------------------------------
+// process information
+// ----------------------------------------------------------------------------
+
+/// Read CPU time and RSS of a process from `/proc/<pid>/stat`: fields are
+/// counted after the command name, which is enclosed in parentheses and
+/// may contain spaces
+bool WTSampleProcess(long pid, WTProcessSample& sample) {
+#if defined(__linux__)
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+    if (!read_small_file(path, buf, sizeof(buf))) {
+        return false;
+    }
+    char* p = strrchr(buf, ')');
+    if (!p) {
+        return false;
+    }
+    // field 3 (state) follows the command name: utime and stime are the
+    // fields 14 and 15, rss is field 24
+    long long utime = 0, stime = 0, rss = 0;
+    int field = 2;
+    for (p++; *p && field < 24; ) {
+        while (*p == ' ') {
+            p++;
+        }
+        field++;
+        if (field == 14) {
+            utime = strtoll(p, NULL, 10);
+        } else if (field == 15) {
+            stime = strtoll(p, NULL, 10);
+        } else if (field == 24) {
+            rss = strtoll(p, NULL, 10);
+        }
+        while (*p && *p != ' ') {
+            p++;
+        }
+    }
+    if (field < 24) {
+        return false;
+    }
+    static long ticks = sysconf(_SC_CLK_TCK);
+    static long page = sysconf(_SC_PAGESIZE);
+    sample.timestamp = WTMonotonicMillis();
+    sample.cpu_ms = (utime + stime) * 1000 / (ticks > 0 ? ticks : 100);
+    sample.rss_bytes = rss * page;
+    return true;
+#else
+    (void)pid;
+    (void)sample;
+    return false;
+#endif
+}
+
+/// Percentage of one CPU used by the process between two samples
+double WTCpuPercent(const WTProcessSample& prev, const WTProcessSample& cur) {
+    long long elapsed = cur.timestamp - prev.timestamp;
+    if (elapsed <= 0 || cur.cpu_ms < prev.cpu_ms) {
+        return 0.0;
+    }
+    return 100.0 * (double)(cur.cpu_ms - prev.cpu_ms) / (double)elapsed;
+}
+
+
+// end.
@@ -0,0 +1,30 @@
+/// whenever_tray
+///
+/// Access to information provided by the operating system about processes
+/// and about the system itself. On Linux the information is read from the
+/// `/proc` pseudo-filesystem using fixed size buffers; on other platforms
+/// the functions just report that the information is not available.
+
+#ifndef WT_SYSINFO_H
+#define WT_SYSINFO_H
+
+// resource usage of a process at a given time
+struct WTProcessSample {
+    long long timestamp;    // milliseconds, monotonic clock
+    long long cpu_ms;       // user + system CPU time
+    long long rss_bytes;    // resident set size
+};
+
+// monotonic time in milliseconds, to compute durations and rates
+long long WTMonotonicMillis();
+
+// sample the resource usage of a process: return false if not available
+bool WTSampleProcess(long pid, WTProcessSample& sample);
+
+// CPU usage (percentage of one CPU) between two samples of a process
+double WTCpuPercent(const WTProcessSample& prev, const WTProcessSample& cur);
+
+
+#endif // WT_SYSINFO_H
+
+// end.
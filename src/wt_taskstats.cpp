@@ -0,0 +1,386 @@
+/// whenever_tray
+///
+/// Statistics about the tasks and the conditions of the scheduler.
+
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "wt_taskstats.h"
+
+#if defined(_WIN32)
+#define TASKSTATS_SEEK _fseeki64
+#define TASKSTATS_STAT _stati64
+typedef struct _stati64 taskstats_stat_t;
+#else
+#define TASKSTATS_SEEK fseeko
+#define TASKSTATS_STAT stat
+typedef struct stat taskstats_stat_t;
+#endif
+
+// size of the buffer used for reading the log
+#define TASKSTATS_BUFFER (64 * 1024)
+
+// header and trailer of the file of aggregates
+#define TASKSTATS_HEADER "whenever_tray taskstats 1"
+#define TASKSTATS_END "end"
+
+// structured log record fields: contexts of the items, beginning and end
+// of a run, and the statuses of a successful and of a failed run
+static const char* TASKSTATS_CONTEXTS[WT_STATS_KIND_COUNT] = {
+    "TASK",
+    "CONDITION",
+};
+static const char* TASKSTATS_WHEN_START = "START";
+static const char* TASKSTATS_WHEN_END = "END";
+static const char* TASKSTATS_STATUS_OK = "OK";
+static const char* TASKSTATS_STATUS_FAILED[] = {
+    "FAIL",
+    "ERR",
+    "ERROR",
+    NULL,
+};
+
+
+// ============================================================================
+// WTDurationHistogram: implementation
+// ============================================================================
+
+/// Values below WT_DURATION_SUB_COUNT have a bucket each, then every power
+/// of two is split in WT_DURATION_SUB_COUNT buckets of the same width
+size_t WTDurationHistogram::Bucket(unsigned long long ms) {
+    if (ms < WT_DURATION_SUB_COUNT) {
+        return (size_t)ms;
+    }
+    int top = 63;
+    while (!(ms >> top)) {
+        top--;
+    }
+    int shift = top - WT_DURATION_SUB_BITS;
+    return (size_t)(shift + 1) * WT_DURATION_SUB_COUNT
+           + (size_t)((ms >> shift) & (WT_DURATION_SUB_COUNT - 1));
+}
+
+unsigned long long WTDurationHistogram::Lowest(size_t bucket) {
+    if (bucket < 2 * WT_DURATION_SUB_COUNT) {
+        return bucket;
+    }
+    int shift = (int)(bucket / WT_DURATION_SUB_COUNT) - 1;
+    return (unsigned long long)(WT_DURATION_SUB_COUNT + bucket % WT_DURATION_SUB_COUNT) << shift;
+}
+
+unsigned long long WTDurationHistogram::Highest(size_t bucket) {
+    if (bucket < 2 * WT_DURATION_SUB_COUNT) {
+        return bucket;
+    }
+    int shift = (int)(bucket / WT_DURATION_SUB_COUNT) - 1;
+    return Lowest(bucket) + (1ULL << shift) - 1;
+}
+
+void WTDurationHistogram::Record(unsigned long long ms) {
+    size_t bucket = Bucket(ms);
+    if (bucket >= m_buckets.size()) {
+        m_buckets.resize(bucket + 1, 0);
+    }
+    m_buckets[bucket]++;
+    m_count++;
+    m_sum += ms;
+    if (ms > m_max) {
+        m_max = ms;
+    }
+}
+
+/// The highest value of the bucket where the fraction is reached, which
+/// is never more than the largest duration recorded
+unsigned long long WTDurationHistogram::Percentile(double fraction) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(fraction * m_count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < m_buckets.size(); i++) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            unsigned long long value = Highest(i);
+            return value < m_max ? value : m_max;
+        }
+    }
+    return m_max;
+}
+
+
+// ============================================================================
+// WTTaskStats: implementation
+// ============================================================================
+
+WTTaskStats::WTTaskStats() {
+    Clear();
+}
+
+/// Forget the aggregates and start reading the log from the beginning
+void WTTaskStats::Clear() {
+    m_items.clear();
+    m_segment.clear();
+    m_identity.device = m_identity.inode = 0;
+    m_offset = 0;
+    m_pending = 0;
+}
+
+/// Tell a file by device and inode: on Windows, where there are no inodes,
+/// the creation time is used instead
+bool WTTaskStats::Identify(const std::string& path, Identity& id, unsigned long long& size) {
+    taskstats_stat_t st;
+    if (TASKSTATS_STAT(path.c_str(), &st) != 0) {
+        return false;
+    }
+    id.device = (unsigned long long)st.st_dev;
+#if defined(_WIN32)
+    id.inode = (unsigned long long)st.st_ctime;
+#else
+    id.inode = (unsigned long long)st.st_ino;
+#endif
+    size = (unsigned long long)st.st_size;
+    return true;
+}
+
+void WTTaskStats::LogRotated(const std::string& segment) {
+    m_segment = segment;
+}
+
+/// Parse the complete lines of a file from the current offset, reading
+/// whole buffers until the budget is exhausted: a line still being written
+/// is left for the next time
+bool WTTaskStats::ReadFrom(const std::string& path, unsigned long long& budget, bool& complete) {
+    complete = false;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    if (TASKSTATS_SEEK(f, (long long)m_offset, SEEK_SET) != 0) {
+        fclose(f);
+        return false;
+    }
+    std::vector<char> buf(TASKSTATS_BUFFER);
+    size_t used = 0;
+    while (budget > 0) {
+        size_t n = fread(&buf[used], 1, buf.size() - used, f);
+        if (n == 0) {
+            complete = true;
+            break;
+        }
+        used += n;
+        budget = n < budget ? budget - n : 0;
+
+        size_t start = 0;
+        for (;;) {
+            const char* nl = (const char*)memchr(&buf[start], '\n', used - start);
+            if (!nl) {
+                break;
+            }
+            size_t len = nl - &buf[start];
+            Feed(&buf[start], len);
+            start += len + 1;
+        }
+        if (start == 0 && used == buf.size()) {
+            // a line longer than the buffer: its beginning is enough, and
+            // the rest does not look like a record
+            Feed(&buf[0], used);
+            start = used;
+        }
+        m_offset += start;
+        memmove(&buf[0], &buf[start], used - start);
+        used -= start;
+    }
+    fclose(f);
+    return true;
+}
+
+/// Parse the new part of the log: the rest of a rotated log comes first,
+/// provided that it is still the file that was being read
+bool WTTaskStats::Update(unsigned long long max_bytes) {
+    unsigned long long budget = max_bytes;
+    bool complete = true;
+    Identity id;
+    unsigned long long size;
+    if (!m_segment.empty()) {
+        if (Identify(m_segment, id, size) && id == m_identity && size > m_offset) {
+            ReadFrom(m_segment, budget, complete);
+            if (!complete) {
+                m_pending = size - m_offset;
+                return true;
+            }
+        }
+        m_segment.clear();
+        m_identity.device = m_identity.inode = 0;
+        m_offset = 0;
+    }
+    m_pending = 0;
+    if (!Identify(m_logPath, id, size)) {
+        return false;
+    }
+    if (!(id == m_identity) || size < m_offset) {
+        m_identity = id;
+        m_offset = 0;
+    }
+    if (size > m_offset && ReadFrom(m_logPath, budget, complete) && !complete) {
+        m_pending = size > m_offset ? size - m_offset : 0;
+        return true;
+    }
+    return false;
+}
+
+/// Account for a START or an END record of a task or of a condition: the
+/// duration of a run is known only if its beginning has been seen
+void WTTaskStats::Feed(const char* line, size_t len) {
+    WTLogRecord rec;
+    if (!WTParseLogLine(line, len, rec) || rec.name.len == 0) {
+        return;
+    }
+    int kind = 0;
+    while (kind < WT_STATS_KIND_COUNT && !rec.context.Is(TASKSTATS_CONTEXTS[kind])) {
+        kind++;
+    }
+    if (kind == WT_STATS_KIND_COUNT) {
+        return;
+    }
+    bool start = rec.when.Is(TASKSTATS_WHEN_START);
+    if (!start && !rec.when.Is(TASKSTATS_WHEN_END)) {
+        return;
+    }
+
+    std::pair<int, std::string> key(kind, std::string(rec.name.ptr, rec.name.len));
+    std::map<std::pair<int, std::string>, WTItemStats>::iterator it = m_items.find(key);
+    if (it == m_items.end()) {
+        WTItemStats item;
+        item.kind = (WTStatsKind)kind;
+        item.name = key.second;
+        item.started = item.succeeded = item.failed = 0;
+        item.last_start = item.last_end = 0;
+        it = m_items.insert(std::make_pair(key, item)).first;
+    }
+    WTItemStats& item = it->second;
+    if (start) {
+        item.started++;
+        item.last_start = rec.timestamp;
+        return;
+    }
+    if (rec.status.Is(TASKSTATS_STATUS_OK)) {
+        item.succeeded++;
+    } else {
+        for (int i = 0; TASKSTATS_STATUS_FAILED[i]; i++) {
+            if (rec.status.Is(TASKSTATS_STATUS_FAILED[i])) {
+                item.failed++;
+                break;
+            }
+        }
+    }
+    if (item.last_start > item.last_end && rec.timestamp >= item.last_start) {
+        item.durations.Record((unsigned long long)(rec.timestamp - item.last_start));
+    }
+    item.last_end = rec.timestamp;
+}
+
+/// Return the items, in the order of the map
+std::vector<const WTItemStats*> WTTaskStats::Items() const {
+    std::vector<const WTItemStats*> items;
+    items.reserve(m_items.size());
+    std::map<std::pair<int, std::string>, WTItemStats>::const_iterator it;
+    for (it = m_items.begin(); it != m_items.end(); ++it) {
+        items.push_back(&it->second);
+    }
+    return items;
+}
+
+/// Write the aggregates through a temporary file: each item is followed by
+/// its non-empty buckets
+bool WTTaskStats::Save(const std::string& path) const {
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    bool ok = fprintf(f, "%s\nlog %llu %llu %llu\n", TASKSTATS_HEADER,
+                      m_identity.device, m_identity.inode, m_offset) > 0;
+    std::map<std::pair<int, std::string>, WTItemStats>::const_iterator it;
+    for (it = m_items.begin(); ok && it != m_items.end(); ++it) {
+        const WTItemStats& item = it->second;
+        const WTDurationHistogram& h = item.durations;
+        ok = fprintf(f, "item %d %llu %llu %llu %lld %lld %llu %llu %llu %s\n",
+                     (int)item.kind, item.started, item.succeeded, item.failed,
+                     item.last_start, item.last_end, h.m_count, h.m_sum, h.m_max,
+                     item.name.c_str()) > 0;
+        for (size_t i = 0; ok && i < h.m_buckets.size(); i++) {
+            if (h.m_buckets[i]) {
+                ok = fprintf(f, "bucket %u %llu\n", (unsigned)i, h.m_buckets[i]) > 0;
+            }
+        }
+    }
+    ok = ok && fprintf(f, "%s\n", TASKSTATS_END) > 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Read the aggregates back: a file without its trailer is incomplete, and
+/// is rejected, in which case the log is parsed again from the beginning
+bool WTTaskStats::Load(const std::string& path) {
+    Clear();
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    char line[512];
+    char name[256];
+    bool complete = false;
+    WTItemStats* item = NULL;
+    if (fgets(line, sizeof(line), f)
+        && strncmp(line, TASKSTATS_HEADER, strlen(TASKSTATS_HEADER)) == 0) {
+        while (fgets(line, sizeof(line), f)) {
+            WTItemStats s;
+            int kind;
+            unsigned bucket;
+            unsigned long long count;
+            if (sscanf(line, "item %d %llu %llu %llu %lld %lld %llu %llu %llu %255s",
+                       &kind, &s.started, &s.succeeded, &s.failed, &s.last_start,
+                       &s.last_end, &s.durations.m_count, &s.durations.m_sum,
+                       &s.durations.m_max, name) == 10
+                && kind >= 0 && kind < WT_STATS_KIND_COUNT) {
+                s.kind = (WTStatsKind)kind;
+                s.name = name;
+                item = &m_items[std::make_pair(kind, s.name)];
+                *item = s;
+            } else if (sscanf(line, "bucket %u %llu", &bucket, &count) == 2) {
+                if (item && bucket < 64 * WT_DURATION_SUB_COUNT
+                    && WTDurationHistogram::Lowest(bucket) <= item->durations.m_max) {
+                    if (bucket >= item->durations.m_buckets.size()) {
+                        item->durations.m_buckets.resize(bucket + 1, 0);
+                    }
+                    item->durations.m_buckets[bucket] = count;
+                }
+            } else if (sscanf(line, "log %llu %llu %llu", &m_identity.device,
+                              &m_identity.inode, &m_offset) == 3) {
+                continue;
+            } else if (strncmp(line, TASKSTATS_END, strlen(TASKSTATS_END)) == 0) {
+                complete = true;
+                break;
+            }
+        }
+    }
+    fclose(f);
+    if (!complete) {
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+
+// end.
@@ -0,0 +1,149 @@
+/// whenever_tray
+///
+/// Statistics about the tasks and the conditions of the scheduler, built
+/// from the records found in its log. The log is read incrementally: only
+/// the bytes written since the last update are parsed, starting from the
+/// offset reached the previous time, and the file is recognized by its
+/// identity so that a log that has been replaced is read from the start.
+/// Each item keeps its counters and a histogram of durations, with
+/// logarithmic buckets split in linear sub-buckets (as in HDR histograms),
+/// so that its size does not depend on the number of runs and the error on
+/// any percentile is within about 6%. The aggregates and the offset are
+/// saved to a small text file, so that the log is not parsed again when the
+/// tray restarts.
+///
+/// This module does not depend on wxWidgets.
+
+#ifndef WT_TASKSTATS_H
+#define WT_TASKSTATS_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "wt_output.h"
+
+// linear sub-buckets in each power of two of a duration histogram
+#define WT_DURATION_SUB_BITS 4
+#define WT_DURATION_SUB_COUNT (1 << WT_DURATION_SUB_BITS)
+
+// Histogram of durations in milliseconds, with a relative resolution of
+// 1/WT_DURATION_SUB_COUNT: buckets are allocated up to the largest value
+class WTDurationHistogram {
+public:
+    WTDurationHistogram() : m_count(0), m_sum(0), m_max(0) { }
+
+    void Record(unsigned long long ms);
+
+    // value below which the given fraction of the durations falls
+    unsigned long long Percentile(double fraction) const;
+
+    unsigned long long Count() const {
+        return m_count;
+    }
+    unsigned long long Sum() const {
+        return m_sum;
+    }
+    unsigned long long Max() const {
+        return m_max;
+    }
+
+    // bucket of a value, and lowest and highest value of a bucket
+    static size_t Bucket(unsigned long long ms);
+    static unsigned long long Lowest(size_t bucket);
+    static unsigned long long Highest(size_t bucket);
+
+private:
+    friend class WTTaskStats;
+
+    std::vector<unsigned long long> m_buckets;
+    unsigned long long m_count;
+    unsigned long long m_sum;
+    unsigned long long m_max;
+};
+
+// kinds of items found in the log
+enum WTStatsKind {
+    WT_STATS_TASK = 0,
+    WT_STATS_CONDITION,
+    WT_STATS_KIND_COUNT,
+};
+
+// Counters of a task or of a condition: a run begins with a START record
+// and ends with an END record, whose status tells whether it succeeded
+struct WTItemStats {
+    WTStatsKind kind;
+    std::string name;
+    unsigned long long started;
+    unsigned long long succeeded;
+    unsigned long long failed;
+    long long last_start;           // timestamp of the last START, or 0
+    long long last_end;             // timestamp of the last END, or 0
+    WTDurationHistogram durations;
+};
+
+// Aggregates of the records of a log
+class WTTaskStats {
+public:
+    WTTaskStats();
+
+    void SetLogPath(const std::string& path) {
+        m_logPath = path;
+    }
+
+    // the log has been renamed: what is left of it is read from the new
+    // path before starting again with the new log
+    void LogRotated(const std::string& segment);
+
+    // parse at most about max_bytes new bytes of the log, returning true
+    // if more are left: the next call goes on from there
+    bool Update(unsigned long long max_bytes);
+
+    // feed a single line, as read from the log
+    void Feed(const char* line, size_t len);
+
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+    void Clear();
+
+    // the items, ordered by kind and name
+    std::vector<const WTItemStats*> Items() const;
+
+    // whether what is left of a rotated log is still to be parsed
+    bool Rotating() const {
+        return !m_segment.empty();
+    }
+
+    // bytes of the log parsed so far, and bytes still to be parsed
+    unsigned long long Offset() const {
+        return m_offset;
+    }
+    unsigned long long Pending() const {
+        return m_pending;
+    }
+
+private:
+    struct Identity {
+        unsigned long long device;
+        unsigned long long inode;
+
+        bool operator==(const Identity& other) const {
+            return device == other.device && inode == other.inode;
+        }
+    };
+
+    static bool Identify(const std::string& path, Identity& id, unsigned long long& size);
+    bool ReadFrom(const std::string& path, unsigned long long& budget, bool& complete);
+
+    std::string m_logPath;
+    std::string m_segment;
+    Identity m_identity;
+    unsigned long long m_offset;
+    unsigned long long m_pending;
+    std::map<std::pair<int, std::string>, WTItemStats> m_items;
+};
+
+
+#endif // WT_TASKSTATS_H
+
+// end.
@@ -0,0 +1,22 @@
+/// whenever_tray
+///
+/// Timing of the interaction with the scheduler: the time it is given to
+/// settle after being started and to leave after the exit command, and the
+/// time within which it is expected to acknowledge a command. The tests of
+/// the process layer and of the controller drive the fake scheduler with
+/// the same values as the tray.
+
+#ifndef WT_TIMING_H
+#define WT_TIMING_H
+
+#define APP_KILL_SLEEP 1500     // milliseconds
+#define APP_KILL_POLL 50        // milliseconds
+#define APP_START_SLEEP 500     // milliseconds
+#define APP_POLL_INTERVAL 250   // milliseconds
+#define APP_ACK_TIMEOUT 2000    // milliseconds
+#define APP_READ_CHUNK 4096     // bytes read from a pipe per poll
+
+
+#endif // WT_TIMING_H
+
+// end.
@@ -0,0 +1,214 @@
+/// whenever_tray
+///
+/// Traces of the input and output of the scheduler.
+
+#include <chrono>
+#include <cstring>
+
+#include "wt_trace.h"
+
+// signature at the beginning of a trace, including the format version
+static const char TRACE_SIGNATURE[8] = { 'W', 'T', 'T', 'R', 'A', 'C', 'E', 1 };
+
+// names of the kinds of records, indexed by WTTraceKind
+static const char* TRACE_KIND_NAMES[WT_TRACE_KIND_COUNT] = {
+    "stdin",
+    "stdout",
+    "stderr",
+    "start",
+    "exit",
+};
+
+// monotonic time in nanoseconds
+static unsigned long long trace_now() {
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* WTTraceKindName(WTTraceKind kind) {
+    return kind < WT_TRACE_KIND_COUNT ? TRACE_KIND_NAMES[kind] : "unknown";
+}
+
+
+// ============================================================================
+// WTTraceWriter: implementation
+// ============================================================================
+
+WTTraceWriter::WTTraceWriter()
+    : m_file(NULL), m_last(0), m_size(0), m_limit(0), m_truncated(false) {
+}
+
+WTTraceWriter::~WTTraceWriter() {
+    Close();
+}
+
+/// Create the file and write its header: the times of the records are
+/// counted from here
+bool WTTraceWriter::Open(const std::string& path, unsigned long long limit) {
+    Close();
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return false;
+    }
+    m_buffer.reserve(WT_TRACE_BUFFER);
+    m_buffer.clear();
+    m_size = 0;
+    m_limit = limit;
+    m_truncated = false;
+    m_last = trace_now();
+
+    long long started = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    unsigned char stamp[8];
+    for (int i = 0; i < 8; i++) {
+        stamp[i] = (unsigned char)((unsigned long long)started >> (8 * i));
+    }
+    Put(TRACE_SIGNATURE, sizeof(TRACE_SIGNATURE));
+    Put(stamp, sizeof(stamp));
+    return true;
+}
+
+void WTTraceWriter::Close() {
+    if (m_file) {
+        Flush();
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+/// Write the buffered records to the file
+void WTTraceWriter::Flush() {
+    if (m_file && !m_buffer.empty()) {
+        fwrite(&m_buffer[0], 1, m_buffer.size(), m_file);
+        fflush(m_file);
+        m_buffer.clear();
+    }
+}
+
+void WTTraceWriter::Put(const void* data, size_t len) {
+    if (m_buffer.size() + len > WT_TRACE_BUFFER) {
+        Flush();
+    }
+    if (len > WT_TRACE_BUFFER) {
+        fwrite(data, 1, len, m_file);
+    } else {
+        const char* p = (const char*)data;
+        m_buffer.insert(m_buffer.end(), p, p + len);
+    }
+    m_size += len;
+}
+
+/// Seven bits per byte, least significant first, with the high bit set on
+/// all bytes but the last
+void WTTraceWriter::PutVarint(unsigned long long value) {
+    unsigned char buf[10];
+    size_t n = 0;
+    while (value >= 0x80) {
+        buf[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (unsigned char)value;
+    Put(buf, n);
+}
+
+/// Append a record, unless the trace has reached its limit: in that case
+/// the trace is closed, so that it ends with a complete record
+void WTTraceWriter::Record(WTTraceKind kind, const char* data, size_t len) {
+    if (!m_file) {
+        return;
+    }
+    if (m_limit > 0 && m_size + len + 32 > m_limit) {
+        m_truncated = true;
+        Close();
+        return;
+    }
+    unsigned long long now = trace_now();
+    PutVarint(now - m_last);
+    m_last = now;
+    unsigned char k = (unsigned char)kind;
+    Put(&k, 1);
+    PutVarint(len);
+    Put(data, len);
+}
+
+
+// ============================================================================
+// WTTraceReader: implementation
+// ============================================================================
+
+WTTraceReader::WTTraceReader() : m_file(NULL), m_time(0), m_startedAt(0) {
+}
+
+WTTraceReader::~WTTraceReader() {
+    Close();
+}
+
+/// Open a trace, checking its signature
+bool WTTraceReader::Open(const std::string& path) {
+    Close();
+    m_file = fopen(path.c_str(), "rb");
+    if (!m_file) {
+        return false;
+    }
+    char signature[sizeof(TRACE_SIGNATURE)];
+    unsigned char stamp[8];
+    if (fread(signature, 1, sizeof(signature), m_file) != sizeof(signature)
+        || memcmp(signature, TRACE_SIGNATURE, sizeof(signature)) != 0
+        || fread(stamp, 1, sizeof(stamp), m_file) != sizeof(stamp)) {
+        Close();
+        return false;
+    }
+    unsigned long long started = 0;
+    for (int i = 0; i < 8; i++) {
+        started |= (unsigned long long)stamp[i] << (8 * i);
+    }
+    m_startedAt = (long long)started;
+    m_time = 0;
+    return true;
+}
+
+void WTTraceReader::Close() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+bool WTTraceReader::GetVarint(unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(m_file);
+        if (c == EOF) {
+            return false;
+        }
+        value |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Read a record: a record cut short, as when the tray has been killed
+/// while recording, ends the trace
+bool WTTraceReader::Next(WTTraceRecord& rec) {
+    unsigned long long delta, len;
+    int kind;
+    if (!m_file || !GetVarint(delta) || (kind = getc(m_file)) == EOF
+        || kind >= WT_TRACE_KIND_COUNT || !GetVarint(len) || len > WT_TRACE_RECORD_MAX) {
+        return false;
+    }
+    m_data.resize(len > 0 ? (size_t)len : 1);
+    if (len > 0 && fread(&m_data[0], 1, (size_t)len, m_file) != len) {
+        return false;
+    }
+    m_time += delta;
+    rec.kind = (WTTraceKind)kind;
+    rec.time_ns = m_time;
+    rec.data = &m_data[0];
+    rec.len = (size_t)len;
+    return true;
+}
+
+
+// end.
@@ -0,0 +1,122 @@
+/// whenever_tray
+///
+/// Traces of the input and output of the scheduler, for reproducing the
+/// conditions of a session offline: the commands written to the scheduler
+/// and the chunks read from its stdout and stderr are recorded as they are,
+/// with the time elapsed since the previous record in nanoseconds. The file
+/// is compact, since times and lengths are stored as variable length
+/// integers, and it is written through a buffer, so that recording costs a
+/// copy per chunk; a trace that grows beyond its limit is stopped, and the
+/// records written so far remain readable.
+///
+/// The file begins with an 8-byte signature and the wall clock time of the
+/// start of the recording, in microseconds since the epoch (little endian),
+/// followed by the records:
+///
+///     varint  nanoseconds since the previous record
+///     byte    kind of record (WTTraceKind)
+///     varint  length of the data
+///     bytes   data
+///
+/// This module does not depend on wxWidgets.
+
+#ifndef WT_TRACE_H
+#define WT_TRACE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// size of the write buffer, and largest record accepted by the reader
+#define WT_TRACE_BUFFER (256 * 1024)
+#define WT_TRACE_RECORD_MAX (16 * 1024 * 1024)
+
+// kinds of records: data written to the scheduler, data read from it, and
+// events of its lifecycle, whose data is a readable text
+enum WTTraceKind {
+    WT_TRACE_STDIN = 0,
+    WT_TRACE_STDOUT,
+    WT_TRACE_STDERR,
+    WT_TRACE_START,             // the command line
+    WT_TRACE_EXIT,              // the exit status
+    WT_TRACE_KIND_COUNT,
+};
+
+// A record as read back: the data is valid until the next record is read
+struct WTTraceRecord {
+    WTTraceKind kind;
+    unsigned long long time_ns;     // since the start of the recording
+    const char* data;
+    size_t len;
+};
+
+// Writer of a trace, used from a single thread
+class WTTraceWriter {
+public:
+    WTTraceWriter();
+    ~WTTraceWriter();
+
+    // create the trace, replacing an existing file: the limit is in bytes,
+    // 0 for none
+    bool Open(const std::string& path, unsigned long long limit = 0);
+    void Close();
+    bool IsOpen() const {
+        return m_file != NULL;
+    }
+
+    void Record(WTTraceKind kind, const char* data, size_t len);
+    void Flush();
+
+    // bytes written so far, and whether the limit has stopped the trace
+    unsigned long long Size() const {
+        return m_size;
+    }
+    bool Truncated() const {
+        return m_truncated;
+    }
+
+private:
+    void Put(const void* data, size_t len);
+    void PutVarint(unsigned long long value);
+
+    FILE* m_file;
+    std::vector<char> m_buffer;
+    unsigned long long m_last;
+    unsigned long long m_size;
+    unsigned long long m_limit;
+    bool m_truncated;
+};
+
+// Reader of a trace
+class WTTraceReader {
+public:
+    WTTraceReader();
+    ~WTTraceReader();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    // read the next record, returning false at the end of the trace or if
+    // the rest of the trace is damaged
+    bool Next(WTTraceRecord& rec);
+
+    long long StartedAt() const {
+        return m_startedAt;
+    }
+
+private:
+    bool GetVarint(unsigned long long& value);
+
+    FILE* m_file;
+    std::vector<char> m_data;
+    unsigned long long m_time;
+    long long m_startedAt;
+};
+
+// name of a kind of record, for reports
+const char* WTTraceKindName(WTTraceKind kind);
+
+
+#endif // WT_TRACE_H
+
+// end.